@@ -7,7 +7,8 @@
 #include <linux/genhd.h>
 
 /*
- * NR_REQUEST is the number of entries in the request-queue.
+ * NR_REQUEST is the default number of entries in the request-queue
+ * of a device, see "queue_depth=" for changing it per major.
  * NOTE that writes may use only the low 2/3 of these: reads
  * take precedence.
  *
@@ -36,6 +37,7 @@ struct request {
 	struct buffer_head * bh;
 	struct buffer_head * bhtail;
 	struct request * next;
+	int passes;		/* times it may still be overtaken */
 };
 
 /*
@@ -48,11 +50,44 @@ struct request {
 ((s1)->dev < (s2)->dev || (((s1)->dev == (s2)->dev && \
 (s1)->sector < (s2)->sector)))))
 
+/*
+ * An I/O scheduler decides where a new request goes in the queue of a
+ * device. Merging buffers into queued requests is done for every policy
+ * by make_request(). The request at the head of the queue may already
+ * be in the hands of the driver, so it is never moved or merged into.
+ */
+struct elevator {
+	char * name;
+	void (*add_request)(struct request * head, struct request * req);
+};
+
+struct blk_stat {
+	unsigned long requests;		/* new requests queued */
+	unsigned long back_merges;	/* buffers added at the tail of a request */
+	unsigned long front_merges;	/* buffers added at the head of a request */
+	unsigned long dispatched;	/* requests started by the driver */
+	unsigned long seek_sectors;	/* distance between dispatched requests */
+	unsigned long last_sector;
+};
+
 struct blk_dev_struct {
 	void (*request_fn)(void);
 	struct request * current_request;
+	struct elevator * elevator;	/* NULL means default_elevator */
+	struct blk_stat stat;
+	int plugging;			/* request_fn may run from a bottom half */
+	struct request plug;		/* dummy queue head while plugged */
+	struct request * requests;	/* request pool, NULL until first use */
+	struct request * free_requests;
+	int nr_requests;		/* size of the pool, 0 means NR_REQUEST */
+	int nr_free;
+	struct wait_queue * wait_for_request;
 };
 
+extern struct elevator elevator_noop;
+extern struct elevator elevator_deadline;
+extern struct elevator * default_elevator;
+
 
 struct sec_size {
 	unsigned block_size;
@@ -72,13 +107,41 @@ struct sec_size {
 
 extern struct sec_size * blk_sec[MAX_BLKDEV];
 extern struct blk_dev_struct blk_dev[MAX_BLKDEV];
-extern struct wait_queue * wait_for_request;
 extern void resetup_one_dev(struct gendisk *dev, int drive);
 
 extern int * blk_size[MAX_BLKDEV];
 
 extern int * blksize_size[MAX_BLKDEV];
 
+/*
+ * Give a request that has been taken off the queue back to the pool.
+ */
+extern inline void free_request(struct blk_dev_struct * dev, struct request * req)
+{
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	req->dev = -1;
+	req->next = dev->free_requests;
+	dev->free_requests = req;
+	dev->nr_free++;
+	restore_flags(flags);
+	wake_up(&dev->wait_for_request);
+}
+
+/*
+ * Called when the driver starts on a request, for the seek statistics.
+ */
+extern inline void blk_dispatch(struct blk_dev_struct * dev, struct request * req)
+{
+	long dist = req->sector - dev->stat.last_sector;
+
+	dev->stat.dispatched++;
+	dev->stat.seek_sectors += (dist < 0) ? -dist : dist;
+	dev->stat.last_sector = req->sector + req->nr_sectors;
+}
+
 extern unsigned long hd_init(unsigned long mem_start, unsigned long mem_end);
 extern unsigned long cdu31a_init(unsigned long mem_start, unsigned long mem_end);
 extern unsigned long mcd_init(unsigned long mem_start, unsigned long mem_end);
@@ -264,6 +327,12 @@ static void end_request(int uptodate)
 		bh->b_uptodate = uptodate;
 		unlock_buffer(bh);
 		if ((bh = req->bh) != NULL) {
+			/* drivers that don't count down current_nr_sectors
+			   leave stepping over the finished buffer to us */
+			if (uptodate && req->current_nr_sectors) {
+				req->sector += req->current_nr_sectors;
+				req->nr_sectors -= req->current_nr_sectors;
+			}
 			req->current_nr_sectors = bh->b_size >> 9;
 			if (req->nr_sectors < req->current_nr_sectors) {
 				req->nr_sectors = req->current_nr_sectors;
@@ -275,14 +344,13 @@ static void end_request(int uptodate)
 	}
 	DEVICE_OFF(req->dev);
 	CURRENT = req->next;
+	if (CURRENT && CURRENT->dev >= 0)
+		blk_dispatch(blk_dev + MAJOR_NR, CURRENT);
 	if ((p = req->waiting) != NULL) {
 		req->waiting = NULL;
-		p->state = TASK_RUNNING;
-		if (p->counter > current->counter)
-			need_resched = 1;
+		wake_up_process(p);
 	}
-	req->dev = -1;
-	wake_up(&wait_for_request);
+	free_request(blk_dev + MAJOR_NR, req);
 }
 #endif
 
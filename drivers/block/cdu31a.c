@@ -1098,6 +1098,8 @@ try_read_again:
             block += 1;
             nsect -= 1;
             CURRENT->buffer += 512;
+            if (--CURRENT->current_nr_sectors == 0 && nsect)
+               end_request(1);      /* on to the next buffer */
          }
                
          end_request(1);
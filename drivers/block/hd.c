@@ -556,6 +556,18 @@ static int hd_ioctl(struct inode * inode, struct file * file,
 			fsync_dev(inode->i_rdev);
 			invalidate_buffers(inode->i_rdev);
 			return 0;
+		case BLKRASET:
+			if(!suser())  return -EACCES;
+			if(arg > 0xff) return -EINVAL;
+			max_readahead[MAJOR(inode->i_rdev)] = arg;
+			return 0;
+		case BLKRAGET:
+			if (!arg)  return -EINVAL;
+			err = verify_area(VERIFY_WRITE, (long *) arg, sizeof(long));
+			if (err)
+				return err;
+			put_fs_long(max_readahead[MAJOR(inode->i_rdev)],(long *) arg);
+			return 0;
 
 		case BLKRRPART: /* Re-read partition tables */
 			return revalidate_hddisk(inode->i_rdev, 1);
@@ -729,7 +741,9 @@ unsigned long hd_init(unsigned long mem_start, unsigned long mem_end)
 		return mem_start;
 	}
 	blk_dev[MAJOR_NR].request_fn = DEVICE_REQUEST;
+	blk_dev[MAJOR_NR].plugging = 1;
 	read_ahead[MAJOR_NR] = 8;		/* 8 sector (4kB) read-ahead */
+	max_readahead[MAJOR_NR] = 64;		/* up to 32kB when sequential */
 	hd_gendisk.next = gendisk_head;
 	gendisk_head = &hd_gendisk;
 	timer_table[HD_TIMER].fn = hd_times_out;
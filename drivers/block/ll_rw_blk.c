@@ -14,6 +14,9 @@
 #include <linux/string.h>
 #include <linux/config.h>
 #include <linux/locks.h>
+#include <linux/mm.h>
+
+#include <linux/interrupt.h>
 
 #include <asm/system.h>
 
@@ -23,21 +26,16 @@
 extern u_long sbpcd_init(u_long, u_long);
 #endif CONFIG_SBPCD
 
-/*
- * The request-struct contains all necessary data
- * to load a nr of sectors into memory
- */
-static struct request all_requests[NR_REQUEST];
-
-/*
- * used to wait on when there are no free requests
- */
-struct wait_queue * wait_for_request = NULL;
-
 /* This specifies how many sectors to read ahead on the disk.  */
 
 int read_ahead[MAX_BLKDEV] = {0, };
 
+/*
+ * How far the read-ahead window of a file being read sequentially may
+ * grow (see file_readahead()). Zero means read_ahead[] of the device.
+ */
+int max_readahead[MAX_BLKDEV] = {0, };
+
 /* blk_dev_struct is:
  *	do_request-address
  *	next-request
@@ -75,47 +73,143 @@ int * blk_size[MAX_BLKDEV] = { NULL, NULL, };
 int * blksize_size[MAX_BLKDEV] = { NULL, NULL, };
 
 /*
- * look for a free request in the first N entries.
- * NOTE: interrupts must be disabled on the way in, and will still
- *       be disabled on the way out.
+ * Every queue has its own pool of requests. It is allocated the first
+ * time the queue is used, as the floppy and scsi drivers only register
+ * after blk_dev_init(), and the size can be set per major at boot with
+ * "queue_depth=major,depth".
  */
-static inline struct request * get_request(int n, int dev)
+#define MAX_REQUESTS	(PAGE_SIZE / sizeof(struct request))
+
+static int init_queue(struct blk_dev_struct * dev)
 {
-	static struct request *prev_found = NULL, *prev_limit = NULL;
-	register struct request *req, *limit;
+	struct request * req;
+	unsigned long page;
+	int n;
 
+	page = __get_free_page(GFP_KERNEL);
+	if (dev->requests) {		/* somebody beat us to it */
+		free_page(page);
+		return 1;
+	}
+	if (!page) {
+		printk("ll_rw_blk: no memory for request queue %d\n",
+			dev - blk_dev);
+		return 0;
+	}
+	n = dev->nr_requests;
 	if (n <= 0)
-		panic("get_request(%d): impossible!\n", n);
-
-	limit = all_requests + n;
-	if (limit != prev_limit) {
-		prev_limit = limit;
-		prev_found = all_requests;
+		n = NR_REQUEST;
+	if (n > MAX_REQUESTS)
+		n = MAX_REQUESTS;
+	dev->nr_requests = n;
+	req = (struct request *) page;
+	cli();
+	while (n-- > 0) {
+		req->dev = -1;
+		req->next = dev->free_requests;
+		dev->free_requests = req;
+		dev->nr_free++;
+		req++;
 	}
-	req = prev_found;
-	for (;;) {
-		req = ((req > all_requests) ? req : limit) - 1;
-		if (req->dev < 0)
-			break;
-		if (req == prev_found)
-			return NULL;
+	dev->requests = (struct request *) page;
+	sti();
+	return 1;
+}
+
+void queue_depth_setup(char *str, int *ints)
+{
+	if (ints[0] != 2 || ints[1] <= 0 || ints[1] >= MAX_BLKDEV) {
+		printk("queue_depth: usage queue_depth=major,depth\n");
+		return;
 	}
-	prev_found = req;
-	req->dev = dev;
+	blk_dev[ints[1]].nr_requests = ints[2];
+}
+
+/*
+ * Take a request from the pool of the queue, as long as that leaves more
+ * than "reserve" of them free.
+ * NOTE: interrupts must be disabled on the way in, and will still
+ *       be disabled on the way out.
+ */
+static inline struct request * get_request(struct blk_dev_struct * dev,
+	int reserve, int devno)
+{
+	struct request * req;
+
+	if (dev->nr_free <= reserve)
+		return NULL;
+	req = dev->free_requests;
+	dev->free_requests = req->next;
+	dev->nr_free--;
+	req->dev = devno;
 	return req;
 }
 
 /*
- * wait until a free request in the first N entries is available.
+ * Plugging: a queue that is idle when buffers are submitted gets a dummy
+ * request at its head, so that the driver doesn't start on the first
+ * buffer while the rest of the batch is still coming in and can't be
+ * merged into it. The queue is unplugged from the BLKDEV_BH bottom half,
+ * or earlier by somebody who has to wait for one of the buffers.
+ *
+ * Only queues whose request_fn doesn't sleep (dev->plugging) can be
+ * unplugged from a bottom half, the others are still plugged for the
+ * length of a single ll_rw_block() call only.
+ */
+static inline void plug_device(struct blk_dev_struct * dev)
+{
+	dev->current_request = &dev->plug;
+	dev->plug.dev = -1;
+	dev->plug.next = NULL;
+	mark_bh(BLKDEV_BH);
+}
+
+static void unplug_device(struct blk_dev_struct * dev)
+{
+	struct request * req;
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	if (dev->current_request == &dev->plug) {
+		req = dev->current_request = dev->plug.next;
+		if (req) {
+			if (!scsi_major(MAJOR(req->dev)))
+				blk_dispatch(dev, req);
+			(dev->request_fn)();
+		}
+	}
+	restore_flags(flags);
+}
+
+void unplug_devices(void)
+{
+	struct blk_dev_struct * dev;
+
+	for (dev = blk_dev ; dev < blk_dev + MAX_BLKDEV ; dev++)
+		if (dev->current_request == &dev->plug)
+			unplug_device(dev);
+}
+
+static void blkdev_bh(void * unused)
+{
+	unplug_devices();
+}
+
+/*
+ * wait until a free request is available.
  * NOTE: interrupts must be disabled on the way in, and will still
  *       be disabled on the way out.
  */
-static inline struct request * get_request_wait(int n, int dev)
+static inline struct request * get_request_wait(struct blk_dev_struct * dev,
+	int devno)
 {
 	register struct request *req;
 
-	while ((req = get_request(n, dev)) == NULL)
-		sleep_on(&wait_for_request);
+	while ((req = get_request(dev, 0, devno)) == NULL) {
+		unplug_devices();
+		sleep_on(&dev->wait_for_request);
+	}
 	return req;
 }
 
@@ -144,6 +238,58 @@ void set_device_ro(int dev,int flag)
 	else ro_bits[major][minor >> 5] &= ~(1 << (minor & 31));
 }
 
+/*
+ * The I/O schedulers. "noop" just queues requests in the order they
+ * arrive, which is all a ramdisk needs. "deadline" is the old one-way
+ * elevator, except that a request can only be overtaken a limited
+ * number of times: after that new requests have to queue up behind it.
+ * Reads get a much smaller limit than writes, as somebody is usually
+ * waiting for them.
+ */
+#define READ_PASSES	8
+#define WRITE_PASSES	64
+
+static void noop_add_request(struct request * head, struct request * req)
+{
+	while (head->next)
+		head = head->next;
+	head->next = req;
+}
+
+static void deadline_add_request(struct request * head, struct request * req)
+{
+	struct request * tmp;
+
+	for (tmp = head->next ; tmp ; tmp = tmp->next)
+		if (tmp->passes <= 0)
+			head = tmp;
+	for (tmp = head ; tmp->next ; tmp = tmp->next) {
+		if ((IN_ORDER(tmp,req) ||
+		    !IN_ORDER(tmp,tmp->next)) &&
+		    IN_ORDER(req,tmp->next))
+			break;
+	}
+	req->next = tmp->next;
+	tmp->next = req;
+	for (tmp = req->next ; tmp ; tmp = tmp->next)
+		tmp->passes--;
+}
+
+struct elevator elevator_noop = { "noop", noop_add_request };
+struct elevator elevator_deadline = { "deadline", deadline_add_request };
+
+struct elevator * default_elevator = &elevator_deadline;
+
+void elevator_setup(char *str, int *ints)
+{
+	if (!strcmp(str, elevator_noop.name))
+		default_elevator = &elevator_noop;
+	else if (!strcmp(str, elevator_deadline.name))
+		default_elevator = &elevator_deadline;
+	else
+		printk("elevator: unknown policy \"%s\"\n", str);
+}
+
 /*
  * add-request adds a request to the linked list.
  * It disables interrupts so that it can muck with the
@@ -152,25 +298,26 @@ void set_device_ro(int dev,int flag)
 static void add_request(struct blk_dev_struct * dev, struct request * req)
 {
 	struct request * tmp;
+	struct elevator * elv;
 
 	req->next = NULL;
+	req->passes = (req->cmd == READ) ? READ_PASSES : WRITE_PASSES;
 	cli();
+	dev->stat.requests++;
 	if (req->bh)
 		req->bh->b_dirt = 0;
 	if (!(tmp = dev->current_request)) {
 		dev->current_request = req;
+		/* scsi counts it when it takes the request off the queue */
+		if (!scsi_major(MAJOR(req->dev)))
+			blk_dispatch(dev, req);
 		(dev->request_fn)();
 		sti();
 		return;
 	}
-	for ( ; tmp->next ; tmp = tmp->next) {
-		if ((IN_ORDER(tmp,req) ||
-		    !IN_ORDER(tmp,tmp->next)) &&
-		    IN_ORDER(req,tmp->next))
-			break;
-	}
-	req->next = tmp->next;
-	tmp->next = req;
+	if (!(elv = dev->elevator))
+		elv = default_elevator;
+	elv->add_request(tmp, req);
 
 /* for SCSI devices, call request_fn unconditionally */
 	if (scsi_major(MAJOR(req->dev)))
@@ -183,7 +330,8 @@ static void make_request(int major,int rw, struct buffer_head * bh)
 {
 	unsigned int sector, count;
 	struct request * req;
-	int rw_ahead, max_req;
+	struct blk_dev_struct * dev = blk_dev + major;
+	int rw_ahead, reserve;
 
 /* WRITEA/READA is special case - it is not really needed, so if the */
 /* buffer is locked, we just forget about it, else it's a normal read */
@@ -207,6 +355,10 @@ static void make_request(int major,int rw, struct buffer_head * bh)
 			bh->b_dirt = bh->b_uptodate = 0;
 			return;
 		}
+	if (!dev->requests && !init_queue(dev)) {
+		bh->b_dirt = bh->b_uptodate = 0;
+		return;
+	}
 	lock_buffer(bh);
 	if ((rw == WRITE && !bh->b_dirt) || (rw == READ && bh->b_uptodate)) {
 		unlock_buffer(bh);
@@ -217,7 +369,7 @@ static void make_request(int major,int rw, struct buffer_head * bh)
  * we want some room for reads: they take precedence. The last third
  * of the requests are only for reads.
  */
-	max_req = (rw == READ) ? NR_REQUEST : ((NR_REQUEST*2)/3);
+	reserve = (rw == READ) ? 0 : dev->nr_requests/3;
 
 /* big loop: look for a free request. */
 
@@ -226,14 +378,11 @@ repeat:
 
 /* The scsi disk drivers completely remove the request from the queue when
  * they start processing an entry.  For this reason it is safe to continue
- * to add links to the top entry for scsi devices.
+ * to add links to the top entry for scsi devices. Every other driver
+ * works on the top entry in place, so that one is left alone.
  */
-	if ((major == HD_MAJOR
-	     || major == SCSI_DISK_MAJOR
-	     || major == SCSI_CDROM_MAJOR)
-	    && (req = blk_dev[major].current_request))
-	{
-	        if (major == HD_MAJOR)
+	if ((req = blk_dev[major].current_request) != NULL) {
+		if (!scsi_major(major))
 			req = req->next;
 		while (req) {
 			if (req->dev == bh->b_dev &&
@@ -246,6 +395,7 @@ repeat:
 				req->bhtail = bh;
 				req->nr_sectors += count;
 				bh->b_dirt = 0;
+				blk_dev[major].stat.back_merges++;
 				sti();
 				return;
 			}
@@ -263,6 +413,7 @@ repeat:
 			    	req->sector = sector;
 			    	bh->b_dirt = 0;
 			    	req->bh = bh;
+			    	blk_dev[major].stat.front_merges++;
 			    	sti();
 			    	return;
 			}    
@@ -272,7 +423,7 @@ repeat:
 	}
 
 /* find an unused request. */
-	req = get_request(max_req, bh->b_dev);
+	req = get_request(dev, reserve, bh->b_dev);
 
 /* if no request available: if rw_ahead, forget it; otherwise try again. */
 	if (! req) {
@@ -281,7 +432,8 @@ repeat:
 			unlock_buffer(bh);
 			return;
 		}
-		sleep_on(&wait_for_request);
+		unplug_devices();
+		sleep_on(&dev->wait_for_request);
 		sti();
 		goto repeat;
 	}
@@ -318,8 +470,10 @@ void ll_rw_page(int rw, int dev, int page, char * buffer)
 		printk("Can't page to read-only device 0x%X\n",dev);
 		return;
 	}
+	if (!blk_dev[major].requests && !init_queue(blk_dev + major))
+		return;
 	cli();
-	req = get_request_wait(NR_REQUEST, dev);
+	req = get_request_wait(blk_dev + major, dev);
 	sti();
 /* fill up the request-info, and add it to the queue */
 	req->cmd = rw;
@@ -333,6 +487,7 @@ void ll_rw_page(int rw, int dev, int page, char * buffer)
 	req->next = NULL;
 	current->state = TASK_SWAPPING;
 	add_request(major+blk_dev,req);
+	unplug_device(major+blk_dev);
 	schedule();
 }
 
@@ -396,7 +551,9 @@ void ll_rw_block(int rw, int nr, struct buffer_head * bh[])
 
 	plugged = 0;
 	cli();
-	if (!dev->current_request && nr > 1) {
+	if (!dev->current_request && dev->plugging)
+		plug_device(dev);
+	else if (!dev->current_request && nr > 1) {
 		dev->current_request = &plug;
 		plug.dev = -1;
 		plug.next = NULL;
@@ -416,6 +573,8 @@ void ll_rw_block(int rw, int nr, struct buffer_head * bh[])
 	if (plugged) {
 		cli();
 		dev->current_request = plug.next;
+		if (plug.next && !scsi_major(major))
+			blk_dispatch(dev, plug.next);
 		(dev->request_fn)();
 		sti();
 	}
@@ -450,12 +609,14 @@ void ll_rw_swap_file(int rw, int dev, unsigned int *b, int nb, char *buf)
 		return;
 	}
 	
+	if (!blk_dev[major].requests && !init_queue(blk_dev + major))
+		return;
 	buffersize = PAGE_SIZE / nb;
 
 	for (i=0; i<nb; i++, buf += buffersize)
 	{
 		cli();
-		req = get_request_wait(NR_REQUEST, dev);
+		req = get_request_wait(blk_dev + major, dev);
 		sti();
 		req->cmd = rw;
 		req->errors = 0;
@@ -468,20 +629,79 @@ void ll_rw_swap_file(int rw, int dev, unsigned int *b, int nb, char *buf)
 		req->next = NULL;
 		current->state = TASK_UNINTERRUPTIBLE;
 		add_request(major+blk_dev,req);
+		unplug_device(major+blk_dev);
 		schedule();
 	}
 }
 
-long blk_dev_init(long mem_start, long mem_end)
+/*
+ * Queue a whole batch of swap pages at once. The buffer heads aren't in
+ * the buffer cache, they only describe where the pieces of the pages go,
+ * so they needn't be of the device's block size: while the device is
+ * plugged make_request() merges neighbouring ones into big requests. The
+ * caller waits on the buffers.
+ */
+void ll_rw_swap_batch(int rw, int nr, struct buffer_head * bh[])
 {
-	struct request * req;
+	unsigned int major = MAJOR(bh[0]->b_dev);
+	struct blk_dev_struct * dev;
+	int i;
 
-	req = all_requests + NR_REQUEST;
-	while (--req >= all_requests) {
-		req->dev = -1;
-		req->next = NULL;
+	if (major >= MAX_BLKDEV || !(blk_dev[major].request_fn)) {
+		printk("ll_rw_swap_batch: trying to swap nonexistent block-device\n");
+		goto sorry;
+	}
+	if (rw == WRITE && is_read_only(bh[0]->b_dev)) {
+		printk("Can't swap to read-only device 0x%X\n",bh[0]->b_dev);
+		goto sorry;
+	}
+	dev = blk_dev + major;
+	cli();
+	if (!dev->current_request)
+		plug_device(dev);
+	sti();
+	for (i = 0; i < nr; i++) {
+		bh[i]->b_req = 1;
+		make_request(major, rw, bh[i]);
 	}
+	unplug_device(dev);
+	return;
+
+sorry:
+	for (i = 0; i < nr; i++)
+		bh[i]->b_dirt = bh[i]->b_uptodate = 0;
+}
+
+/*
+ * Per-major queue statistics for /proc/stat: requests queued, back and
+ * front merges, requests dispatched and the total seek distance.
+ */
+int get_blk_stat(char * buffer)
+{
+	struct blk_dev_struct * dev;
+	struct elevator * elv;
+	int major, len = 0;
+
+	for (major = 0, dev = blk_dev ; major < MAX_BLKDEV ; major++, dev++) {
+		if (!dev->request_fn || !dev->stat.requests)
+			continue;
+		if (!(elv = dev->elevator))
+			elv = default_elevator;
+		len += sprintf(buffer+len, "blk%d %s %lu %lu %lu %lu %lu\n",
+			major, elv->name,
+			dev->stat.requests,
+			dev->stat.back_merges,
+			dev->stat.front_merges,
+			dev->stat.dispatched,
+			dev->stat.seek_sectors);
+	}
+	return len;
+}
+
+long blk_dev_init(long mem_start, long mem_end)
+{
 	memset(ro_bits,0,sizeof(ro_bits));
+	bh_base[BLKDEV_BH].routine = blkdev_bh;
 #ifdef CONFIG_BLK_DEV_HD
 	mem_start = hd_init(mem_start,mem_end);
 #endif
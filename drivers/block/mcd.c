@@ -502,6 +502,8 @@ mcd_transfer(void)
 		CURRENT -> nr_sectors--;
 		CURRENT -> sector++;
 		CURRENT -> buffer += 512;
+		if (--CURRENT -> current_nr_sectors == 0 && CURRENT -> nr_sectors)
+			end_request(1);		/* on to the next buffer */
 	}
 }
 
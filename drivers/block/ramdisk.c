@@ -82,6 +82,7 @@ long rd_init(long mem_start, int length)
 		return 0;
 	}
 	blk_dev[MEM_MAJOR].request_fn = DEVICE_REQUEST;
+	blk_dev[MEM_MAJOR].elevator = &elevator_noop;	/* no seeks to save */
 	rd_start = (char *) mem_start;
 	rd_length = length;
 	cp = rd_start;
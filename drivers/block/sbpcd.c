@@ -2266,6 +2266,8 @@ static void sbp_transfer(void)
       CURRENT->nr_sectors--;
       CURRENT->sector++;
       CURRENT->buffer += 512;
+      if (--CURRENT->current_nr_sectors == 0 && CURRENT->nr_sectors)
+	end_request(1);		/* on to the next buffer */
     }
 }
 /*==========================================================================*/
@@ -91,6 +91,7 @@ u_long xd_init (u_long mem_start,u_long mem_end)
 	}
 	blk_dev[MAJOR_NR].request_fn = DEVICE_REQUEST;
 	read_ahead[MAJOR_NR] = 8;	/* 8 sector (4kB) read ahead */
+	max_readahead[MAJOR_NR] = 64;	/* up to 32kB when sequential */
 	xd_gendisk.next = gendisk_head;
 	gendisk_head = &xd_gendisk;
 
@@ -184,7 +185,7 @@ static void do_xd_request (void)
 
 		if (CURRENT_DEV < xd_drives && CURRENT->sector + CURRENT->nr_sectors <= xd[MINOR(CURRENT->dev)].nr_sects) {
 			block = CURRENT->sector + xd[MINOR(CURRENT->dev)].start_sect;
-			count = CURRENT->nr_sectors;
+			count = CURRENT->current_nr_sectors;
 
 			switch (CURRENT->cmd) {
 				case READ:
@@ -231,6 +232,19 @@ static int xd_ioctl (struct inode *inode,struct file *file,u_int cmd,u_long arg)
 				fsync_dev(inode->i_rdev);
 				invalidate_buffers(inode->i_rdev);
 				return 0;
+			case BLKRASET:
+				if(!suser())  return -EACCES;
+				if(arg > 0xff) return -EINVAL;
+				max_readahead[MAJOR(inode->i_rdev)] = arg;
+				return 0;
+			case BLKRAGET:	if (arg) {
+							if ((err = verify_area(VERIFY_WRITE,(long *) arg,sizeof(long))))
+								return (err);
+							put_fs_long(max_readahead[MAJOR(inode->i_rdev)],(long *) arg);
+
+							return (0);
+						}
+						break;
 				
 			case BLKRRPART:		return (xd_reread_partitions(inode->i_rdev));
 			RO_IOCTLS(inode->i_rdev,arg);
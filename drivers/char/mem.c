@@ -103,13 +103,14 @@ static int mmap_mem(struct inode * inode, struct file * file,
 	mpnt->vm_start = addr;
 	mpnt->vm_end = addr + len;
 	mpnt->vm_page_prot = prot;
+	mpnt->vm_flags = (prot & (PAGE_RW | PAGE_COW)) == PAGE_RW ? VM_SHARED : 0;
 	mpnt->vm_share = NULL;
 	mpnt->vm_inode = inode;
 	inode->i_count++;
 	mpnt->vm_offset = off;
 	mpnt->vm_ops = NULL;
 	insert_vm_struct(current, mpnt);
-	merge_segments(current->mmap, NULL, NULL);
+	merge_segments(current, addr, addr + len, NULL, NULL);
 	return 0;
 }
 
@@ -197,12 +198,13 @@ static int mmap_zero(struct inode * inode, struct file * file,
 	mpnt->vm_start = addr;
 	mpnt->vm_end = addr + len;
 	mpnt->vm_page_prot = prot;
+	mpnt->vm_flags = 0;
 	mpnt->vm_share = NULL;
 	mpnt->vm_inode = NULL;
 	mpnt->vm_offset = off;
 	mpnt->vm_ops = NULL;
 	insert_vm_struct(current, mpnt);
-	merge_segments(current->mmap, ignoff_mergep, inode);
+	merge_segments(current, addr, addr + len, ignoff_mergep, inode);
 	return 0;
 }
 
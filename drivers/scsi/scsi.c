@@ -554,6 +554,7 @@ Scsi_Cmnd * request_queueable (struct request * req, int index)
       && scsi_devices[index].host->host_busy >= scsi_devices[index].host->hostt->can_queue) return NULL;
 
   if (req) {
+    blk_dispatch(blk_dev + MAJOR(req->dev), req);
     memcpy(&SCpnt->request, req, sizeof(struct request));
     tablesize = scsi_devices[index].host->sg_tablesize;
     bh = req->bh;
@@ -651,6 +652,7 @@ Scsi_Cmnd * allocate_device (struct request ** reqp, int index, int wait)
 		   (SCwait->request.dev > 0));
       } else {
 	if (req) {
+	  blk_dispatch(blk_dev + MAJOR(req->dev), req);
 	  memcpy(&SCpnt->request, req, sizeof(struct request));
 	  tablesize = scsi_devices[index].host->sg_tablesize;
 	  bh = req->bh;
@@ -677,8 +679,8 @@ Scsi_Cmnd * allocate_device (struct request ** reqp, int index, int wait)
 	  }
 	  else 
 	    {
-	      req->dev = -1;
 	      *reqp = req->next;
+	      free_request(blk_dev + MAJOR(dev), req);
 	    };
 	} else {
 	  SCpnt->request.dev = 0xffff; /* Busy */
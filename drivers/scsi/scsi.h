@@ -486,9 +486,7 @@ static void end_scsi_request(Scsi_Cmnd * SCpnt, int uptodate, int sectors)
 	DEVICE_OFF(req->dev);
 	if ((p = req->waiting) != NULL) {
 		req->waiting = NULL;
-		p->state = TASK_RUNNING;
-		if (p->counter > current->counter)
-			need_resched = 1;
+		wake_up_process(p);
 	}
 	req->dev = -1;
 	wake_up(&scsi_devices[SCpnt->index].device_wait);
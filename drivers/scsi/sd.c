@@ -364,14 +364,13 @@ static void do_sd_request (void)
 	  CURRENT = CURRENT->next;
 	else
 	  req1->next = req->next;
+	free_request(blk_dev + MAJOR_NR, req);
       };
       sti();
     };
     
     if (!SCpnt) return; /* Could not find anything to do */
     
-    wake_up(&wait_for_request);
-    
     /* Queue command */
     requeue_sd_request(SCpnt);
   };  /* While */
@@ -655,9 +654,7 @@ static void sd_init_done (Scsi_Cmnd * SCpnt)
   
   if ((p = req->waiting) != NULL) {
     req->waiting = NULL;
-    p->state = TASK_RUNNING;
-    if (p->counter > current->counter)
-      need_resched = 1;
+    wake_up_process(p);
   }
 }
 
@@ -888,15 +885,20 @@ unsigned long sd_init(unsigned long memory_start, unsigned long memory_end)
 	  i = sd_init_onedisk(i);
 
 	blk_dev[MAJOR_NR].request_fn = DEVICE_REQUEST;
+	blk_dev[MAJOR_NR].plugging = 1;
 
 	/* If our host adapter is capable of scatter-gather, then we increase
 	   the read-ahead to 16 blocks (32 sectors).  If not, we use
 	   a two block (4 sector) read ahead. */
-	if(rscsi_disks[0].device->host->sg_tablesize)
+	if(rscsi_disks[0].device->host->sg_tablesize) {
 	  read_ahead[MAJOR_NR] = 32;
+	  max_readahead[MAJOR_NR] = 128;  /* up to 64kB when sequential */
+	}
 	/* 64 sector read-ahead */
-	else
+	else {
 	  read_ahead[MAJOR_NR] = 4;  /* 4 sector read-ahead */
+	  max_readahead[MAJOR_NR] = 4;
+	}
 	
 	sd_gendisk.next = gendisk_head;
 	gendisk_head = &sd_gendisk;
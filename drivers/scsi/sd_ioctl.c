@@ -59,6 +59,18 @@ int sd_ioctl(struct inode * inode, struct file * file, unsigned int cmd, unsigne
  			fsync_dev(inode->i_rdev);
 			invalidate_buffers(inode->i_rdev);
 			return 0;
+		case BLKRASET:
+			if(!suser())  return -EACCES;
+			if(arg > 0xff) return -EINVAL;
+			max_readahead[MAJOR(inode->i_rdev)] = arg;
+			return 0;
+		case BLKRAGET:
+			if (!arg)  return -EINVAL;
+			error = verify_area(VERIFY_WRITE, (long *) arg, sizeof(long));
+			if (error)
+				return error;
+			put_fs_long(max_readahead[MAJOR(inode->i_rdev)],(long *) arg);
+			return 0;
 
 		case BLKRRPART: /* Re-read partition tables */
 			return revalidate_scsidisk(dev, 1);
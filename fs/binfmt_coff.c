@@ -442,6 +442,7 @@ load_object (struct linux_binprm * bprm, struct pt_regs *regs, int lib_ok)
  *  Define the initial locations for the various items in the new process
  */
 	    current->mmap        = NULL;
+	    current->mmap_avl    = NULL;
 	    current->rss         = 0;
 /*
  *  Construct the parameter and environment string table entries.
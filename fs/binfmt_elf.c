@@ -58,6 +58,7 @@ unsigned long * create_elf_tables(char * p,int argc,int envc,struct elfhdr * exe
 		mpnt->vm_start = PAGE_MASK & (unsigned long) p;
 		mpnt->vm_end = TASK_SIZE;
 		mpnt->vm_page_prot = PAGE_PRIVATE|PAGE_DIRTY;
+		mpnt->vm_flags = 0;
 		mpnt->vm_share = NULL;
 		mpnt->vm_inode = NULL;
 		mpnt->vm_offset = 0;
@@ -420,6 +421,7 @@ int load_elf_binary(struct linux_binprm * bprm, struct pt_regs * regs)
 	current->end_code = 0;
 	current->start_mmap = ELF_START_MMAP;
 	current->mmap = NULL;
+	current->mmap_avl = NULL;
 	elf_entry = (unsigned int) elf_ex.e_entry;
 	
 	/* Do this so that we can load the interpreter, if need be.  We will
@@ -67,7 +67,7 @@ int block_write(struct inode * inode, struct file * filp, char * buf, int count)
 		p += chars;
 		buf += chars;
 		bh->b_uptodate = 1;
-		bh->b_dirt = 1;
+		mark_buffer_dirty(bh);
 		brelse(bh);
 	}
 	return written;
@@ -90,7 +90,8 @@ int block_read(struct inode * inode, struct file * filp, char * buf, int count)
 	unsigned int chars;
 	unsigned int size;
 	unsigned int dev;
-	int read;
+	unsigned int rablock, raend;
+	int read, ra;
 
 	dev = inode->i_rdev;
 	blocksize = BLOCK_SIZE;
@@ -117,17 +118,18 @@ int block_read(struct inode * inode, struct file * filp, char * buf, int count)
 		left = count;
 	if (left <= 0)
 		return 0;
+	ra = file_readahead(filp, dev, offset, left);
 	read = 0;
 	block = offset >> blocksize_bits;
 	offset &= blocksize-1;
 	size >>= blocksize_bits;
 	blocks = (left + offset + blocksize - 1) >> blocksize_bits;
 	bhb = bhe = buflist;
-	if (filp->f_reada) {
-		blocks += read_ahead[MAJOR(dev)] / (blocksize >> 9);
-		if (block + blocks > size)
-			blocks = size - block;
-	}
+	ra /= blocksize >> 9;
+	rablock = block + blocks;
+	raend = rablock + ra;
+	if (raend > size)
+		raend = size;
 
 	/* We do this in a two stage process.  We first try and request
 	   as many blocks as we can, then we wait for the first one to
@@ -197,7 +199,7 @@ int block_read(struct inode * inode, struct file * filp, char * buf, int count)
 		} while (left > 0 && bhe != bhb && (!*bhe || !(*bhe)->b_lock));
 	} while (left > 0);
 
-/* Release the read-ahead blocks */
+/* Release the blocks a read error left unused */
 	while (bhe != bhb) {
 		brelse(*bhe);
 		if (++bhe == &buflist[NBUF])
@@ -205,6 +207,19 @@ int block_read(struct inode * inode, struct file * filp, char * buf, int count)
 	};
 	if (!read)
 		return -EIO;
+
+/* Keep the read-ahead window ahead of the reader: once less than half */
+/* of it is still to come, start reading up to its far end */
+	if (rablock < raend && filp->f_raend < rablock + (ra >> 1)) {
+		if (filp->f_raend > rablock)
+			rablock = filp->f_raend;
+		while (rablock < raend) {
+			for (i = 0; i < NBUF && rablock < raend; i++)
+				bhreq[i] = getblk(dev, rablock++, blocksize);
+			read_ahead_buffers(bhreq, i);
+		}
+		filp->f_raend = raend;
+	}
 	filp->f_reada = 1;
 	return read;
 }
@@ -22,12 +22,14 @@
 #include <linux/errno.h>
 #include <linux/sched.h>
 #include <linux/kernel.h>
+#include <linux/kernel_stat.h>
 #include <linux/major.h>
 #include <linux/string.h>
 #include <linux/locks.h>
 #include <linux/errno.h>
 
 #include <asm/system.h>
+#include <asm/segment.h>
 #include <asm/io.h>
 
 #ifdef CONFIG_SCSI
@@ -48,11 +50,54 @@ extern int check_mcd_media_change(int, int);
 
 static int grow_buffers(int pri, int size);
 
-static struct buffer_head * hash_table[NR_HASH];
-static struct buffer_head * free_list = NULL;
+/*
+ * The hash table starts out as a single page and is doubled (up to
+ * MAX_NR_HASH entries) whenever there are more than two buffers per
+ * chain on average.
+ */
+#define MAX_NR_HASH	65536
+
+static struct buffer_head ** hash_table = NULL;
+static int nr_hash = 0;			/* always a power of two */
+static int hash_vmalloced = 0;
+
+/*
+ * Every buffer is on one of these lists, each kept in LRU order: the
+ * clean list is where getblk() finds its victims, the dirty list is
+ * all that sync_buffers() has to walk, and the locked list holds the
+ * buffers that have been handed to the driver for writing.
+ */
+static struct buffer_head * lru_list[NR_LIST] = { NULL, };
+static int nr_buffers_type[NR_LIST] = { 0, };
 static struct buffer_head * unused_list = NULL;
 static struct wait_queue * buffer_wait = NULL;
 
+/*
+ * The dirty-buffer flushing daemon, see sys_bdflush() at the end of
+ * this file. Its tunables can be read and set through the same call.
+ */
+static struct task_struct * bdflush_tsk = NULL;
+static struct wait_queue * bdflush_wait = NULL;
+static struct wait_queue * bdflush_done = NULL;
+
+#define N_PARAM 4
+
+static union bdflush_param {
+	struct {
+		int nfract;	/* percentage of buffers dirty before bdflush
+				   starts writing regardless of age */
+		int ndirty;	/* max number of buffers written per wakeup */
+		int age_buffer;	/* jiffies a buffer may stay dirty */
+		int interval;	/* jiffies between bdflush wakeups */
+	} b_un;
+	unsigned int data[N_PARAM];
+} bdf_prm = {{25, 500, 30*HZ, 5*HZ}};
+
+static int bdflush_min[N_PARAM] = {  1,   10,   1*HZ,   1*HZ };
+static int bdflush_max[N_PARAM] = { 100, 5000, 600*HZ, 600*HZ };
+
+static void wakeup_bdflush(int wait);
+
 int nr_buffers = 0;
 int buffermem = 0;
 int nr_buffer_heads = 0;
@@ -74,6 +119,7 @@ void __wait_on_buffer(struct buffer_head * bh)
 
 	bh->b_count++;
 	add_wait_queue(&bh->b_wait, &wait);
+	unplug_devices();
 repeat:
 	current->state = TASK_UNINTERRUPTIBLE;
 	if (bh->b_lock) {
@@ -98,45 +144,62 @@ static int sync_buffers(dev_t dev, int wait)
 	   0) write out all dirty, unlocked buffers;
 	   1) write out all dirty buffers, waiting if locked;
 	   2) wait for completion by waiting for all buffers to unlock.
+	   The first two only have to look at the dirty list, the last
+	   one at the locked list. We always work on the head of the list
+	   and rotate past the buffers we skip, as the lists may change
+	   under us whenever we sleep.
 	 */
 repeat:
 	retry = 0;
-	bh = free_list;
-	for (i = nr_buffers*2 ; i-- > 0 ; bh = bh->b_next_free) {
-		if (dev && bh->b_dev != dev)
-			continue;
-#ifdef 0 /* Disable bad-block debugging code */
-		if (bh->b_req && !bh->b_lock &&
-		    !bh->b_dirt && !bh->b_uptodate)
-			printk ("Warning (IO error) - orphaned block %08x on %04x\n",
-				bh->b_blocknr, bh->b_dev);
-#endif
-		if (bh->b_lock)
-		{
-			/* Buffer is locked; skip it unless wait is
-			   requested AND pass > 0. */
-			if (!wait || !pass) {
-				retry = 1;
+	if (pass < 2) {
+		for (i = nr_buffers_type[BUF_DIRTY]*2 ; i-- > 0 ; ) {
+			if (!(bh = lru_list[BUF_DIRTY]))
+				break;
+			if (!bh->b_dirt) {
+				refile_buffer(bh);
+				continue;
+			}
+			if (dev && bh->b_dev != dev) {
+				lru_list[BUF_DIRTY] = bh->b_next_free;
 				continue;
 			}
-			wait_on_buffer (bh);
+			if (bh->b_lock)
+			{
+				/* Buffer is locked; skip it unless wait is
+				   requested AND pass > 0. */
+				if (!wait || !pass) {
+					retry = 1;
+					lru_list[BUF_DIRTY] = bh->b_next_free;
+					continue;
+				}
+				wait_on_buffer (bh);
+				continue;
+			}
+			bh->b_count++;
+			ll_rw_block(WRITE, 1, &bh);
+			bh->b_count--;
+			refile_buffer(bh);
+			retry = 1;
 		}
-		/* If an unlocked buffer is not uptodate, there has been 
-		   an IO error. Skip it. */
-		if (wait && bh->b_req && !bh->b_lock &&
-		    !bh->b_dirt && !bh->b_uptodate)
-		{
-			err = 1;
-			continue;
+	}
+	if (wait && pass) {
+		for (i = nr_buffers_type[BUF_LOCKED]*2 ; i-- > 0 ; ) {
+			if (!(bh = lru_list[BUF_LOCKED]))
+				break;
+			if (dev && bh->b_dev != dev) {
+				lru_list[BUF_LOCKED] = bh->b_next_free;
+				continue;
+			}
+			if (bh->b_lock) {
+				wait_on_buffer (bh);
+				continue;
+			}
+			/* If an unlocked buffer is not uptodate, there has been 
+			   an IO error. */
+			if (bh->b_req && !bh->b_dirt && !bh->b_uptodate)
+				err = 1;
+			refile_buffer(bh);
 		}
-		/* Don't write clean buffers.  Don't write ANY buffers
-		   on the third pass. */
-		if (!bh->b_dirt || pass>=2)
-			continue;
-		bh->b_count++;
-		ll_rw_block(WRITE, 1, &bh);
-		bh->b_count--;
-		retry = 1;
 	}
 	/* If we are waiting for the sync to succeed, and if any dirty
 	   blocks were written, then repeat; on the second pass, only
@@ -190,16 +253,18 @@ asmlinkage int sys_fsync(unsigned int fd)
 
 void invalidate_buffers(dev_t dev)
 {
-	int i;
+	int i, nlist;
 	struct buffer_head * bh;
 
-	bh = free_list;
-	for (i = nr_buffers*2 ; --i > 0 ; bh = bh->b_next_free) {
-		if (bh->b_dev != dev)
-			continue;
-		wait_on_buffer(bh);
-		if (bh->b_dev == dev)
-			bh->b_uptodate = bh->b_dirt = bh->b_req = 0;
+	for (nlist = 0 ; nlist < NR_LIST ; nlist++) {
+		bh = lru_list[nlist];
+		for (i = nr_buffers_type[nlist]*2 ; bh && --i > 0 ; bh = bh->b_next_free) {
+			if (bh->b_dev != dev)
+				continue;
+			wait_on_buffer(bh);
+			if (bh->b_dev == dev)
+				bh->b_uptodate = bh->b_dirt = bh->b_req = 0;
+		}
 	}
 }
 
@@ -276,9 +341,18 @@ void check_disk_change(dev_t dev)
 #endif
 }
 
-#define _hashfn(dev,block) (((unsigned)(dev^block))%NR_HASH)
+#define _hashfn(dev,block) (((unsigned)(dev^block)) & (nr_hash-1))
 #define hash(dev,block) hash_table[_hashfn(dev,block)]
 
+static inline int buffer_list(struct buffer_head * bh)
+{
+	if (bh->b_dirt)
+		return BUF_DIRTY;
+	if (bh->b_lock)
+		return BUF_LOCKED;
+	return BUF_CLEAN;
+}
+
 static inline void remove_from_hash_queue(struct buffer_head * bh)
 {
 	if (bh->b_next)
@@ -290,68 +364,138 @@ static inline void remove_from_hash_queue(struct buffer_head * bh)
 	bh->b_next = bh->b_prev = NULL;
 }
 
-static inline void remove_from_free_list(struct buffer_head * bh)
+static inline void insert_into_hash_queue(struct buffer_head * bh)
+{
+	bh->b_prev = NULL;
+	bh->b_next = NULL;
+	if (!bh->b_dev)
+		return;
+	bh->b_next = hash(bh->b_dev,bh->b_blocknr);
+	hash(bh->b_dev,bh->b_blocknr) = bh;
+	if (bh->b_next)
+		bh->b_next->b_prev = bh;
+}
+
+static inline void remove_from_lru_list(struct buffer_head * bh)
 {
+	int nlist = bh->b_list;
+
 	if (!(bh->b_prev_free) || !(bh->b_next_free))
-		panic("VFS: Free block list corrupted");
-	bh->b_prev_free->b_next_free = bh->b_next_free;
-	bh->b_next_free->b_prev_free = bh->b_prev_free;
-	if (free_list == bh)
-		free_list = bh->b_next_free;
+		panic("VFS: LRU block list corrupted");
+	if (bh->b_next_free == bh)
+		lru_list[nlist] = NULL;
+	else {
+		bh->b_prev_free->b_next_free = bh->b_next_free;
+		bh->b_next_free->b_prev_free = bh->b_prev_free;
+		if (lru_list[nlist] == bh)
+			lru_list[nlist] = bh->b_next_free;
+	}
 	bh->b_next_free = bh->b_prev_free = NULL;
+	nr_buffers_type[nlist]--;
+}
+
+static inline void put_last_lru(struct buffer_head * bh, int nlist)
+{
+	struct buffer_head * head = lru_list[nlist];
+
+	if (!head) {
+		lru_list[nlist] = bh->b_next_free = bh->b_prev_free = bh;
+	} else {
+		bh->b_next_free = head;
+		bh->b_prev_free = head->b_prev_free;
+		head->b_prev_free->b_next_free = bh;
+		head->b_prev_free = bh;
+	}
+	bh->b_list = nlist;
+	nr_buffers_type[nlist]++;
+}
+
+static inline void put_first_lru(struct buffer_head * bh, int nlist)
+{
+	put_last_lru(bh, nlist);
+	lru_list[nlist] = bh;
 }
 
 static inline void remove_from_queues(struct buffer_head * bh)
 {
 	remove_from_hash_queue(bh);
-	remove_from_free_list(bh);
+	remove_from_lru_list(bh);
 }
 
-static inline void put_first_free(struct buffer_head * bh)
+/*
+ * Mark a buffer as recently used: it goes to the back of whatever list
+ * it belongs on.
+ */
+static inline void touch_buffer(struct buffer_head * bh)
 {
-	if (!bh || (bh == free_list))
-		return;
-	remove_from_free_list(bh);
-/* add to front of free list */
-	bh->b_next_free = free_list;
-	bh->b_prev_free = free_list->b_prev_free;
-	free_list->b_prev_free->b_next_free = bh;
-	free_list->b_prev_free = bh;
-	free_list = bh;
+	remove_from_lru_list(bh);
+	put_last_lru(bh, buffer_list(bh));
 }
 
-static inline void put_last_free(struct buffer_head * bh)
+static inline void insert_into_queues(struct buffer_head * bh)
 {
-	if (!bh)
+	put_last_lru(bh, buffer_list(bh));
+	insert_into_hash_queue(bh);
+}
+
+/*
+ * Buffers change state behind our back: interrupts unlock them and
+ * ll_rw_block() cleans them. The lists are therefore only kept roughly
+ * right, and this is called to move a buffer to the proper list
+ * whenever somebody notices that it has drifted.
+ */
+void refile_buffer(struct buffer_head * bh)
+{
+	int nlist;
+
+	if (!bh->b_next_free)
 		return;
-	if (bh == free_list) {
-		free_list = bh->b_next_free;
+	nlist = buffer_list(bh);
+	if (nlist == bh->b_list)
 		return;
+	remove_from_lru_list(bh);
+	put_last_lru(bh, nlist);
+	if (nlist == BUF_DIRTY) {
+		bh->b_flushtime = jiffies + bdf_prm.b_un.age_buffer;
+		if (nr_buffers_type[BUF_DIRTY]*100 > nr_buffers*bdf_prm.b_un.nfract)
+			wakeup_bdflush(0);
 	}
-	remove_from_free_list(bh);
-/* add to back of free list */
-	bh->b_next_free = free_list;
-	bh->b_prev_free = free_list->b_prev_free;
-	free_list->b_prev_free->b_next_free = bh;
-	free_list->b_prev_free = bh;
 }
 
-static inline void insert_into_queues(struct buffer_head * bh)
+/*
+ * Double the size of the hash table. The new table is allocated before
+ * anything is touched, as vmalloc() may sleep and end up shrinking the
+ * buffer cache under us; the rehash itself doesn't sleep.
+ */
+static void grow_hash_table(void)
 {
-/* put at end of free list */
-	bh->b_next_free = free_list;
-	bh->b_prev_free = free_list->b_prev_free;
-	free_list->b_prev_free->b_next_free = bh;
-	free_list->b_prev_free = bh;
-/* put the buffer in new hash-queue if it has a device */
-	bh->b_prev = NULL;
-	bh->b_next = NULL;
-	if (!bh->b_dev)
+	struct buffer_head ** old = hash_table, ** new;
+	struct buffer_head * bh, * next;
+	int i, old_size = nr_hash, size = nr_hash << 1;
+
+	if (size > MAX_NR_HASH)
 		return;
-	bh->b_next = hash(bh->b_dev,bh->b_blocknr);
-	hash(bh->b_dev,bh->b_blocknr) = bh;
-	if (bh->b_next)
-		bh->b_next->b_prev = bh;
+	new = (struct buffer_head **) vmalloc(size * sizeof(*new));
+	if (!new)
+		return;
+	if (nr_hash != old_size) {
+		vfree(new);
+		return;
+	}
+	memset(new, 0, size * sizeof(*new));
+	hash_table = new;
+	nr_hash = size;
+	for (i = 0 ; i < old_size ; i++) {
+		for (bh = old[i] ; bh ; bh = next) {
+			next = bh->b_next;
+			insert_into_hash_queue(bh);
+		}
+	}
+	if (hash_vmalloced)
+		vfree(old);
+	else
+		free_page((unsigned long) old);
+	hash_vmalloced = 1;
 }
 
 static struct buffer_head * find_buffer(dev_t dev, int block, int size)
@@ -394,7 +538,7 @@ struct buffer_head * get_hash_table(dev_t dev, int block, int size)
 
 void set_blocksize(dev_t dev, int size)
 {
-	int i;
+	int i, nlist;
 	struct buffer_head * bh, *bhnext;
 
 	if (!blksize_size[MAJOR(dev)])
@@ -417,20 +561,86 @@ void set_blocksize(dev_t dev, int size)
   /* We need to be quite careful how we do this - we are moving entries
      around on the free list, and we can get in a loop if we are not careful.*/
 
-	bh = free_list;
-	for (i = nr_buffers*2 ; --i > 0 ; bh = bhnext) {
-		bhnext = bh->b_next_free; 
-		if (bh->b_dev != dev)
+	for (nlist = 0 ; nlist < NR_LIST ; nlist++) {
+		bh = lru_list[nlist];
+		for (i = nr_buffers_type[nlist]*2 ; bh && --i > 0 ; bh = bhnext) {
+			bhnext = bh->b_next_free; 
+			if (bh->b_dev != dev)
+				continue;
+			if (bh->b_size == size)
+				continue;
+
+			wait_on_buffer(bh);
+			if (bh->b_dev == dev && bh->b_size != size)
+				bh->b_uptodate = bh->b_dirt = 0;
+			remove_from_hash_queue(bh);
+		}
+	}
+}
+
+/*
+ * Find a clean, unused buffer of the right size to recycle. The clean
+ * list is in LRU order, so this is normally the very first one: busy
+ * buffers are moved out of the way to the back of the list, and ones
+ * that have become dirty or locked are refiled.
+ */
+static struct buffer_head * find_victim(int size)
+{
+	struct buffer_head * bh, * next;
+	int i;
+
+	bh = lru_list[BUF_CLEAN];
+	for (i = nr_buffers_type[BUF_CLEAN] ; bh && i-- > 0 ; bh = next) {
+		next = bh->b_next_free;
+		kstat.buffer_scans++;
+		if (bh->b_dirt || bh->b_lock) {
+			refile_buffer(bh);
+			if (next == bh)
+				break;
 			continue;
-		if (bh->b_size == size)
+		}
+		if (bh->b_count || bh->b_size != size ||
+		    mem_map[MAP_NR((unsigned long) bh->b_data)] != 1) {
+			touch_buffer(bh);
 			continue;
+		}
+		return bh;
+	}
+	return NULL;
+}
 
+/*
+ * No clean buffer to be had: get bdflush to write out the dirty ones,
+ * refile any that have finished writing without anybody noticing, and
+ * only sleep if there really is nothing that will become free soon.
+ */
+static void wait_for_buffers(void)
+{
+	struct buffer_head * bh;
+	int i, moved = 0;
+
+	if (nr_buffers_type[BUF_DIRTY])
+		wakeup_bdflush(1);
+	for (i = nr_buffers_type[BUF_LOCKED] ; i-- > 0 ; ) {
+		if (!(bh = lru_list[BUF_LOCKED]))
+			break;
+		if (bh->b_lock) {
+			lru_list[BUF_LOCKED] = bh->b_next_free;
+			continue;
+		}
+		refile_buffer(bh);
+		moved++;
+	}
+	if (moved)
+		return;
+	if ((bh = lru_list[BUF_LOCKED]) != NULL) {
+		bh->b_count++;
 		wait_on_buffer(bh);
-		if (bh->b_dev == dev && bh->b_size != size)
-			bh->b_uptodate = bh->b_dirt = 0;
-		remove_from_hash_queue(bh);
-/*    put_first_free(bh); */
+		bh->b_count--;
+		refile_buffer(bh);
+		return;
 	}
+	sleep_on(&buffer_wait);
 }
 
 /*
@@ -443,69 +653,54 @@ void set_blocksize(dev_t dev, int size)
  * 14.02.92: changed it to sync dirty buffers a bit: better performance
  * when the filesystem starts to get full of dirty blocks (I hope).
  */
-#define BADNESS(bh) (((bh)->b_dirt<<1)+(bh)->b_lock)
 struct buffer_head * getblk(dev_t dev, int block, int size)
 {
-	struct buffer_head * bh, * tmp;
-	int buffers;
+	struct buffer_head * bh;
 	static int grow_size = 0;
 
+	kstat.buffer_lookups++;
 repeat:
 	bh = get_hash_table(dev, block, size);
 	if (bh) {
-		if (bh->b_uptodate && !bh->b_dirt)
-			put_last_free(bh);
+		touch_buffer(bh);
+		kstat.buffer_hits++;
+		if (bh->b_reada) {
+			bh->b_reada = 0;
+			if (bh->b_uptodate || bh->b_lock)
+				kstat.ra_hits++;
+		}
 		return bh;
 	}
+	if (nr_buffers > (nr_hash << 1))
+		grow_hash_table();
 	grow_size -= size;
 	if (nr_free_pages > min_free_pages && grow_size <= 0) {
 		if (grow_buffers(GFP_BUFFER, size))
 			grow_size = PAGE_SIZE;
 	}
-	buffers = nr_buffers;
-	bh = NULL;
-
-	for (tmp = free_list; buffers-- > 0 ; tmp = tmp->b_next_free) {
-		if (tmp->b_count || tmp->b_size != size)
-			continue;
-		if (mem_map[MAP_NR((unsigned long) tmp->b_data)] != 1)
-			continue;
-		if (!bh || BADNESS(tmp)<BADNESS(bh)) {
-			bh = tmp;
-			if (!BADNESS(tmp))
-				break;
-		}
-#if 0
-		if (tmp->b_dirt) {
-			tmp->b_count++;
-			ll_rw_block(WRITEA, 1, &tmp);
-			tmp->b_count--;
-		}
-#endif
-	}
-
+	bh = find_victim(size);
 	if (!bh) {
 		if (nr_free_pages > 5)
 			if (grow_buffers(GFP_BUFFER, size))
 				goto repeat;
 		if (!grow_buffers(GFP_ATOMIC, size))
-			sleep_on(&buffer_wait);
+			wait_for_buffers();
 		goto repeat;
 	}
 
 	wait_on_buffer(bh);
-	if (bh->b_count || bh->b_size != size)
-		goto repeat;
-	if (bh->b_dirt) {
-		sync_buffers(0,0);
+	if (bh->b_count || bh->b_size != size || bh->b_dirt)
 		goto repeat;
-	}
 /* NOTE!! While we slept waiting for this block, somebody else might */
 /* already have added "this" block to the cache. check it */
 	if (find_buffer(dev,block,size))
 		goto repeat;
 /* OK, FINALLY we know that this buffer is the only one of its kind, */
 /* and that it's unused (b_count=0), unlocked (b_lock=0), and clean */
+	if (bh->b_reada) {
+		bh->b_reada = 0;
+		kstat.ra_wasted++;
+	}
 	bh->b_count=1;
 	bh->b_dirt=0;
 	bh->b_uptodate=0;
@@ -522,6 +717,7 @@ void brelse(struct buffer_head * buf)
 	if (!buf)
 		return;
 	wait_on_buffer(buf);
+	refile_buffer(buf);
 	if (buf->b_count) {
 		if (--buf->b_count)
 			return;
@@ -594,6 +790,76 @@ struct buffer_head * breada(dev_t dev,int first, ...)
 	return (NULL);
 }
 
+/*
+ * file_readahead() keeps the read-ahead window of an open file. It is
+ * told the device and where the coming read starts and how long it is.
+ * A read that starts where the last one ended doubles the window, up
+ * to max_readahead[] of the device, any other read halves it, and the
+ * first read after an open or lseek() starts without one. Returns the
+ * window in 512-byte sectors.
+ */
+#define MIN_READAHEAD	8
+
+int file_readahead(struct file * filp, dev_t dev, off_t pos, int count)
+{
+	int win, max;
+
+	max = max_readahead[MAJOR(dev)];
+	if (!max)
+		max = read_ahead[MAJOR(dev)];
+
+	if (filp->f_reada && pos == filp->f_ranext) {
+		win = filp->f_rawin << 1;
+		if (win < MIN_READAHEAD)
+			win = MIN_READAHEAD;
+	} else {
+		win = 0;
+		if (filp->f_reada && filp->f_rawin >= MIN_READAHEAD << 1)
+			win = filp->f_rawin >> 1;
+		filp->f_raend = 0;
+	}
+	if (win > max)
+		win = max;
+	filp->f_rawin = win;
+	filp->f_ranext = pos + count;
+	return win;
+}
+
+/*
+ * Start reading the buffers a reader is expected to want next, and let
+ * go of them without waiting: when the reader gets there it finds them
+ * in the cache. They are marked, so that getblk() can count the ones
+ * that were used and the ones that were thrown out unused.
+ */
+void read_ahead_buffers(struct buffer_head * bh[], int nr)
+{
+	int i, n;
+
+	for (i = n = 0 ; i < nr ; i++) {
+		if (!bh[i])
+			continue;
+		if (bh[i]->b_uptodate || bh[i]->b_lock) {
+			if (!--bh[i]->b_count)
+				wake_up(&buffer_wait);
+			continue;
+		}
+		bh[i]->b_reada = 1;
+		bh[n++] = bh[i];
+	}
+	if (!n)
+		return;
+	ll_rw_block(READA, n, bh);
+	for (i = 0 ; i < n ; i++) {
+		/* READA is dropped when the request queue is full */
+		if (bh[i]->b_lock || bh[i]->b_uptodate)
+			kstat.ra_blocks++;
+		else
+			bh[i]->b_reada = 0;
+		if (!--bh[i]->b_count)
+			wake_up(&buffer_wait);
+	}
+}
+
 /*
  * See fs/inode.c for the weird use of volatile..
  */
@@ -879,16 +1145,7 @@ static int grow_buffers(int pri, int size)
 	}
 	tmp = bh;
 	while (1) {
-		if (free_list) {
-			tmp->b_next_free = free_list;
-			tmp->b_prev_free = free_list->b_prev_free;
-			free_list->b_prev_free->b_next_free = tmp;
-			free_list->b_prev_free = tmp;
-		} else {
-			tmp->b_prev_free = tmp;
-			tmp->b_next_free = tmp;
-		}
-		free_list = tmp;
+		put_first_lru(tmp, BUF_CLEAN);
 		++nr_buffers;
 		if (tmp->b_this_page)
 			tmp = tmp->b_this_page;
@@ -927,6 +1184,8 @@ static int try_to_free(struct buffer_head * bh, struct buffer_head ** bhp)
 		nr_buffers--;
 		if (p == *bhp)
 			*bhp = p->b_prev_free;
+		if (p->b_reada)
+			kstat.ra_wasted++;
 		remove_from_queues(p);
 		put_unused_buffer_head(p);
 	} while (tmp != bh);
@@ -945,34 +1204,39 @@ static int try_to_free(struct buffer_head * bh, struct buffer_head ** bhp)
 int shrink_buffers(unsigned int priority)
 {
 	struct buffer_head *bh;
-	int i;
+	int i, nlist;
 
 	if (priority < 2)
 		sync_buffers(0,0);
-	bh = free_list;
-	i = nr_buffers >> priority;
-	for ( ; i-- > 0 ; bh = bh->b_next_free) {
-		if (bh->b_count ||
-		    (priority >= 5 &&
-		     mem_map[MAP_NR((unsigned long) bh->b_data)] > 1)) {
-			put_last_free(bh);
-			continue;
-		}
-		if (!bh->b_this_page)
-			continue;
-		if (bh->b_lock)
-			if (priority)
+	for (nlist = 0 ; nlist < NR_LIST ; nlist++) {
+		bh = lru_list[nlist];
+		i = nr_buffers_type[nlist] >> priority;
+		for ( ; bh && i-- > 0 ; bh = bh->b_next_free) {
+			if (bh->b_count ||
+			    (priority >= 5 &&
+			     mem_map[MAP_NR((unsigned long) bh->b_data)] > 1)) {
+				touch_buffer(bh);
 				continue;
-			else
-				wait_on_buffer(bh);
-		if (bh->b_dirt) {
-			bh->b_count++;
-			ll_rw_block(WRITEA, 1, &bh);
-			bh->b_count--;
-			continue;
+			}
+			if (!bh->b_this_page)
+				continue;
+			if (bh->b_lock)
+				if (priority)
+					continue;
+				else
+					wait_on_buffer(bh);
+			if (bh->b_dirt) {
+				bh->b_count++;
+				ll_rw_block(WRITEA, 1, &bh);
+				bh->b_count--;
+				continue;
+			}
+			if (try_to_free(bh, &bh))
+				return 1;
+			/* the list may have just lost its last buffer */
+			if (!lru_list[nlist])
+				break;
 		}
-		if (try_to_free(bh, &bh))
-			return 1;
 	}
 	return 0;
 }
@@ -980,24 +1244,30 @@ int shrink_buffers(unsigned int priority)
 void show_buffers(void)
 {
 	struct buffer_head * bh;
-	int found = 0, locked = 0, dirty = 0, used = 0, lastused = 0;
+	int found, locked, dirty, used, lastused, nlist;
+	static char *buf_types[NR_LIST] = { "CLEAN", "LOCKED", "DIRTY" };
 
 	printk("Buffer memory:   %6dkB\n",buffermem>>10);
 	printk("Buffer heads:    %6d\n",nr_buffer_heads);
 	printk("Buffer blocks:   %6d\n",nr_buffers);
-	bh = free_list;
-	do {
-		found++;
-		if (bh->b_lock)
-			locked++;
-		if (bh->b_dirt)
-			dirty++;
-		if (bh->b_count)
-			used++, lastused = found;
-		bh = bh->b_next_free;
-	} while (bh != free_list);
-	printk("Buffer mem: %d buffers, %d used (last=%d), %d locked, %d dirty\n",
-		found, used, lastused, locked, dirty);
+	printk("Hash entries:    %6d\n",nr_hash);
+	for (nlist = 0 ; nlist < NR_LIST ; nlist++) {
+		found = locked = dirty = used = lastused = 0;
+		if (!(bh = lru_list[nlist]))
+			continue;
+		do {
+			found++;
+			if (bh->b_lock)
+				locked++;
+			if (bh->b_dirt)
+				dirty++;
+			if (bh->b_count)
+				used++, lastused = found;
+			bh = bh->b_next_free;
+		} while (bh != lru_list[nlist]);
+		printk("Buffer[%-6s]: %d buffers, %d used (last=%d), %d locked, %d dirty\n",
+			buf_types[nlist], found, used, lastused, locked, dirty);
+	}
 }
 
 /*
@@ -1015,11 +1285,154 @@ void buffer_init(void)
 		min_free_pages = 200;
 	else
 		min_free_pages = 20;
-	for (i = 0 ; i < NR_HASH ; i++)
-		hash_table[i] = NULL;
-	free_list = 0;
+	hash_table = (struct buffer_head **) get_free_page(GFP_KERNEL);
+	if (!hash_table)
+		panic("VFS: Unable to allocate buffer hash table!");
+	nr_hash = PAGE_SIZE / sizeof(*hash_table);
+	for (i = 0 ; i < NR_LIST ; i++) {
+		lru_list[i] = NULL;
+		nr_buffers_type[i] = 0;
+	}
 	grow_buffers(GFP_KERNEL, BLOCK_SIZE);
-	if (!free_list)
+	if (!lru_list[BUF_CLEAN])
 		panic("VFS: Unable to initialize buffer free list!");
 	return;
 }
+
+/*
+ * Wake up bdflush, and if asked to, wait for it to have done a round
+ * of writing. Without a daemon running the caller has to do it.
+ */
+static void wakeup_bdflush(int wait)
+{
+	if (!bdflush_tsk) {
+		if (wait)
+			sync_buffers(0,0);
+		return;
+	}
+	wake_up(&bdflush_wait);
+	if (wait)
+		sleep_on(&bdflush_done);
+}
+
+#define NR_FLUSH_BATCH	32
+
+static inline int bh_before(struct buffer_head * a, struct buffer_head * b)
+{
+	if (a->b_dev != b->b_dev)
+		return a->b_dev < b->b_dev;
+	return a->b_blocknr < b->b_blocknr;
+}
+
+/*
+ * Write out at most "limit" dirty buffers, oldest first. Unless "force"
+ * is set only the ones that have been dirty for longer than age_buffer
+ * are written. Buffers are handed to ll_rw_block() in batches sorted by
+ * device and block number, so the drivers see them in disk order.
+ */
+static int flush_dirty_buffers(int limit, int force)
+{
+	struct buffer_head * bh, * next, * batch[NR_FLUSH_BATCH];
+	int i, j, n, written = 0;
+
+	while (written < limit) {
+		n = 0;
+		bh = lru_list[BUF_DIRTY];
+		for (i = nr_buffers_type[BUF_DIRTY] ; bh && i-- > 0 ; bh = next) {
+			next = bh->b_next_free;
+			if (!bh->b_dirt || bh->b_lock)
+				continue;
+			/* the dirty list is (roughly) in order of age */
+			if (!force && bh->b_flushtime > jiffies)
+				break;
+			bh->b_count++;
+			for (j = n++ ; j > 0 && bh_before(bh, batch[j-1]) ; j--)
+				batch[j] = batch[j-1];
+			batch[j] = bh;
+			if (n == NR_FLUSH_BATCH || written + n >= limit)
+				break;
+		}
+		if (!n)
+			break;
+		for (i = 0 ; i < n ; i = j) {
+			for (j = i+1 ; j < n && batch[j]->b_dev == batch[i]->b_dev ; j++)
+				/* nothing */;
+			ll_rw_block(WRITE, j-i, batch+i);
+		}
+		for (i = 0 ; i < n ; i++) {
+			batch[i]->b_count--;
+			refile_buffer(batch[i]);
+		}
+		written += n;
+		if (n < NR_FLUSH_BATCH)
+			break;
+	}
+	return written;
+}
+
+static inline int too_many_dirty(void)
+{
+	return nr_buffers_type[BUF_DIRTY]*100 > nr_buffers*bdf_prm.b_un.nfract;
+}
+
+/*
+ * sys_bdflush():
+ *	func == 0	turns the caller into the flushing daemon; it only
+ *			returns when the daemon is killed
+ *	func == 1	writes out the buffers that are old enough, for an
+ *			"update" daemon that wants to do it itself
+ *	func >= 2	reads (even func) or sets (odd func) tunable number
+ *			(func-2)/2
+ */
+asmlinkage int sys_bdflush(int func, long data)
+{
+	int i, error, written;
+
+	if (func == 1) {
+		sync_supers(0);
+		sync_inodes(0);
+		flush_dirty_buffers(nr_buffers, 0);
+		return 0;
+	}
+	if (func >= 2) {
+		i = (func-2) >> 1;
+		if (i >= N_PARAM)
+			return -EINVAL;
+		if ((func & 1) == 0) {
+			error = verify_area(VERIFY_WRITE, (void *) data, sizeof(int));
+			if (error)
+				return error;
+			put_fs_long(bdf_prm.data[i], data);
+			return 0;
+		}
+		if (!suser())
+			return -EPERM;
+		if (data < bdflush_min[i] || data > bdflush_max[i])
+			return -EINVAL;
+		bdf_prm.data[i] = data;
+		return 0;
+	}
+	if (func)
+		return -EINVAL;
+	if (!suser())
+		return -EPERM;
+	if (bdflush_tsk)
+		return -EBUSY;
+	bdflush_tsk = current;
+	strcpy(current->comm, "bdflush");
+	current->blocked = ~(1 << (SIGKILL-1));
+	for (;;) {
+		written = flush_dirty_buffers(bdf_prm.b_un.ndirty, too_many_dirty());
+		wake_up(&bdflush_done);
+		if (written && too_many_dirty())
+			continue;
+		current->timeout = jiffies + bdf_prm.b_un.interval;
+		interruptible_sleep_on(&bdflush_wait);
+		current->timeout = 0;
+		if (current->signal & (1 << (SIGKILL-1))) {
+			bdflush_tsk = NULL;
+			wake_up(&bdflush_done);
+			return 0;
+		}
+	}
+}
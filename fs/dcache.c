@@ -0,0 +1,327 @@
+/*
+ *  linux/fs/dcache.c
+ *
+ *  The directory entry cache: remembers which inode (or that no inode)
+ *  a name in a directory stands for, so that lookup() doesn't have to
+ *  ask the filesystem to search the directory every time.
+ */
+
+/*
+ * Entries are keyed by (device, directory inode number, name) and hashed
+ * twice: by the whole key for lookups, and by the directory alone so that
+ * all the names of one directory can be thrown out together. An entry
+ * with an inode number of zero is a negative entry: the name is known
+ * not to exist.
+ *
+ * Directories are only ever changed through the system calls in namei.c,
+ * and those tell us about it: anything that adds a name forgets the
+ * negative entries of the directory, anything that removes or renames a
+ * name forgets the whole directory. That is cruder than forgetting just
+ * the one name, but it is also right for filesystems where several
+ * spellings find the same file (msdos). Filesystems on unnamed devices
+ * (nfs, proc) can change under us and aren't cached at all.
+ *
+ * The cache is limited to a number of entries set from the memory size
+ * at boot, and the least recently used entry is reused when it is full.
+ */
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/kernel_stat.h>
+#include <linux/major.h>
+#include <linux/stat.h>
+#include <linux/string.h>
+#include <linux/errno.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+
+#define DCACHE_NAME_LEN	63
+
+struct dcache_entry {
+	dev_t dev;
+	unsigned long dir;
+	unsigned long ino;
+	int len;
+	struct dcache_entry * next_hash, * prev_hash;
+	struct dcache_entry * next_dir, * prev_dir;
+	struct dcache_entry * next_lru, * prev_lru;
+	char name[DCACHE_NAME_LEN + 1];
+};
+
+static struct dcache_entry ** name_hash_table = NULL;
+static struct dcache_entry ** dir_hash_table = NULL;
+static struct dcache_entry * lru_dcache = NULL;	/* most recently used first */
+static struct kmem_cache * dcache_cachep = NULL;
+static int dcache_hash_order = 0;
+static unsigned long dcache_hash_mask = 0;
+static int nr_dcache = 0, max_dcache = 0;
+
+/*
+ * Bumped whenever entries are forgotten. A lookup that slept in the
+ * filesystem only enters its result if nothing was forgotten meanwhile,
+ * or it could put back a name that was just removed.
+ */
+static unsigned long dcache_generation = 0;
+
+static inline unsigned long name_hashfn(dev_t dev, unsigned long dir,
+	const char * name, int len)
+{
+	unsigned long hash = dev ^ (dir * 31);
+
+	while (len--)
+		hash = (hash << 4) + (hash >> 28) + (unsigned char) *name++;
+	return (hash ^ (hash >> 12)) & dcache_hash_mask;
+}
+
+#define dir_hashfn(dev,dir)	(((dev) ^ (dir) ^ ((dir) >> 8)) & dcache_hash_mask)
+
+static inline int dcache_usable(struct inode * dir, const char * name, int len)
+{
+	if (!dcache_cachep || !S_ISDIR(dir->i_mode))
+		return 0;
+	if (MAJOR(dir->i_dev) == UNNAMED_MAJOR)
+		return 0;
+	if (!len || len > DCACHE_NAME_LEN)
+		return 0;
+	if (name[0] == '.' && (len == 1 || (len == 2 && name[1] == '.')))
+		return 0;
+	return 1;
+}
+
+static inline void remove_lru(struct dcache_entry * de)
+{
+	if (de->next_lru == de)
+		lru_dcache = NULL;
+	else {
+		de->next_lru->prev_lru = de->prev_lru;
+		de->prev_lru->next_lru = de->next_lru;
+		if (lru_dcache == de)
+			lru_dcache = de->next_lru;
+	}
+}
+
+static inline void add_lru(struct dcache_entry * de)
+{
+	if (!lru_dcache)
+		de->next_lru = de->prev_lru = de;
+	else {
+		de->next_lru = lru_dcache;
+		de->prev_lru = lru_dcache->prev_lru;
+		de->prev_lru->next_lru = de;
+		lru_dcache->prev_lru = de;
+	}
+	lru_dcache = de;
+}
+
+static void remove_dcache(struct dcache_entry * de)
+{
+	if (de->next_hash)
+		de->next_hash->prev_hash = de->prev_hash;
+	if (de->prev_hash)
+		de->prev_hash->next_hash = de->next_hash;
+	else
+		name_hash_table[name_hashfn(de->dev,de->dir,de->name,de->len)] = de->next_hash;
+	if (de->next_dir)
+		de->next_dir->prev_dir = de->prev_dir;
+	if (de->prev_dir)
+		de->prev_dir->next_dir = de->next_dir;
+	else
+		dir_hash_table[dir_hashfn(de->dev,de->dir)] = de->next_dir;
+	remove_lru(de);
+}
+
+static void free_dcache(struct dcache_entry * de)
+{
+	remove_dcache(de);
+	kmem_cache_free(dcache_cachep, de);
+	nr_dcache--;
+}
+
+static struct dcache_entry * find_dcache(dev_t dev, unsigned long dir,
+	const char * name, int len)
+{
+	struct dcache_entry * de;
+
+	de = name_hash_table[name_hashfn(dev,dir,name,len)];
+	for ( ; de ; de = de->next_hash)
+		if (de->dir == dir && de->dev == dev && de->len == len &&
+		    !memcmp(de->name, name, len))
+			break;
+	return de;
+}
+
+static void add_dcache(dev_t dev, unsigned long dir, const char * name, int len,
+	unsigned long ino, unsigned long generation)
+{
+	struct dcache_entry * de, ** p;
+
+	de = find_dcache(dev, dir, name, len);
+	if (de) {
+		de->ino = ino;
+		remove_lru(de);
+		add_lru(de);
+		return;
+	}
+	if (nr_dcache >= max_dcache) {
+		de = lru_dcache->prev_lru;
+		remove_dcache(de);
+	} else {
+		de = (struct dcache_entry *) kmem_cache_alloc(dcache_cachep, GFP_KERNEL);
+		if (!de)
+			return;
+		/* we may have slept: check nothing changed meanwhile */
+		if (generation != dcache_generation ||
+		    find_dcache(dev, dir, name, len)) {
+			kmem_cache_free(dcache_cachep, de);
+			return;
+		}
+		nr_dcache++;
+	}
+	de->dev = dev;
+	de->dir = dir;
+	de->ino = ino;
+	de->len = len;
+	memcpy(de->name, name, len);
+	de->name[len] = '\0';
+	p = name_hash_table + name_hashfn(dev,dir,name,len);
+	de->prev_hash = NULL;
+	if ((de->next_hash = *p) != NULL)
+		de->next_hash->prev_hash = de;
+	*p = de;
+	p = dir_hash_table + dir_hashfn(dev,dir);
+	de->prev_dir = NULL;
+	if ((de->next_dir = *p) != NULL)
+		de->next_dir->prev_dir = de;
+	*p = de;
+	add_lru(de);
+}
+
+/*
+ * The inode number to remember for the result of a lookup. If the name
+ * is a mount point, the filesystem has handed us the root of what is
+ * mounted there, and we want the inode it covers: iget() crosses the
+ * mount point again when the entry is used.
+ */
+static unsigned long dcache_ino(struct inode * dir, struct inode * inode)
+{
+	struct super_block * sb = inode->i_sb;
+
+	if (inode->i_dev == dir->i_dev)
+		return inode->i_ino;
+	if (sb && sb->s_mounted == inode && sb->s_covered &&
+	    sb->s_covered->i_dev == dir->i_dev)
+		return sb->s_covered->i_ino;
+	return 0;
+}
+
+/*
+ * dcache_lookup() takes the place of the filesystem lookup operation:
+ * it uses up "dir" and returns the inode in "result" the same way.
+ */
+int dcache_lookup(struct inode * dir, const char * name, int len,
+	struct inode ** result)
+{
+	struct dcache_entry * de;
+	unsigned long generation, ino;
+	int error;
+
+	if (!dcache_usable(dir, name, len))
+		return dir->i_op->lookup(dir,name,len,result);
+	de = find_dcache(dir->i_dev, dir->i_ino, name, len);
+	if (de) {
+		remove_lru(de);
+		add_lru(de);
+		if (!de->ino) {
+			kstat.dcache_hits++;
+			iput(dir);
+			return -ENOENT;
+		}
+		if ((*result = iget(dir->i_sb, de->ino)) != NULL) {
+			kstat.dcache_hits++;
+			iput(dir);
+			return 0;
+		}
+	}
+	kstat.dcache_misses++;
+	generation = dcache_generation;
+	dir->i_count++;
+	error = dir->i_op->lookup(dir,name,len,result);
+	if (generation == dcache_generation) {
+		if (!error) {
+			if ((ino = dcache_ino(dir, *result)) != 0)
+				add_dcache(dir->i_dev, dir->i_ino, name, len, ino, generation);
+		} else if (error == -ENOENT)
+			add_dcache(dir->i_dev, dir->i_ino, name, len, 0, generation);
+	}
+	iput(dir);
+	return error;
+}
+
+/*
+ * Forget the names cached for a directory: only the negative ones if
+ * something was just created in it, all of them if something was
+ * removed or renamed.
+ */
+void dcache_forget(dev_t dev, unsigned long dir, int negative_only)
+{
+	struct dcache_entry * de, * next;
+
+	if (!dcache_cachep)
+		return;
+	dcache_generation++;
+	for (de = dir_hash_table[dir_hashfn(dev,dir)] ; de ; de = next) {
+		next = de->next_dir;
+		if (de->dir != dir || de->dev != dev)
+			continue;
+		if (negative_only && de->ino)
+			continue;
+		free_dcache(de);
+	}
+}
+
+/*
+ * Forget everything cached for a device: called when it is unmounted.
+ */
+void dcache_invalidate(dev_t dev)
+{
+	struct dcache_entry * de, * next;
+	int i;
+
+	if (!lru_dcache)
+		return;
+	dcache_generation++;
+	de = lru_dcache;
+	for (i = nr_dcache ; i > 0 ; i--, de = next) {
+		next = de->next_lru;
+		if (de->dev == dev)
+			free_dcache(de);
+	}
+}
+
+void dcache_init(void)
+{
+	unsigned long nr_buckets;
+
+	/* One entry for every two pages, and a bucket in each table for every two entries */
+	max_dcache = high_memory >> (PAGE_SHIFT + 1);
+	if (max_dcache < 256)
+		max_dcache = 256;
+	if (max_dcache > 32768)
+		max_dcache = 32768;
+	while (dcache_hash_order < 3 &&
+	       (PAGE_SIZE << dcache_hash_order) / sizeof(struct dcache_entry *) < max_dcache / 2)
+		dcache_hash_order++;
+	nr_buckets = (PAGE_SIZE << dcache_hash_order) / sizeof(struct dcache_entry *);
+	name_hash_table = (struct dcache_entry **) __get_free_pages(GFP_KERNEL, dcache_hash_order);
+	dir_hash_table = (struct dcache_entry **) __get_free_pages(GFP_KERNEL, dcache_hash_order);
+	if (!name_hash_table || !dir_hash_table)
+		panic("VFS: Unable to allocate directory cache hash tables");
+	memset(name_hash_table, 0, PAGE_SIZE << dcache_hash_order);
+	memset(dir_hash_table, 0, PAGE_SIZE << dcache_hash_order);
+	dcache_hash_mask = nr_buckets - 1;
+	dcache_cachep = kmem_cache_create("dcache", sizeof(struct dcache_entry), 0, NULL);
+	if (!dcache_cachep)
+		panic("VFS: Unable to create directory cache");
+	printk("VFS: directory cache of %d entries, %lu hash buckets\n",
+		max_dcache, nr_buckets);
+}
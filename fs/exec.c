@@ -277,6 +277,7 @@ unsigned long * create_tables(char * p,int argc,int envc,int ibcs)
 		mpnt->vm_start = PAGE_MASK & (unsigned long) p;
 		mpnt->vm_end = TASK_SIZE;
 		mpnt->vm_page_prot = PAGE_PRIVATE|PAGE_DIRTY;
+		mpnt->vm_flags = 0;
 		mpnt->vm_share = NULL;
 		mpnt->vm_inode = NULL;
 		mpnt->vm_offset = 0;
@@ -422,9 +423,22 @@ int read_exec(struct inode *inode, unsigned long offset,
 {
 	struct file file;
 	int result = -ENOEXEC;
+	int cached = 0;
 
 	if (!inode->i_op || !inode->i_op->default_file_ops)
 		goto end_readexec;
+	if (get_fs() == USER_DS) {
+		result = verify_area(VERIFY_WRITE, addr, count);
+		if (result)
+			goto end_readexec;
+	}
+	cached = read_page_cache(inode, offset, addr, count);
+	if (cached == count)
+		return cached;
+	offset += cached;
+	addr += cached;
+	count -= cached;
+	result = -ENOEXEC;
 	file.f_mode = 1;
 	file.f_flags = 0;
 	file.f_count = 1;
@@ -442,16 +456,13 @@ int read_exec(struct inode *inode, unsigned long offset,
  			goto close_readexec;
 	} else
 		file.f_pos = offset;
-	if (get_fs() == USER_DS) {
-		result = verify_area(VERIFY_WRITE, addr, count);
-		if (result)
-			goto close_readexec;
-	}
 	result = file.f_op->read(inode, &file, addr, count);
 close_readexec:
 	if (file.f_op->release)
 		file.f_op->release(inode,&file);
 end_readexec:
+	if (cached > 0)
+		return (result < 0) ? cached : cached + result;
 	return result;
 }
 
@@ -488,6 +499,7 @@ void flush_old_exec(struct linux_binprm * bprm)
 
 	mpnt = current->mmap;
 	current->mmap = NULL;
+	current->mmap_avl = NULL;
 	current->stk_vma = NULL;
 	while (mpnt) {
 		mpnt1 = mpnt->vm_next;
@@ -527,6 +539,7 @@ void flush_old_exec(struct linux_binprm * bprm)
 			sys_close(i);
 	FD_ZERO(&current->close_on_exec);
 	clear_page_tables(current);
+	release_vfork(current);
 	if (last_task_used_math == current)
 		last_task_used_math = NULL;
 	current->used_math = 0;
@@ -795,6 +808,7 @@ int load_aout_binary(struct linux_binprm * bprm, struct pt_regs * regs)
 	current->rss = 0;
 	current->suid = current->euid = bprm->e_uid;
 	current->mmap = NULL;
+	current->mmap_avl = NULL;
 	current->executable = NULL;  /* for OMAGIC files */
 	current->sgid = current->egid = bprm->e_gid;
 	if (N_MAGIC(ex) == OMAGIC) {
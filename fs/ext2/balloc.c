@@ -42,78 +42,48 @@
 
 #define in_range(b, first, len)		((b) >= (first) && (b) <= (first) + (len) - 1)
 
-static inline int find_first_zero_bit (unsigned long * addr, unsigned size)
+/*
+ * Find the first run of at least "want" free bits at or after "start".
+ * Returns "size" if there is none.
+ */
+static int find_free_run (char * map, int size, int start, int want)
 {
-	int res;
-
-	if (!size)
-		return 0;
-	__asm__("
-		cld
-		movl $-1,%%eax
-		repe; scasl
-		je 1f
-		subl $4,%%edi
-		movl (%%edi),%%eax
-		notl %%eax
-		bsfl %%eax,%%edx
-		jmp 2f
-1:		xorl %%edx,%%edx
-2:		subl %%ebx,%%edi
-		shll $3,%%edi
-		addl %%edi,%%edx"
-		:"=d" (res)
-		:"c" ((size + 31) >> 5), "D" (addr), "b" (addr)
-		:"ax", "bx", "cx", "di");
-	return res;
+	int run;
+
+	while ((start = find_next_zero_bit (map, size, start)) < size) {
+		for (run = 1; run < want && start + run < size &&
+			      !test_bit (start + run, map); run++)
+			;
+		if (run >= want)
+			return start;
+		start += run;
+	}
+	return size;
 }
 
-static inline int find_next_zero_bit (unsigned long * addr, int size,
-				      int offset)
+/*
+ * Length of the free run that the clear bits first..last are part of.
+ */
+static int free_run_length (char * map, int size, int first, int last)
 {
-	unsigned long * p = ((unsigned long *) addr) + (offset >> 5);
-	int set = 0, bit = offset & 31, res;
-	
-	if (bit) {
-		/*
-		 * Look for zero in first byte
-		 */
-		__asm__("
-			bsfl %1,%0
-			jne 1f
-			movl $32, %0
-1:			"
-			: "=r" (set)
-			: "r" (~(*p >> bit)));
-		if (set < (32 - bit))
-			return set + offset;
-		set = 32 - bit;
-		p++;
-	}
-	/*
-	 * No zero yet, search remaining full bytes for a zero
-	 */
-	res = find_first_zero_bit (p, size - 32 * (p - addr));
-	return (offset + set + res);
+	while (first > 0 && !test_bit (first - 1, map))
+		first--;
+	while (last < size - 1 && !test_bit (last + 1, map))
+		last++;
+	return last - first + 1;
 }
 
-static inline char * find_first_zero_byte (char * addr, int size)
+static int longest_free_run (char * map, int size)
 {
-	char *res;
+	int start = 0, run, longest = 0;
 
-	if (!size)
-		return 0;
-	__asm__("
-		cld
-		mov $0,%%eax
-		repnz; scasb
-		jnz 1f
-		dec %%edi
-1:		"
-		: "=D" (res)
-		: "0" (addr), "c" (size)
-		: "ax");
-	return res;
+	while ((start = find_next_zero_bit (map, size, start)) < size) {
+		run = free_run_length (map, size, start, start);
+		if (run > longest)
+			longest = run;
+		start += run;
+	}
+	return longest;
 }
 
 static struct ext2_group_desc * get_group_desc (struct super_block * sb,
@@ -160,6 +130,8 @@ static void read_block_bitmap (struct super_block * sb,
 			    block_group, gdp->bg_block_bitmap);
 	sb->u.ext2_sb.s_block_bitmap_number[bitmap_nr] = block_group;
 	sb->u.ext2_sb.s_block_bitmap[bitmap_nr] = bh;
+	sb->u.ext2_sb.s_max_free_run[block_group] =
+		longest_free_run (bh->b_data, EXT2_BLOCKS_PER_GROUP(sb));
 }
 
 /*
@@ -170,7 +142,7 @@ static void read_block_bitmap (struct super_block * sb,
  *
  * Notes:
  * 1/ There is one cache per mounted file system.
- * 2/ If the file system contains less than EXT2_MAX_GROUP_LOADED groups,
+ * 2/ If the file system contains no more groups than the cache can hold,
  *    this function reads the bitmap without maintaining a LRU cache.
  */
 static int load__block_bitmap (struct super_block * sb,
@@ -186,7 +158,8 @@ static int load__block_bitmap (struct super_block * sb,
 			    "block_group = %d, groups_count = %lu",
 			    block_group, sb->u.ext2_sb.s_groups_count);
 
-	if (sb->u.ext2_sb.s_groups_count <= EXT2_MAX_GROUP_LOADED) {
+	if (sb->u.ext2_sb.s_groups_count <=
+	    sb->u.ext2_sb.s_max_loaded_bitmaps) {
 		if (sb->u.ext2_sb.s_block_bitmap[block_group]) {
 			if (sb->u.ext2_sb.s_block_bitmap_number[block_group] !=
 			    block_group)
@@ -216,10 +189,12 @@ static int load__block_bitmap (struct super_block * sb,
 		sb->u.ext2_sb.s_block_bitmap_number[0] = block_bitmap_number;
 		sb->u.ext2_sb.s_block_bitmap[0] = block_bitmap;
 	} else {
-		if (sb->u.ext2_sb.s_loaded_block_bitmaps < EXT2_MAX_GROUP_LOADED)
+		if (sb->u.ext2_sb.s_loaded_block_bitmaps <
+		    sb->u.ext2_sb.s_max_loaded_bitmaps)
 			sb->u.ext2_sb.s_loaded_block_bitmaps++;
 		else
-			brelse (sb->u.ext2_sb.s_block_bitmap[EXT2_MAX_GROUP_LOADED - 1]);
+			brelse (sb->u.ext2_sb.s_block_bitmap
+				[sb->u.ext2_sb.s_max_loaded_bitmaps - 1]);
 		for (j = sb->u.ext2_sb.s_loaded_block_bitmaps - 1; j > 0;  j--) {
 			sb->u.ext2_sb.s_block_bitmap_number[j] =
 				sb->u.ext2_sb.s_block_bitmap_number[j - 1];
@@ -238,7 +213,8 @@ static inline int load_block_bitmap (struct super_block * sb,
 	    sb->u.ext2_sb.s_block_bitmap_number[0] == block_group)
 		return 0;
 	
-	if (sb->u.ext2_sb.s_groups_count <= EXT2_MAX_GROUP_LOADED && 
+	if (sb->u.ext2_sb.s_groups_count <=
+	    sb->u.ext2_sb.s_max_loaded_bitmaps &&
 	    sb->u.ext2_sb.s_block_bitmap_number[block_group] == block_group &&
 	    sb->u.ext2_sb.s_block_bitmap[block_group]) 
 		return block_group;
@@ -309,11 +285,15 @@ void ext2_free_blocks (struct super_block * sb, unsigned long block,
 			es->s_free_blocks_count++;
 		}
 	}
+	i = free_run_length (bh->b_data, EXT2_BLOCKS_PER_GROUP(sb),
+			     bit, bit + count - 1);
+	if (i > sb->u.ext2_sb.s_max_free_run[block_group])
+		sb->u.ext2_sb.s_max_free_run[block_group] = i;
 	
-	bh2->b_dirt = 1;
-	sb->u.ext2_sb.s_sbh->b_dirt = 1;
+	mark_buffer_dirty(bh2);
+	mark_buffer_dirty(sb->u.ext2_sb.s_sbh);
 
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	if (sb->s_flags & MS_SYNC) {
 		ll_rw_block (WRITE, 1, &bh);
 		wait_on_buffer (bh);
@@ -329,8 +309,15 @@ void ext2_free_blocks (struct super_block * sb, unsigned long block,
  * is allocated.  Otherwise a forward search is made for a free block; within 
  * each block group the search first looks for an entire free byte in the block
  * bitmap, and then for any free bit if that fails.
+ *
+ * "want" is the number of blocks the caller is about to need after this
+ * one.  When it is large the forward search first looks for a free run
+ * that long, and up to EXT2_MAX_PREALLOC of them are preallocated, so
+ * that a big write gets one contiguous extent from a single pass over
+ * the bitmap and doesn't interleave with other files growing meanwhile.
  */
 int ext2_new_block (struct super_block * sb, unsigned long goal,
+		    unsigned long want,
 		    unsigned long * prealloc_count,
 		    unsigned long * prealloc_block)
 {
@@ -359,6 +346,11 @@ int ext2_new_block (struct super_block * sb, unsigned long goal,
 
 	ext2_debug ("goal=%lu.\n", goal);
 
+	if (want > EXT2_MAX_PREALLOC)
+		want = EXT2_MAX_PREALLOC;
+	if (want < 8)
+		want = 0;
+
 repeat:
 	/*
 	 * First, test whether the goal block is free.
@@ -420,6 +412,18 @@ repeat:
 		 * Search first in the remainder of the current group; then,
 		 * cyclicly search throught the rest of the groups.
 		 */
+		if (want && sb->u.ext2_sb.s_max_free_run[i] > want) {
+			k = find_free_run (bh->b_data, EXT2_BLOCKS_PER_GROUP(sb),
+					   j, want + 1);
+			if (k < EXT2_BLOCKS_PER_GROUP(sb)) {
+				j = k;
+				goto got_block;
+			}
+			if (!j)
+				sb->u.ext2_sb.s_max_free_run[i] =
+					longest_free_run (bh->b_data,
+						EXT2_BLOCKS_PER_GROUP(sb));
+		}
 		p = ((char *) bh->b_data) + (j >> 3);
 		r = find_first_zero_byte (p, 
 					  (EXT2_BLOCKS_PER_GROUP(sb) - j + 7) >> 3);
@@ -442,14 +446,33 @@ repeat:
 	/*
 	 * Now search the rest of the groups.  We assume that 
 	 * i and gdp correctly point to the last group visited.
+	 *
+	 * A big request first goes to a group that may have a free run
+	 * long enough: s_max_free_run says which ones might, without
+	 * reading any bitmaps.
 	 */
-	for (k = 0; k < sb->u.ext2_sb.s_groups_count; k++) {
-		i++;
-		if (i >= sb->u.ext2_sb.s_groups_count)
-			i = 0;
-		gdp = get_group_desc (sb, i, &bh2);
-		if (gdp->bg_free_blocks_count > 0)
-			break;
+	k = sb->u.ext2_sb.s_groups_count;
+	if (want) {
+		for (k = 0, tmp = i; k < sb->u.ext2_sb.s_groups_count; k++) {
+			if (++tmp >= sb->u.ext2_sb.s_groups_count)
+				tmp = 0;
+			gdp = get_group_desc (sb, tmp, &bh2);
+			if (gdp->bg_free_blocks_count > want &&
+			    sb->u.ext2_sb.s_max_free_run[tmp] > want)
+				break;
+		}
+		if (k < sb->u.ext2_sb.s_groups_count)
+			i = tmp;
+	}
+	if (k >= sb->u.ext2_sb.s_groups_count) {
+		for (k = 0; k < sb->u.ext2_sb.s_groups_count; k++) {
+			i++;
+			if (i >= sb->u.ext2_sb.s_groups_count)
+				i = 0;
+			gdp = get_group_desc (sb, i, &bh2);
+			if (gdp->bg_free_blocks_count > 0)
+				break;
+		}
 	}
 	if (k >= sb->u.ext2_sb.s_groups_count) {
 		unlock_super (sb);
@@ -457,6 +480,15 @@ repeat:
 	}
 	bitmap_nr = load_block_bitmap (sb, i);
 	bh = sb->u.ext2_sb.s_block_bitmap[bitmap_nr];
+	if (want && sb->u.ext2_sb.s_max_free_run[i] > want) {
+		j = find_free_run (bh->b_data, EXT2_BLOCKS_PER_GROUP(sb), 0,
+				   want + 1);
+		if (j < EXT2_BLOCKS_PER_GROUP(sb))
+			goto got_block;
+		sb->u.ext2_sb.s_max_free_run[i] =
+			longest_free_run (bh->b_data,
+					  EXT2_BLOCKS_PER_GROUP(sb));
+	}
 	r = find_first_zero_byte (bh->b_data, 
 				  EXT2_BLOCKS_PER_GROUP(sb) >> 3);
 	j = (r - bh->b_data) << 3;
@@ -509,8 +541,8 @@ got_block:
 	if (prealloc_block) {
 		*prealloc_count = 0;
 		*prealloc_block = tmp + 1;
-		for (k = 1;
-		     k < 8 && (j + k) < EXT2_BLOCKS_PER_GROUP(sb); k++) {
+		for (k = 1; k <= (want ? want : 7) &&
+			    (j + k) < EXT2_BLOCKS_PER_GROUP(sb); k++) {
 			if (set_bit (j + k, bh->b_data))
 				break;
 			(*prealloc_count)++;
@@ -524,7 +556,7 @@ got_block:
 
 	j = tmp;
 
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	if (sb->s_flags & MS_SYNC) {
 		ll_rw_block (WRITE, 1, &bh);
 		wait_on_buffer (bh);
@@ -544,16 +576,16 @@ got_block:
 	}
 	clear_block (bh->b_data, sb->s_blocksize);
 	bh->b_uptodate = 1;
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	brelse (bh);
 
 	ext2_debug ("allocating block %d. "
 		    "Goal hits %d of %d.\n", j, goal_hits, goal_attempts);
 
 	gdp->bg_free_blocks_count--;
-	bh2->b_dirt = 1;
+	mark_buffer_dirty(bh2);
 	es->s_free_blocks_count--;
-	sb->u.ext2_sb.s_sbh->b_dirt = 1;
+	mark_buffer_dirty(sb->u.ext2_sb.s_sbh);
 	sb->s_dirt = 1;
 	unlock_super (sb);
 	return j;
@@ -9,17 +9,11 @@
 #include <linux/fs.h>
 #include <linux/ext2_fs.h>
 
-static int nibblemap[] = {4, 3, 3, 2, 3, 2, 2, 1, 3, 2, 2, 1, 2, 1, 1, 0};
+#include <asm/bitops.h>
 
 unsigned long ext2_count_free (struct buffer_head * map, unsigned int numchars)
 {
-	unsigned int i;
-	unsigned long sum = 0;
-	
 	if (!map) 
 		return (0);
-	for (i = 0; i < numchars; i++)
-		sum += nibblemap[map->b_data[i] & 0xf] +
-			nibblemap[(map->b_data[i] >> 4) & 0xf];
-	return (sum);
+	return count_zero_bits (map->b_data, numchars * 8);
 }
@@ -24,6 +24,7 @@
 #include <linux/sched.h>
 #include <linux/stat.h>
 #include <linux/locks.h>
+#include <linux/mm.h>
 
 #define	NBUF	32
 
@@ -83,6 +84,8 @@ static int ext2_file_read (struct inode * inode, struct file * filp,
 	struct buffer_head * buflist[NBUF];
 	struct super_block * sb;
 	unsigned int size;
+	unsigned int rablock, raend;
+	int ra, i;
 	int err;
 
 	if (!inode) {
@@ -105,18 +108,27 @@ static int ext2_file_read (struct inode * inode, struct file * filp,
 		left = count;
 	if (left <= 0)
 		return 0;
-	read = 0;
+	ra = file_readahead (filp, inode->i_dev, filp->f_pos, left);
+
+	/*
+	 * What the page cache has needn't be read again
+	 */
+	read = read_page_cache (inode, offset, buf, left);
+	filp->f_pos += read;
+	if (!(left -= read))
+		goto done;
+	buf += read;
+	offset += read;
 	block = offset >> EXT2_BLOCK_SIZE_BITS(sb);
 	offset &= (sb->s_blocksize - 1);
 	size = (size + sb->s_blocksize - 1) >> EXT2_BLOCK_SIZE_BITS(sb);
 	blocks = (left + offset + sb->s_blocksize - 1) >> EXT2_BLOCK_SIZE_BITS(sb);
 	bhb = bhe = buflist;
-	if (filp->f_reada) {
-		blocks += read_ahead[MAJOR(inode->i_dev)] >>
-			(EXT2_BLOCK_SIZE_BITS(sb) - 9);
-		if (block + blocks > size)
-			blocks = size - block;
-	}
+	ra >>= EXT2_BLOCK_SIZE_BITS(sb) - 9;
+	rablock = block + blocks;
+	raend = rablock + ra;
+	if (raend > size)
+		raend = size;
 
 	/*
 	 * We do this in a two stage process.  We first try and request
@@ -198,7 +210,7 @@ static int ext2_file_read (struct inode * inode, struct file * filp,
 	} while (left > 0);
 
 	/*
-	 * Release the read-ahead blocks
+	 * Release the blocks a read error left unused
 	 */
 	while (bhe != bhb) {
 		brelse (*bhe);
@@ -207,6 +219,22 @@ static int ext2_file_read (struct inode * inode, struct file * filp,
 	}
 	if (!read)
 		return -EIO;
+
+	/*
+	 * Keep the read-ahead window ahead of the reader: once less than
+	 * half of it is still to come, start reading up to its far end
+	 */
+	if (rablock < raend && filp->f_raend < rablock + (ra >> 1)) {
+		if (filp->f_raend > rablock)
+			rablock = filp->f_raend;
+		while (rablock < raend) {
+			for (i = 0; i < NBUF && rablock < raend; i++)
+				bhreq[i] = ext2_getblk (inode, rablock++, 0, &err);
+			read_ahead_buffers (bhreq, i);
+		}
+		filp->f_raend = raend;
+	}
+done:
 	filp->f_reada = 1;
 	if (!IS_RDONLY(inode)) {
 		inode->i_atime = CURRENT_TIME;
@@ -251,6 +279,13 @@ static int ext2_file_write (struct inode * inode, struct file * filp,
 		pos = filp->f_pos;
 	written = 0;
 	while (written < count) {
+		/*
+		 * Tell the allocator how many more blocks this write will
+		 * need, so that it can reserve them in one go
+		 */
+		inode->u.ext2_i.i_alloc_want = (pos % sb->s_blocksize +
+						count - written - 1) /
+					       sb->s_blocksize;
 		bh = ext2_getblk (inode, pos / sb->s_blocksize, 1, &err);
 		if (!bh) {
 			if (!written)
@@ -280,9 +315,10 @@ static int ext2_file_write (struct inode * inode, struct file * filp,
 		memcpy_fromfs (p, buf, c);
 		buf += c;
 		bh->b_uptodate = 1;
-		bh->b_dirt = 1;
+		mark_buffer_dirty(bh);
 		brelse (bh);
 	}
+	inode->u.ext2_i.i_alloc_want = 0;
 	inode->i_ctime = inode->i_mtime = CURRENT_TIME;
 	filp->f_pos = pos;
 	inode->i_dirt = 1;
@@ -33,32 +33,6 @@
 
 #include <asm/bitops.h>
 
-static inline int find_first_zero_bit (unsigned long * addr, unsigned size)
-{
-	int res;
-
-	if (!size)
-		return 0;
-	__asm__("
-		cld
-		movl $-1,%%eax
-		repe; scasl
-		je 1f
-		subl $4,%%edi
-		movl (%%edi),%%eax
-		notl %%eax
-		bsfl %%eax,%%edx
-		jmp 2f
-1:		xorl %%edx,%%edx
-2:		subl %%ebx,%%edi
-		shll $3,%%edi
-		addl %%edi,%%edx"
-		: "=d" (res)
-		: "c" ((size + 31) >> 5), "D" (addr), "b" (addr)
-		: "ax", "bx", "cx", "di");
-	return res;
-}
-
 static struct ext2_group_desc * get_group_desc (struct super_block * sb,
 						unsigned int block_group,
 						struct buffer_head ** bh)
@@ -112,7 +86,7 @@ static void read_inode_bitmap (struct super_block * sb,
  *
  * Notes:
  * 1/ There is one cache per mounted file system.
- * 2/ If the file system contains less than EXT2_MAX_GROUP_LOADED groups,
+ * 2/ If the file system contains no more groups than the cache can hold,
  *    this function reads the bitmap without maintaining a LRU cache.
  */
 static int load_inode_bitmap (struct super_block * sb,
@@ -130,7 +104,8 @@ static int load_inode_bitmap (struct super_block * sb,
 	if (sb->u.ext2_sb.s_loaded_inode_bitmaps > 0 &&
 	    sb->u.ext2_sb.s_inode_bitmap_number[0] == block_group)
 		return 0;
-	if (sb->u.ext2_sb.s_groups_count <= EXT2_MAX_GROUP_LOADED) {
+	if (sb->u.ext2_sb.s_groups_count <=
+	    sb->u.ext2_sb.s_max_loaded_bitmaps) {
 		if (sb->u.ext2_sb.s_inode_bitmap[block_group]) {
 			if (sb->u.ext2_sb.s_inode_bitmap_number[block_group] != block_group)
 				ext2_panic (sb, "load_inode_bitmap",
@@ -160,10 +135,12 @@ static int load_inode_bitmap (struct super_block * sb,
 		sb->u.ext2_sb.s_inode_bitmap_number[0] = inode_bitmap_number;
 		sb->u.ext2_sb.s_inode_bitmap[0] = inode_bitmap;
 	} else {
-		if (sb->u.ext2_sb.s_loaded_inode_bitmaps < EXT2_MAX_GROUP_LOADED)
+		if (sb->u.ext2_sb.s_loaded_inode_bitmaps <
+		    sb->u.ext2_sb.s_max_loaded_bitmaps)
 			sb->u.ext2_sb.s_loaded_inode_bitmaps++;
 		else
-			brelse (sb->u.ext2_sb.s_inode_bitmap[EXT2_MAX_GROUP_LOADED - 1]);
+			brelse (sb->u.ext2_sb.s_inode_bitmap
+				[sb->u.ext2_sb.s_max_loaded_bitmaps - 1]);
 		for (j = sb->u.ext2_sb.s_loaded_inode_bitmaps - 1; j > 0; j--) {
 			sb->u.ext2_sb.s_inode_bitmap_number[j] =
 				sb->u.ext2_sb.s_inode_bitmap_number[j - 1];
@@ -202,7 +179,7 @@ static void set_inode_dtime (struct inode * inode,
 			EXT2_INODES_PER_BLOCK(inode->i_sb));
 	raw_inode->i_links_count = 0;
 	raw_inode->i_dtime = CURRENT_TIME;
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	if (IS_SYNC(inode)) {
 		ll_rw_block (WRITE, 1, &bh);
 		wait_on_buffer (bh);
@@ -266,12 +243,12 @@ void ext2_free_inode (struct inode * inode)
 		gdp->bg_free_inodes_count++;
 		if (S_ISDIR(inode->i_mode))
 			gdp->bg_used_dirs_count--;
-		bh2->b_dirt = 1;
+		mark_buffer_dirty(bh2);
 		es->s_free_inodes_count++;
-		sb->u.ext2_sb.s_sbh->b_dirt = 1;
+		mark_buffer_dirty(sb->u.ext2_sb.s_sbh);
 		set_inode_dtime (inode, gdp);
 	}
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	if (sb->s_flags & MS_SYNC) {
 		ll_rw_block (WRITE, 1, &bh);
 		wait_on_buffer (bh);
@@ -313,7 +290,7 @@ static void inc_inode_version (struct inode * inode,
 			EXT2_INODES_PER_BLOCK(inode->i_sb));
 	raw_inode->i_version++;
 	inode->u.ext2_i.i_version = raw_inode->i_version;
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	brelse (bh);
 }
 
@@ -438,7 +415,7 @@ repeat:
 				      "bit already set for inode %d", j);
 			goto repeat;
 		}
-		bh->b_dirt = 1;
+		mark_buffer_dirty(bh);
 		if (sb->s_flags & MS_SYNC) {
 			ll_rw_block (WRITE, 1, &bh);
 			wait_on_buffer (bh);
@@ -466,9 +443,9 @@ repeat:
 	gdp->bg_free_inodes_count--;
 	if (S_ISDIR(mode))
 		gdp->bg_used_dirs_count++;
-	bh2->b_dirt = 1;
+	mark_buffer_dirty(bh2);
 	es->s_free_inodes_count--;
-	sb->u.ext2_sb.s_sbh->b_dirt = 1;
+	mark_buffer_dirty(sb->u.ext2_sb.s_sbh);
 	sb->s_dirt = 1;
 	inode->i_mode = mode;
 	inode->i_sb = sb;
@@ -489,7 +466,7 @@ repeat:
 	inode->i_blksize = sb->s_blocksize;
 	inode->i_blocks = 0;
 	inode->i_mtime = inode->i_atime = inode->i_ctime = CURRENT_TIME;
-	inode->u.ext2_i.i_flags = dir->u.ext2_i.i_flags;
+	inode->u.ext2_i.i_flags = dir->u.ext2_i.i_flags & ~EXT2_INDEX_FL;
 	inode->u.ext2_i.i_faddr = 0;
 	inode->u.ext2_i.i_frag = 0;
 	inode->u.ext2_i.i_fsize = 0;
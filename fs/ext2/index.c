@@ -0,0 +1,713 @@
+/*
+ *  linux/fs/ext2/index.c
+ *
+ *  Hashed directory index
+ */
+
+/*
+ * A big directory can carry an index that takes a lookup or an insert
+ * straight to the one block that holds (or will hold) the name, instead
+ * of scanning every block.  The index hides in the directory in a way
+ * that looks like free space to code that doesn't know about it:
+ *
+ *  - block 0, the root, holds "." and "..", and ".." stretches to the
+ *    end of the block.  After its name come a small header and an array
+ *    of (hash, block) pairs sorted by hash;
+ *  - with two levels, the root points to index nodes rather than to
+ *    leaves.  A node starts with one empty entry covering the block,
+ *    followed by another array of pairs;
+ *  - the leaves are ordinary directory blocks, holding the names whose
+ *    hash is at least that of their index entry and below the next one.
+ *
+ * Name hashes are even.  An odd hash in the index means that a split
+ * fell inside a run of names with the same hash, so a lookup for that
+ * hash goes on to the next leaf as well.
+ *
+ * Directories get an index when they grow past one block on a
+ * filesystem mounted with "index", and keep it from then on (the
+ * EXT2_INDEX_FL inode flag).  An older kernel simply scans all the
+ * blocks; the first name it adds goes into the free space of "..", and
+ * that breaks the root.  So the root is checked every time it is read,
+ * and a directory whose index doesn't look right loses the flag and is
+ * searched linearly from then on.
+ */
+
+#include <linux/errno.h>
+#include <linux/fs.h>
+#include <linux/ext2_fs.h>
+#include <linux/sched.h>
+#include <linux/stat.h>
+#include <linux/string.h>
+#include <linux/locks.h>
+#include <linux/mm.h>
+
+struct dx_frame {
+	struct buffer_head * bh;
+	struct ext2_dx_entry * entries;
+	struct ext2_dx_entry * at;
+};
+
+struct dx_map_entry {
+	unsigned long hash;
+	unsigned short offs;
+	unsigned short size;
+};
+
+#define dx_count(entries)	(((struct ext2_dx_countlimit *) (entries))->count)
+#define dx_limit(entries)	(((struct ext2_dx_countlimit *) (entries))->limit)
+#define dx_root_limit(sb)	(((sb)->s_blocksize - EXT2_DX_ROOT_ENTRIES) / \
+				 sizeof (struct ext2_dx_entry))
+#define dx_node_limit(sb)	(((sb)->s_blocksize - EXT2_DX_NODE_ENTRIES) / \
+				 sizeof (struct ext2_dx_entry))
+
+#define NEXT_DIRENT(de)	((struct ext2_dir_entry *) ((char *) (de) + (de)->rec_len))
+
+/*
+ * Lookups don't hold i_sem, so a lookup that sleeps reading a block can
+ * have names moved under it by a split.  Every change to the shape of
+ * an index bumps this, and a lookup that missed while it changed looks
+ * again, rather than report a name that exists as missing.
+ */
+static unsigned long dx_generation = 0;
+
+static unsigned long dx_hash (const char * name, int len)
+{
+	unsigned long hash, hash0 = 0x12a3fe2d, hash1 = 0x37abe8f9;
+
+	while (len--) {
+		hash = hash1 + (hash0 ^ (*name++ * 7152373));
+		if (hash & 0x80000000)
+			hash -= 0x7fffffff;
+		hash1 = hash0;
+		hash0 = hash;
+	}
+	return hash0 << 1;
+}
+
+static void dx_release (struct dx_frame * frames, int n)
+{
+	while (n-- > 0)
+		brelse (frames[n].bh);
+}
+
+static void dx_bad (struct inode * dir, const char * msg)
+{
+	ext2_warning (dir->i_sb, "ext2_dx", "directory #%lu: %s, "
+		      "dropping its index", dir->i_ino, msg);
+	dir->u.ext2_i.i_flags &= ~EXT2_INDEX_FL;
+	dir->i_dirt = 1;
+}
+
+static int dx_root_ok (struct super_block * sb, char * data)
+{
+	struct ext2_dir_entry * de = (struct ext2_dir_entry *) data;
+	struct ext2_dx_root_info * info;
+	struct ext2_dx_entry * entries;
+
+	if (de->rec_len != EXT2_DIR_REC_LEN(1) || de->name_len != 1 ||
+	    de->name[0] != '.')
+		return 0;
+	de = NEXT_DIRENT(de);
+	if (de->rec_len != sb->s_blocksize - EXT2_DIR_REC_LEN(1) ||
+	    de->name_len != 2 || de->name[0] != '.' || de->name[1] != '.')
+		return 0;
+	info = (struct ext2_dx_root_info *) (data + EXT2_DX_ROOT_INFO);
+	if (info->reserved_zero || info->hash_version != EXT2_DX_HASH_LEGACY ||
+	    info->info_length != sizeof (*info) ||
+	    info->indirect_levels >= EXT2_DX_MAX_LEVELS)
+		return 0;
+	entries = (struct ext2_dx_entry *) (data + EXT2_DX_ROOT_ENTRIES);
+	return dx_limit(entries) == dx_root_limit(sb) &&
+	       dx_count(entries) && dx_count(entries) <= dx_limit(entries);
+}
+
+static int dx_node_ok (struct super_block * sb, char * data)
+{
+	struct ext2_dir_entry * de = (struct ext2_dir_entry *) data;
+	struct ext2_dx_entry * entries;
+
+	if (de->inode || de->rec_len != sb->s_blocksize)
+		return 0;
+	entries = (struct ext2_dx_entry *) (data + EXT2_DX_NODE_ENTRIES);
+	return dx_limit(entries) == dx_node_limit(sb) &&
+	       dx_count(entries) && dx_count(entries) <= dx_limit(entries);
+}
+
+/*
+ * Walk the index down to the leaf for "hash".  Returns the number of
+ * levels filled in "frames", or 0 with *err set.
+ */
+static int dx_probe (struct inode * dir, unsigned long hash,
+		     struct dx_frame * frames, int * err)
+{
+	struct super_block * sb = dir->i_sb;
+	struct ext2_dx_entry * entries, * p, * q, * m;
+	struct buffer_head * bh;
+	unsigned long block, nblocks;
+	int level, levels;
+	const char * msg;
+
+	nblocks = dir->i_size >> EXT2_BLOCK_SIZE_BITS(sb);
+	if (!(bh = ext2_bread (dir, 0, 0, err)))
+		return 0;
+	if (!dx_root_ok (sb, bh->b_data)) {
+		brelse (bh);
+		dx_bad (dir, "bad index root");
+		*err = EXT2_DX_BAD;
+		return 0;
+	}
+	levels = ((struct ext2_dx_root_info *)
+		  (bh->b_data + EXT2_DX_ROOT_INFO))->indirect_levels;
+	entries = (struct ext2_dx_entry *) (bh->b_data + EXT2_DX_ROOT_ENTRIES);
+	for (level = 0; ; level++) {
+		p = entries + 1;
+		q = entries + dx_count(entries) - 1;
+		while (p <= q) {
+			m = p + (q - p) / 2;
+			if (m->hash > hash)
+				q = m - 1;
+			else
+				p = m + 1;
+		}
+		frames[level].bh = bh;
+		frames[level].entries = entries;
+		frames[level].at = p - 1;
+		block = frames[level].at->block;
+		if (!block || block >= nblocks) {
+			msg = "index points outside the directory";
+			goto bad;
+		}
+		if (level == levels)
+			return level + 1;
+		if (!(bh = ext2_bread (dir, block, 0, err))) {
+			dx_release (frames, level + 1);
+			return 0;
+		}
+		if (!dx_node_ok (sb, bh->b_data)) {
+			brelse (bh);
+			msg = "bad index node";
+			goto bad;
+		}
+		entries = (struct ext2_dx_entry *)
+			  (bh->b_data + EXT2_DX_NODE_ENTRIES);
+	}
+bad:
+	dx_release (frames, level + 1);
+	dx_bad (dir, msg);
+	*err = EXT2_DX_BAD;
+	return 0;
+}
+
+/*
+ * Move the frames on to the next leaf if it continues the run of names
+ * with this hash.  Returns 1 if it did.
+ */
+static int dx_next_leaf (struct inode * dir, struct dx_frame * frames, int n,
+			 unsigned long hash, int * err)
+{
+	struct dx_frame * p = frames + n - 1;
+	struct buffer_head * bh;
+
+	while (1) {
+		p->at++;
+		if (p->at < p->entries + dx_count(p->entries))
+			break;
+		if (p == frames)
+			return 0;
+		p--;
+	}
+	if (p->at->hash != (hash | 1))
+		return 0;
+	while (p < frames + n - 1) {
+		if (!(bh = ext2_bread (dir, p->at->block, 0, err)))
+			return 0;
+		p++;
+		brelse (p->bh);
+		p->bh = bh;
+		p->entries = (struct ext2_dx_entry *)
+			     (bh->b_data + EXT2_DX_NODE_ENTRIES);
+		p->at = p->entries;
+	}
+	return 1;
+}
+
+static struct ext2_dir_entry * dx_search_leaf (struct inode * dir,
+					       struct buffer_head * bh,
+					       unsigned long block,
+					       const char * name, int namelen)
+{
+	struct ext2_dir_entry * de = (struct ext2_dir_entry *) bh->b_data;
+	char * dlimit = bh->b_data + dir->i_sb->s_blocksize;
+	unsigned long offset = block << EXT2_BLOCK_SIZE_BITS(dir->i_sb);
+
+	while ((char *) de < dlimit) {
+		if (!ext2_check_dir_entry ("ext2_dx_find_entry", dir, de, bh,
+					   offset))
+			return NULL;
+		if (de->inode && de->name_len == namelen &&
+		    !memcmp (de->name, name, namelen))
+			return de;
+		offset += de->rec_len;
+		de = NEXT_DIRENT(de);
+	}
+	return NULL;
+}
+
+/*
+ *	ext2_dx_find_entry()
+ *
+ * is ext2_find_entry() for an indexed directory.  If the index can't be
+ * used it returns NULL with *err set to EXT2_DX_BAD, and the caller
+ * should search the directory linearly.
+ */
+struct buffer_head * ext2_dx_find_entry (struct inode * dir,
+					 const char * name, int namelen,
+					 struct ext2_dir_entry ** res_dir,
+					 int * err)
+{
+	struct dx_frame frames[EXT2_DX_MAX_LEVELS];
+	struct buffer_head * bh;
+	struct ext2_dir_entry * de;
+	unsigned long hash, block, generation;
+	int n;
+
+	*res_dir = NULL;
+	hash = dx_hash (name, namelen);
+repeat:
+	generation = dx_generation;
+	if (!(n = dx_probe (dir, hash, frames, err)))
+		return NULL;
+	do {
+		block = frames[n - 1].at->block;
+		if (!(bh = ext2_bread (dir, block, 0, err)))
+			break;
+		if ((de = dx_search_leaf (dir, bh, block, name, namelen))) {
+			dx_release (frames, n);
+			*res_dir = de;
+			return bh;
+		}
+		brelse (bh);
+		/* the frames point into index blocks that may have changed */
+		if (generation != dx_generation)
+			break;
+	} while (dx_next_leaf (dir, frames, n, hash, err));
+	dx_release (frames, n);
+	if (generation != dx_generation)
+		goto repeat;
+	*err = -ENOENT;
+	return NULL;
+}
+
+/*
+ * Find room for a name in one block, the way ext2_add_entry() does.
+ */
+static struct ext2_dir_entry * dx_add_to_leaf (struct inode * dir,
+					       struct buffer_head * bh,
+					       unsigned long block,
+					       const char * name, int namelen)
+{
+	struct ext2_dir_entry * de = (struct ext2_dir_entry *) bh->b_data;
+	struct ext2_dir_entry * de1;
+	char * dlimit = bh->b_data + dir->i_sb->s_blocksize;
+	unsigned long offset = block << EXT2_BLOCK_SIZE_BITS(dir->i_sb);
+	unsigned short rec_len = EXT2_DIR_REC_LEN(namelen);
+
+	while ((char *) de < dlimit) {
+		if (!ext2_check_dir_entry ("ext2_dx_add_entry", dir, de, bh,
+					   offset))
+			return NULL;
+		if ((de->inode == 0 && de->rec_len >= rec_len) ||
+		    (de->rec_len >= EXT2_DIR_REC_LEN(de->name_len) + rec_len)) {
+			if (de->inode) {
+				de1 = (struct ext2_dir_entry *) ((char *) de +
+					EXT2_DIR_REC_LEN(de->name_len));
+				de1->rec_len = de->rec_len -
+					EXT2_DIR_REC_LEN(de->name_len);
+				de->rec_len = EXT2_DIR_REC_LEN(de->name_len);
+				de = de1;
+			}
+			de->inode = 0;
+			de->name_len = namelen;
+			memcpy (de->name, name, namelen);
+			return de;
+		}
+		offset += de->rec_len;
+		de = NEXT_DIRENT(de);
+	}
+	return NULL;
+}
+
+/*
+ * Append an empty block to the directory.
+ */
+static struct buffer_head * dx_new_block (struct inode * dir,
+					  unsigned long * block, int * err)
+{
+	struct super_block * sb = dir->i_sb;
+	struct buffer_head * bh;
+	struct ext2_dir_entry * de;
+
+	*block = dir->i_size >> EXT2_BLOCK_SIZE_BITS(sb);
+	if (!(bh = ext2_bread (dir, *block, 1, err)))
+		return NULL;
+	de = (struct ext2_dir_entry *) bh->b_data;
+	de->inode = 0;
+	de->rec_len = sb->s_blocksize;
+	de->name_len = 0;
+	dir->i_size += sb->s_blocksize;
+	dir->i_dirt = 1;
+	mark_buffer_dirty(bh);
+	return bh;
+}
+
+/*
+ * Insert (hash, block) into an index array just after frame->at.
+ */
+static void dx_insert_entry (struct dx_frame * frame, unsigned long hash,
+			     unsigned long block)
+{
+	struct ext2_dx_entry * entries = frame->entries;
+	struct ext2_dx_entry * new = frame->at + 1;
+
+	memmove (new + 1, new, (char *) (entries + dx_count(entries)) -
+			       (char *) new);
+	new->hash = hash;
+	new->block = block;
+	dx_count(entries)++;
+	mark_buffer_dirty(frame->bh);
+}
+
+/*
+ * Pack the live entries of a block at its start, the last one taking
+ * up the rest of the block.
+ */
+static void dx_pack_leaf (struct buffer_head * bh, unsigned long size)
+{
+	char * from = bh->b_data, * to = bh->b_data, * limit = from + size;
+	struct ext2_dir_entry * de, * last = NULL;
+	unsigned short rec_len, len;
+
+	while (from < limit) {
+		de = (struct ext2_dir_entry *) from;
+		rec_len = de->rec_len;
+		if (de->inode) {
+			len = EXT2_DIR_REC_LEN(de->name_len);
+			if (to != from)
+				memmove (to, from, len);
+			last = (struct ext2_dir_entry *) to;
+			last->rec_len = len;
+			to += len;
+		}
+		from += rec_len;
+	}
+	if (last)
+		last->rec_len += limit - to;
+	else {
+		last = (struct ext2_dir_entry *) bh->b_data;
+		last->inode = 0;
+		last->rec_len = size;
+		last->name_len = 0;
+	}
+}
+
+/*
+ * Move the upper half (by hash) of a full leaf to an empty block, and
+ * return the hash that now separates them, odd if the split went
+ * through a run of equal hashes.  Returns 0 if the leaf can't be split.
+ */
+static unsigned long dx_split_leaf (struct inode * dir, unsigned long block,
+				    struct buffer_head * bh,
+				    struct buffer_head * bh2,
+				    struct dx_map_entry * map)
+{
+	unsigned long size = dir->i_sb->s_blocksize;
+	unsigned long offset = block << EXT2_BLOCK_SIZE_BITS(dir->i_sb);
+	struct ext2_dir_entry * de, * last = NULL;
+	struct dx_map_entry tmp;
+	unsigned long hash2;
+	int count = 0, split, i, j;
+	char * to;
+
+	de = (struct ext2_dir_entry *) bh->b_data;
+	while ((char *) de < bh->b_data + size) {
+		if (!ext2_check_dir_entry ("ext2_dx_add_entry", dir, de, bh,
+					   offset + ((char *) de - bh->b_data)))
+			return 0;
+		if (de->inode) {
+			map[count].hash = dx_hash (de->name, de->name_len);
+			map[count].offs = (char *) de - bh->b_data;
+			map[count].size = EXT2_DIR_REC_LEN(de->name_len);
+			count++;
+		}
+		de = NEXT_DIRENT(de);
+	}
+	if (count < 2)
+		return 0;
+	for (i = 1; i < count; i++) {
+		tmp = map[i];
+		for (j = i; j > 0 && map[j - 1].hash > tmp.hash; j--)
+			map[j] = map[j - 1];
+		map[j] = tmp;
+	}
+	split = count / 2;
+	hash2 = map[split].hash;
+	if (hash2 == map[split - 1].hash)
+		hash2 |= 1;
+	to = bh2->b_data;
+	for (i = split; i < count; i++) {
+		de = (struct ext2_dir_entry *) (bh->b_data + map[i].offs);
+		memcpy (to, de, map[i].size);
+		last = (struct ext2_dir_entry *) to;
+		last->rec_len = map[i].size;
+		to += map[i].size;
+		de->inode = 0;
+	}
+	last->rec_len += bh2->b_data + size - to;
+	dx_pack_leaf (bh, size);
+	mark_buffer_dirty(bh);
+	mark_buffer_dirty(bh2);
+	return hash2;
+}
+
+/*
+ * The root is full and points to leaves: move its array to a new index
+ * node and make the root point to that.
+ */
+static void dx_grow (struct inode * dir, struct dx_frame * frames,
+		     struct buffer_head * node_bh, unsigned long node_block)
+{
+	struct ext2_dx_entry * entries = frames[0].entries, * node;
+	int count = dx_count(entries);
+
+	node = (struct ext2_dx_entry *) (node_bh->b_data + EXT2_DX_NODE_ENTRIES);
+	memcpy (node, entries, count * sizeof (*node));
+	dx_limit(node) = dx_node_limit(dir->i_sb);
+	frames[1].bh = node_bh;
+	frames[1].entries = node;
+	frames[1].at = node + (frames[0].at - entries);
+	dx_count(entries) = 1;
+	entries[0].block = node_block;
+	frames[0].at = entries;
+	((struct ext2_dx_root_info *) (frames[0].bh->b_data +
+		EXT2_DX_ROOT_INFO))->indirect_levels = 1;
+	mark_buffer_dirty(frames[0].bh);
+	mark_buffer_dirty(node_bh);
+}
+
+/*
+ * The index node is full but the root isn't: move the upper half of the
+ * node to a new one, and leave frames[1] on whichever half it was in.
+ */
+static void dx_split_node (struct inode * dir, struct dx_frame * frames,
+			   struct buffer_head * node_bh, unsigned long node_block)
+{
+	struct ext2_dx_entry * entries = frames[1].entries, * node;
+	int count = dx_count(entries), split = count / 2;
+	unsigned long hash2 = entries[split].hash;
+
+	node = (struct ext2_dx_entry *) (node_bh->b_data + EXT2_DX_NODE_ENTRIES);
+	memcpy (node, entries + split, (count - split) * sizeof (*node));
+	dx_limit(node) = dx_node_limit(dir->i_sb);
+	dx_count(node) = count - split;
+	dx_count(entries) = split;
+	dx_insert_entry (frames, hash2, node_block);
+	mark_buffer_dirty(frames[1].bh);
+	mark_buffer_dirty(node_bh);
+	if (frames[1].at >= entries + split) {
+		frames[1].at = node + (frames[1].at - (entries + split));
+		frames[1].entries = node;
+		brelse (frames[1].bh);
+		frames[1].bh = node_bh;
+		frames[0].at++;
+	} else
+		brelse (node_bh);
+}
+
+/*
+ *	ext2_dx_add_entry()
+ *
+ * is ext2_add_entry() for an indexed directory, with the same results.
+ * A full leaf is split in two, and the index grows a level or splits a
+ * node when it has to.  Returns NULL with *err set to EXT2_DX_BAD if the
+ * index can't be used.
+ */
+struct buffer_head * ext2_dx_add_entry (struct inode * dir,
+					const char * name, int namelen,
+					struct ext2_dir_entry ** res_dir,
+					int * err)
+{
+	struct super_block * sb = dir->i_sb;
+	struct dx_frame frames[EXT2_DX_MAX_LEVELS], * frame;
+	struct buffer_head * bh, * bh2, * node_bh = NULL;
+	unsigned long hash, hash2, block, block2, node_block = 0;
+	unsigned long map;
+	int n;
+
+	if ((bh = ext2_dx_find_entry (dir, name, namelen, res_dir, err))) {
+		brelse (bh);
+		*res_dir = NULL;
+		*err = -EEXIST;
+		return NULL;
+	}
+	if (*err != -ENOENT)
+		return NULL;
+	hash = dx_hash (name, namelen);
+	if (!(n = dx_probe (dir, hash, frames, err)))
+		return NULL;
+	frame = frames + n - 1;
+	block = frame->at->block;
+	if (!(bh = ext2_bread (dir, block, 0, err)))
+		goto out;
+	if ((*res_dir = dx_add_to_leaf (dir, bh, block, name, namelen)))
+		goto added;
+
+	/*
+	 * The leaf is full.  Get everything a split needs before touching
+	 * anything: unlink() may change the leaf while we sleep, but
+	 * nothing else can change the index.
+	 */
+	*err = -ENOSPC;
+	if (dx_count(frame->entries) == dx_limit(frame->entries) &&
+	    (n == EXT2_DX_MAX_LEVELS &&
+	     dx_count(frames[0].entries) == dx_limit(frames[0].entries))) {
+		ext2_warning (sb, "ext2_dx_add_entry",
+			      "directory #%lu: index full", dir->i_ino);
+		goto out_leaf;
+	}
+	if (!(map = __get_free_page (GFP_KERNEL))) {
+		*err = -ENOMEM;
+		goto out_leaf;
+	}
+	if (dx_count(frame->entries) == dx_limit(frame->entries) &&
+	    !(node_bh = dx_new_block (dir, &node_block, err)))
+		goto out_map;
+	if (!(bh2 = dx_new_block (dir, &block2, err))) {
+		brelse (node_bh);
+		goto out_map;
+	}
+	/*
+	 * An unlink may have made room while we slept.  The new blocks
+	 * then stay empty at the end of the directory.
+	 */
+	if ((*res_dir = dx_add_to_leaf (dir, bh, block, name, namelen))) {
+		brelse (node_bh);
+		brelse (bh2);
+		free_page (map);
+		goto added;
+	}
+	*err = -EIO;
+	dx_generation++;
+	if (node_bh) {
+		if (n == 1) {
+			dx_grow (dir, frames, node_bh, node_block);
+			n = 2;
+		} else
+			dx_split_node (dir, frames, node_bh, node_block);
+		frame = frames + n - 1;
+	}
+	if (!(hash2 = dx_split_leaf (dir, block, bh, bh2,
+				     (struct dx_map_entry *) map))) {
+		brelse (bh2);
+		goto out_map;
+	}
+	dx_insert_entry (frame, hash2, block2);
+	free_page (map);
+	if (hash >= (hash2 & ~1)) {
+		brelse (bh);
+		bh = bh2;
+		block = block2;
+	} else
+		brelse (bh2);
+	*err = -ENOSPC;
+	if (!(*res_dir = dx_add_to_leaf (dir, bh, block, name, namelen)))
+		goto out_leaf;
+added:
+	dx_release (frames, n);
+	dir->i_mtime = dir->i_ctime = CURRENT_TIME;
+	dir->i_dirt = 1;
+	mark_buffer_dirty(bh);
+	*err = 0;
+	return bh;
+
+out_map:
+	free_page (map);
+out_leaf:
+	brelse (bh);
+out:
+	dx_release (frames, n);
+	return NULL;
+}
+
+/*
+ *	ext2_dx_make_indexed()
+ *
+ * is called by ext2_add_entry() when a directory is about to get its
+ * second block, "bh".  The names in block 0 move to it, and block 0
+ * becomes the root of an index pointing to it.  Returns 0 (and leaves
+ * everything alone) if block 0 doesn't start with "." and "..".
+ */
+int ext2_dx_make_indexed (struct inode * dir, struct buffer_head * bh)
+{
+	struct super_block * sb = dir->i_sb;
+	struct buffer_head * root_bh;
+	struct ext2_dir_entry * de, * dotdot, * last;
+	struct ext2_dx_root_info * info;
+	struct ext2_dx_entry * entries;
+	unsigned long start, offset;
+	int err;
+
+	if (!(root_bh = ext2_bread (dir, 0, 0, &err)))
+		return 0;
+	de = (struct ext2_dir_entry *) root_bh->b_data;
+	if (de->rec_len != EXT2_DIR_REC_LEN(1) || de->name_len != 1 ||
+	    de->name[0] != '.')
+		goto out;
+	dotdot = NEXT_DIRENT(de);
+	if (!ext2_check_dir_entry ("ext2_dx_make_indexed", dir, dotdot,
+				   root_bh, EXT2_DIR_REC_LEN(1)) ||
+	    dotdot->name_len != 2 || dotdot->name[0] != '.' ||
+	    dotdot->name[1] != '.')
+		goto out;
+	start = offset = EXT2_DIR_REC_LEN(1) + dotdot->rec_len;
+	last = NULL;
+	while (offset < sb->s_blocksize) {
+		de = (struct ext2_dir_entry *) (root_bh->b_data + offset);
+		if (!ext2_check_dir_entry ("ext2_dx_make_indexed", dir, de,
+					   root_bh, offset))
+			goto out;
+		last = de;
+		offset += de->rec_len;
+	}
+	if (last) {
+		memcpy (bh->b_data, root_bh->b_data + start,
+			sb->s_blocksize - start);
+		last = (struct ext2_dir_entry *) (bh->b_data +
+			((char *) last - root_bh->b_data) - start);
+		last->rec_len += start;
+	} else {
+		de = (struct ext2_dir_entry *) bh->b_data;
+		de->inode = 0;
+		de->rec_len = sb->s_blocksize;
+		de->name_len = 0;
+	}
+	dx_generation++;
+	dotdot->rec_len = sb->s_blocksize - EXT2_DIR_REC_LEN(1);
+	memset (root_bh->b_data + EXT2_DX_ROOT_INFO, 0,
+		sb->s_blocksize - EXT2_DX_ROOT_INFO);
+	info = (struct ext2_dx_root_info *) (root_bh->b_data + EXT2_DX_ROOT_INFO);
+	info->hash_version = EXT2_DX_HASH_LEGACY;
+	info->info_length = sizeof (*info);
+	entries = (struct ext2_dx_entry *) (root_bh->b_data + EXT2_DX_ROOT_ENTRIES);
+	dx_limit(entries) = dx_root_limit(sb);
+	dx_count(entries) = 1;
+	entries[0].block = 1;
+	dir->u.ext2_i.i_flags |= EXT2_INDEX_FL;
+	dir->i_dirt = 1;
+	mark_buffer_dirty(root_bh);
+	mark_buffer_dirty(bh);
+	brelse (root_bh);
+	return 1;
+out:
+	brelse (root_bh);
+	return 0;
+}
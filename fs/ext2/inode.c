@@ -109,7 +109,7 @@ static int ext2_alloc_block (struct inode * inode, unsigned long goal)
 		}
 		clear_block (bh->b_data, inode->i_sb->s_blocksize);
 		bh->b_uptodate = 1;
-		bh->b_dirt = 1;
+		mark_buffer_dirty(bh);
 		brelse (bh);
 	} else {
 		ext2_discard_prealloc (inode);
@@ -118,13 +118,14 @@ static int ext2_alloc_block (struct inode * inode, unsigned long goal)
 		if (S_ISREG(inode->i_mode))
 			result = ext2_new_block
 				(inode->i_sb, goal,
+				 inode->u.ext2_i.i_alloc_want,
 				 &inode->u.ext2_i.i_prealloc_count,
 				 &inode->u.ext2_i.i_prealloc_block);
 		else
-			result = ext2_new_block (inode->i_sb, goal, 0, 0);
+			result = ext2_new_block (inode->i_sb, goal, 0, 0, 0);
 	}
 #else
-	result = ext2_new_block (inode->i_sb, goal, 0, 0);
+	result = ext2_new_block (inode->i_sb, goal, 0, 0, 0);
 #endif
 
 	return result;
@@ -314,7 +315,7 @@ repeat:
 		goto repeat;
 	}
 	*p = tmp;
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	if (IS_SYNC(inode)) {
 		ll_rw_block (WRITE, 1, &bh);
 		wait_on_buffer (bh);
@@ -464,6 +465,7 @@ void ext2_read_inode (struct inode * inode)
 	inode->u.ext2_i.i_block_group = block_group;
 	inode->u.ext2_i.i_next_alloc_block = 0;
 	inode->u.ext2_i.i_next_alloc_goal = 0;
+	inode->u.ext2_i.i_alloc_want = 0;
 	if (inode->u.ext2_i.i_prealloc_count)
 		ext2_error (inode->i_sb, "ext2_read_inode",
 			    "New inode has non-zero prealloc count!");
@@ -549,7 +551,7 @@ static struct buffer_head * ext2_update_inode (struct inode * inode)
 		raw_inode->i_block[0] = inode->i_rdev;
 	else for (block = 0; block < EXT2_N_BLOCKS; block++)
 		raw_inode->i_block[block] = inode->u.ext2_i.i_data[block];
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	inode->i_dirt = 0;
 	return bh;
 }
@@ -13,15 +13,21 @@
 #include <linux/ext2_fs.h>
 #include <linux/ioctl.h>
 #include <linux/sched.h>
+#include <linux/stat.h>
 
 int ext2_ioctl (struct inode * inode, struct file * filp, unsigned int cmd,
 		unsigned long arg)
 {
+	unsigned long nr, i, block, last, extents;
+	int err;
 
 	ext2_debug ("cmd = %u, arg = %lu\n", cmd, arg);
 
 	switch (cmd) {
 	case EXT2_IOC_GETFLAGS:
+		err = verify_area (VERIFY_WRITE, (long *) arg, sizeof(long));
+		if (err)
+			return err;
 		put_fs_long (inode->u.ext2_i.i_flags, (long *) arg);
 		return 0;
 	case EXT2_IOC_SETFLAGS:
@@ -29,11 +35,40 @@ int ext2_ioctl (struct inode * inode, struct file * filp, unsigned int cmd,
 			return -EPERM;
 		if (IS_RDONLY(inode))
 			return -EROFS;
-		inode->u.ext2_i.i_flags = get_fs_long ((long *) arg);
+		/* whether a directory has an index is ours to say */
+		inode->u.ext2_i.i_flags = (get_fs_long ((long *) arg) &
+					   ~EXT2_INDEX_FL) |
+					  (inode->u.ext2_i.i_flags &
+					   EXT2_INDEX_FL);
 		inode->i_ctime = CURRENT_TIME;
 		inode->i_dirt = 1;
 		return 0;
+	case EXT2_IOC_GETEXTENTS:
+		/*
+		 * Number of contiguous runs of blocks in the file, for
+		 * measuring fragmentation
+		 */
+		if (!S_ISREG(inode->i_mode) && !S_ISDIR(inode->i_mode))
+			return -EINVAL;
+		err = verify_area (VERIFY_WRITE, (long *) arg, sizeof(long));
+		if (err)
+			return err;
+		nr = (inode->i_size + inode->i_sb->s_blocksize - 1) >>
+		     EXT2_BLOCK_SIZE_BITS(inode->i_sb);
+		extents = 0;
+		last = 0;
+		for (i = 0; i < nr; i++) {
+			block = ext2_bmap (inode, i);
+			if (block && block != last + 1)
+				extents++;
+			last = block;
+		}
+		put_fs_long (extents, (long *) arg);
+		return 0;
 	case EXT2_IOC_GETVERSION:
+		err = verify_area (VERIFY_WRITE, (long *) arg, sizeof(long));
+		if (err)
+			return err;
 		put_fs_long (inode->u.ext2_i.i_version, (long *) arg);
 		return 0;
 	case EXT2_IOC_SETVERSION:
@@ -64,6 +64,19 @@ static int ext2_match (int len, const char * const name,
 	return (int) same;
 }
 
+/*
+ * Use the hashed index of a directory that has one, except for "." and
+ * ".." which live in its first block anyway.
+ */
+static inline int ext2_use_index (struct inode * dir, const char * name,
+				  int namelen)
+{
+	if (!(dir->u.ext2_i.i_flags & EXT2_INDEX_FL) || !namelen)
+		return 0;
+	return !(name[0] == '.' &&
+		 (namelen == 1 || (namelen == 2 && name[1] == '.')));
+}
+
 /*
  *	ext2_find_entry()
  *
@@ -94,6 +107,13 @@ static struct buffer_head * ext2_find_entry (struct inode * dir,
 	if (namelen > EXT2_NAME_LEN)
 		namelen = EXT2_NAME_LEN;
 #endif
+	if (ext2_use_index (dir, name, namelen)) {
+		struct buffer_head * bh;
+
+		bh = ext2_dx_find_entry (dir, name, namelen, res_dir, &err);
+		if (bh || err != EXT2_DX_BAD)
+			return bh;
+	}
 
 	memset (bh_use, 0, sizeof (bh_use));
 	toread = 0;
@@ -167,6 +187,23 @@ failure:
 	return NULL;
 }
 
+/*
+ * Adding a name to an indexed directory can move other names to a new
+ * block, so an entry found before sleeping may not be where it was.
+ * Look it up again right before changing it: nothing sleeps between
+ * ext2_find_entry() finding it and the caller using it.
+ */
+static struct buffer_head * ext2_find_again (struct inode * dir,
+					     const char * name, int namelen,
+					     struct buffer_head * bh,
+					     struct ext2_dir_entry ** res_dir)
+{
+	if (!ext2_use_index (dir, name, namelen))
+		return bh;
+	brelse (bh);
+	return ext2_find_entry (dir, name, namelen, res_dir);
+}
+
 int ext2_lookup (struct inode * dir, const char * name, int len,
 		 struct inode ** result)
 {
@@ -248,6 +285,12 @@ static struct buffer_head * ext2_add_entry (struct inode * dir,
 		*err = -ENOENT;
 		return NULL;
 	}
+	if (ext2_use_index (dir, name, namelen)) {
+		bh = ext2_dx_add_entry (dir, name, namelen, res_dir, err);
+		if (bh || *err != EXT2_DX_BAD)
+			return bh;
+		*err = -EINVAL;
+	}
 	bh = ext2_bread (dir, 0, 0, err);
 	if (!bh)
 		return NULL;
@@ -278,6 +321,17 @@ static struct buffer_head * ext2_add_entry (struct inode * dir,
 #if 0 /* XXX don't update any times until successful completion of syscall */
 				dir->i_ctime = CURRENT_TIME;
 #endif
+				/*
+				 * A directory outgrowing its first block gets
+				 * an index if the filesystem wants one.
+				 */
+				if (offset == sb->s_blocksize &&
+				    test_opt (sb, INDEX) &&
+				    ext2_dx_make_indexed (dir, bh)) {
+					brelse (bh);
+					return ext2_dx_add_entry (dir, name, namelen,
+								  res_dir, err);
+				}
 			} else {
 
 				ext2_debug ("skipping to next block\n");
@@ -323,7 +377,7 @@ static struct buffer_head * ext2_add_entry (struct inode * dir,
 			 */
 			dir->i_mtime = dir->i_ctime = CURRENT_TIME;
 			dir->i_dirt = 1;
-			bh->b_dirt = 1;
+			mark_buffer_dirty(bh);
 			*res_dir = de;
 			*err = 0;
 			return bh;
@@ -397,7 +451,7 @@ int ext2_create (struct inode * dir,const char * name, int len, int mode,
 	ext2_dcache_add (dir->i_dev, dir->i_ino, de->name, de->name_len,
 			 de->inode);
 #endif
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	if (IS_SYNC(dir)) {
 		ll_rw_block (WRITE, 1, &bh);
 		wait_on_buffer (bh);
@@ -471,7 +525,7 @@ int ext2_mknod (struct inode * dir, const char * name, int len, int mode,
 	ext2_dcache_add (dir->i_dev, dir->i_ino, de->name, de->name_len,
 			 de->inode);
 #endif
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	if (IS_SYNC(dir)) {
 		ll_rw_block (WRITE, 1, &bh);
 		wait_on_buffer (bh);
@@ -531,7 +585,7 @@ int ext2_mkdir (struct inode * dir, const char * name, int len, int mode)
 	de->name_len = 2;
 	strcpy (de->name, "..");
 	inode->i_nlink = 2;
-	dir_block->b_dirt = 1;
+	mark_buffer_dirty(dir_block);
 	brelse (dir_block);
 	inode->i_mode = S_IFDIR | (mode & S_IRWXUGO & ~current->umask);
 	if (dir->i_mode & S_ISGID)
@@ -550,7 +604,7 @@ int ext2_mkdir (struct inode * dir, const char * name, int len, int mode)
 	ext2_dcache_add (dir->i_dev, dir->i_ino, de->name, de->name_len,
 			 de->inode);
 #endif
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	if (IS_SYNC(dir)) {
 		ll_rw_block (WRITE, 1, &bh);
 		wait_on_buffer (bh);
@@ -656,7 +710,8 @@ repeat:
 	down(&inode->i_sem);
 	if (!empty_dir (inode))
 		retval = -ENOTEMPTY;
-	else if (de->inode != inode->i_ino)
+	else if (!(bh = ext2_find_again (dir, name, len, bh, &de)) ||
+		 de->inode != inode->i_ino)
 		retval = -ENOENT;
 	else {
 		if (inode->i_count > 1) {
@@ -674,7 +729,7 @@ repeat:
 	up(&inode->i_sem);
 	if (retval)
 		goto end_rmdir;
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	if (IS_SYNC(dir)) {
 		ll_rw_block (WRITE, 1, &bh);
 		wait_on_buffer (bh);
@@ -739,10 +794,15 @@ repeat:
 			      inode->i_ino, inode->i_nlink);
 		inode->i_nlink = 1;
 	}
+	if (!(bh = ext2_find_again (dir, name, len, bh, &de)) ||
+	    de->inode != inode->i_ino) {
+		retval = -ENOENT;
+		goto end_unlink;
+	}
 	retval = ext2_delete_entry (de, bh);
 	if (retval)
 		goto end_unlink;
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	if (IS_SYNC(dir)) {
 		ll_rw_block (WRITE, 1, &bh);
 		wait_on_buffer (bh);
@@ -807,7 +867,7 @@ int ext2_symlink (struct inode * dir, const char * name, int len,
 		link[i++] = c;
 	link[i] = 0;
 	if (name_block) {
-		name_block->b_dirt = 1;
+		mark_buffer_dirty(name_block);
 		brelse (name_block);
 	}
 	inode->i_size = i;
@@ -834,7 +894,7 @@ int ext2_symlink (struct inode * dir, const char * name, int len,
 	ext2_dcache_add (dir->i_dev, dir->i_ino, de->name, de->name_len,
 			 de->inode);
 #endif
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	if (IS_SYNC(dir)) {
 		ll_rw_block (WRITE, 1, &bh);
 		wait_on_buffer (bh);
@@ -880,7 +940,7 @@ int ext2_link (struct inode * oldinode, struct inode * dir,
 	ext2_dcache_add (dir->i_dev, dir->i_ino, de->name, de->name_len,
 			 de->inode);
 #endif
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	if (IS_SYNC(dir)) {
 		ll_rw_block (WRITE, 1, &bh);
 		wait_on_buffer (bh);
@@ -1025,6 +1085,9 @@ start_up:
 					 &retval);
 	if (!new_bh)
 		goto end_rename;
+	if (!(old_bh = ext2_find_again (old_dir, old_name, old_len, old_bh,
+					&old_de)))
+		goto try_again;
 	/*
 	 * sanity checking before doing the rename - avoid races
 	 */
@@ -1056,19 +1119,19 @@ start_up:
 	}
 	old_dir->i_ctime = old_dir->i_mtime = CURRENT_TIME;
 	old_dir->i_dirt = 1;
-	old_bh->b_dirt = 1;
+	mark_buffer_dirty(old_bh);
 	if (IS_SYNC(old_dir)) {
 		ll_rw_block (WRITE, 1, &old_bh);
 		wait_on_buffer (old_bh);
 	}
-	new_bh->b_dirt = 1;
+	mark_buffer_dirty(new_bh);
 	if (IS_SYNC(new_dir)) {
 		ll_rw_block (WRITE, 1, &new_bh);
 		wait_on_buffer (new_bh);
 	}
 	if (dir_bh) {
 		PARENT_INO(dir_bh->b_data) = new_dir->i_ino;
-		dir_bh->b_dirt = 1;
+		mark_buffer_dirty(dir_bh);
 		old_dir->i_nlink--;
 		old_dir->i_dirt = 1;
 		if (new_inode) {
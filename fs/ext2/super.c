@@ -24,6 +24,8 @@
 #include <linux/stat.h>
 #include <linux/string.h>
 #include <linux/locks.h>
+#include <linux/mm.h>
+#include <linux/malloc.h>
 
 extern int vsprintf (char *, const char *, va_list);
 
@@ -36,7 +38,7 @@ void ext2_error (struct super_block * sb, const char * function,
 	if (!(sb->s_flags & MS_RDONLY)) {
 		sb->u.ext2_sb.s_mount_state |= EXT2_ERROR_FS;
 		sb->u.ext2_sb.s_es->s_state |= EXT2_ERROR_FS;
-		sb->u.ext2_sb.s_sbh->b_dirt = 1;
+		mark_buffer_dirty(sb->u.ext2_sb.s_sbh);
 		sb->s_dirt = 1;
 	}
 	va_start (args, fmt);
@@ -66,7 +68,7 @@ NORET_TYPE void ext2_panic (struct super_block * sb, const char * function,
 	if (!(sb->s_flags & MS_RDONLY)) {
 		sb->u.ext2_sb.s_mount_state |= EXT2_ERROR_FS;
 		sb->u.ext2_sb.s_es->s_state |= EXT2_ERROR_FS;
-		sb->u.ext2_sb.s_sbh->b_dirt = 1;
+		mark_buffer_dirty(sb->u.ext2_sb.s_sbh);
 		sb->s_dirt = 1;
 	}
 	va_start (args, fmt);
@@ -89,6 +91,70 @@ void ext2_warning (struct super_block * sb, const char * function,
 		MAJOR(sb->s_dev), MINOR(sb->s_dev), function, buf);
 }
 
+/*
+ * The bitmap caches grow as groups are used, up to one bitmap for every
+ * 256 blocks of memory (at least EXT2_MIN_GROUP_LOADED, at most
+ * EXT2_MAX_GROUP_LOADED), and never beyond the number of groups.  They
+ * are allocated at mount time, together with the per group summary.
+ */
+static int ext2_group_caches_size (struct super_block * sb)
+{
+	return sb->u.ext2_sb.s_max_loaded_bitmaps *
+	       2 * (sizeof (unsigned long) + sizeof (struct buffer_head *)) +
+	       sb->u.ext2_sb.s_groups_count * sizeof (unsigned short);
+}
+
+static int ext2_alloc_group_caches (struct super_block * sb)
+{
+	struct ext2_group_desc * gdp;
+	unsigned long max;
+	char * p;
+	int i, size;
+
+	max = high_memory / (sb->s_blocksize * 256);
+	if (max < EXT2_MIN_GROUP_LOADED)
+		max = EXT2_MIN_GROUP_LOADED;
+	if (max > EXT2_MAX_GROUP_LOADED)
+		max = EXT2_MAX_GROUP_LOADED;
+	if (max > sb->u.ext2_sb.s_groups_count)
+		max = sb->u.ext2_sb.s_groups_count;
+	sb->u.ext2_sb.s_max_loaded_bitmaps = max;
+	size = ext2_group_caches_size (sb);
+	if (!(p = (char *) kmalloc (size, GFP_KERNEL)))
+		return 0;
+	memset (p, 0, size);
+	sb->u.ext2_sb.s_inode_bitmap_number = (unsigned long *) p;
+	p += max * sizeof (unsigned long);
+	sb->u.ext2_sb.s_block_bitmap_number = (unsigned long *) p;
+	p += max * sizeof (unsigned long);
+	sb->u.ext2_sb.s_inode_bitmap = (struct buffer_head **) p;
+	p += max * sizeof (struct buffer_head *);
+	sb->u.ext2_sb.s_block_bitmap = (struct buffer_head **) p;
+	p += max * sizeof (struct buffer_head *);
+	sb->u.ext2_sb.s_max_free_run = (unsigned short *) p;
+	sb->u.ext2_sb.s_loaded_inode_bitmaps = 0;
+	sb->u.ext2_sb.s_loaded_block_bitmaps = 0;
+	/*
+	 * Until its bitmap is read, a group's free block count is the
+	 * best bound there is on its longest free run
+	 */
+	for (i = 0; i < sb->u.ext2_sb.s_groups_count; i++) {
+		gdp = (struct ext2_group_desc *) sb->u.ext2_sb.s_group_desc
+			[i / EXT2_DESC_PER_BLOCK(sb)]->b_data +
+		      i % EXT2_DESC_PER_BLOCK(sb);
+		sb->u.ext2_sb.s_max_free_run[i] = gdp->bg_free_blocks_count;
+	}
+	return 1;
+}
+
+static void ext2_free_group_caches (struct super_block * sb)
+{
+	kfree_s (sb->u.ext2_sb.s_inode_bitmap_number,
+		 ext2_group_caches_size (sb));
+	sb->u.ext2_sb.s_inode_bitmap_number = NULL;
+	sb->u.ext2_sb.s_max_loaded_bitmaps = 0;
+}
+
 void ext2_put_super (struct super_block * sb)
 {
 	int i;
@@ -96,7 +162,7 @@ void ext2_put_super (struct super_block * sb)
 	lock_super (sb);
 	if (!(sb->s_flags & MS_RDONLY)) {
 		sb->u.ext2_sb.s_es->s_state = sb->u.ext2_sb.s_mount_state;
-		sb->u.ext2_sb.s_sbh->b_dirt = 1;
+		mark_buffer_dirty(sb->u.ext2_sb.s_sbh);
 	}
 #ifndef DONT_USE_DCACHE
 	ext2_dcache_invalidate (sb->s_dev);
@@ -105,12 +171,13 @@ void ext2_put_super (struct super_block * sb)
 	for (i = 0; i < EXT2_MAX_GROUP_DESC; i++)
 		if (sb->u.ext2_sb.s_group_desc[i])
 			brelse (sb->u.ext2_sb.s_group_desc[i]);
-	for (i = 0; i < EXT2_MAX_GROUP_LOADED; i++)
+	for (i = 0; i < sb->u.ext2_sb.s_max_loaded_bitmaps; i++)
 		if (sb->u.ext2_sb.s_inode_bitmap[i])
 			brelse (sb->u.ext2_sb.s_inode_bitmap[i]);
-	for (i = 0; i < EXT2_MAX_GROUP_LOADED; i++)
+	for (i = 0; i < sb->u.ext2_sb.s_max_loaded_bitmaps; i++)
 		if (sb->u.ext2_sb.s_block_bitmap[i])
 			brelse (sb->u.ext2_sb.s_block_bitmap[i]);
+	ext2_free_group_caches (sb);
 	brelse (sb->u.ext2_sb.s_sbh);
 	unlock_super (sb);
 	return;
@@ -159,10 +226,10 @@ static int convert_pre_02b_fs (struct super_block * sb,
 		gdp[i].bg_free_blocks_count = old_group_desc[i].bg_free_blocks_count;
 		gdp[i].bg_free_inodes_count = old_group_desc[i].bg_free_inodes_count;
 	}
-	bh2->b_dirt = 1;
+	mark_buffer_dirty(bh2);
 	brelse (bh2);
 	es->s_magic = EXT2_SUPER_MAGIC;
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	sb->s_magic = EXT2_SUPER_MAGIC;
 	return 1;
 }
@@ -236,6 +303,8 @@ static int parse_options (char * options, unsigned long * sb_block,
 		else if (!strcmp (this_char, "grpid") ||
 			 !strcmp (this_char, "bsdgroups"))
 			set_opt (*mount_options, GRPID);
+		else if (!strcmp (this_char, "index"))
+			set_opt (*mount_options, INDEX);
 		else if (!strcmp (this_char, "nocheck")) {
 			clear_opt (*mount_options, CHECK_NORMAL);
 			clear_opt (*mount_options, CHECK_STRICT);
@@ -243,6 +312,8 @@ static int parse_options (char * options, unsigned long * sb_block,
 		else if (!strcmp (this_char, "nogrpid") ||
 			 !strcmp (this_char, "sysvgroups"))
 			clear_opt (*mount_options, GRPID);
+		else if (!strcmp (this_char, "noindex"))
+			clear_opt (*mount_options, INDEX);
 		else if (!strcmp (this_char, "sb")) {
 			if (!value || !*value) {
 				printk ("EXT2-fs: the sb option requires "
@@ -287,7 +358,7 @@ static void ext2_setup_super (struct super_block * sb,
 			es->s_max_mnt_count = EXT2_DFL_MAX_MNT_COUNT;
 		es->s_mnt_count++;
 		es->s_mtime = CURRENT_TIME;
-		sb->u.ext2_sb.s_sbh->b_dirt = 1;
+		mark_buffer_dirty(sb->u.ext2_sb.s_sbh);
 		sb->s_dirt = 1;
 		if (test_opt (sb, DEBUG))
 			printk ("[EXT II FS %s, %s, bs=%lu, fs=%lu, gc=%lu, "
@@ -544,14 +615,15 @@ struct super_block * ext2_read_super (struct super_block * sb, void * data,
 		printk ("EXT2-fs: group descriptors corrupted !\n");
 		return NULL;
 	}
-	for (i = 0; i < EXT2_MAX_GROUP_LOADED; i++) {
-		sb->u.ext2_sb.s_inode_bitmap_number[i] = 0;
-		sb->u.ext2_sb.s_inode_bitmap[i] = NULL;
-		sb->u.ext2_sb.s_block_bitmap_number[i] = 0;
-		sb->u.ext2_sb.s_block_bitmap[i] = NULL;
+	if (!ext2_alloc_group_caches (sb)) {
+		sb->s_dev = 0;
+		unlock_super (sb);
+		for (j = 0; j < i; j++)
+			brelse (sb->u.ext2_sb.s_group_desc[j]);
+		brelse (bh);
+		printk ("EXT2-fs: not enough memory\n");
+		return NULL;
 	}
-	sb->u.ext2_sb.s_loaded_inode_bitmaps = 0;
-	sb->u.ext2_sb.s_loaded_block_bitmaps = 0;
 	unlock_super (sb);
 	/*
 	 * set up enough so that it can read an inode
@@ -563,6 +635,7 @@ struct super_block * ext2_read_super (struct super_block * sb, void * data,
 		for (i = 0; i < EXT2_MAX_GROUP_DESC; i++)
 			if (sb->u.ext2_sb.s_group_desc[i])
 				brelse (sb->u.ext2_sb.s_group_desc[i]);
+		ext2_free_group_caches (sb);
 		brelse (bh);
 		printk ("EXT2-fs: get root inode failed\n");
 		return NULL;
@@ -570,7 +643,7 @@ struct super_block * ext2_read_super (struct super_block * sb, void * data,
 #ifdef EXT2FS_PRE_02B_COMPAT
 	if (fs_converted) {
 		for (i = 0; i < bh_count; i++)
-			sb->u.ext2_sb.s_group_desc[i]->b_dirt = 1;
+			mark_buffer_dirty(sb->u.ext2_sb.s_group_desc[i]);
 		sb->s_dirt = 1;
 	}
 #endif
@@ -582,7 +655,7 @@ static void ext2_commit_super (struct super_block * sb,
 			       struct ext2_super_block * es)
 {
 	es->s_wtime = CURRENT_TIME;
-	sb->u.ext2_sb.s_sbh->b_dirt = 1;
+	mark_buffer_dirty(sb->u.ext2_sb.s_sbh);
 	sb->s_dirt = 0;
 }
 
@@ -639,7 +712,7 @@ int ext2_remount (struct super_block * sb, int * flags, char * data)
 		 */
 		es->s_state = sb->u.ext2_sb.s_mount_state;
 		es->s_mtime = CURRENT_TIME;
-		sb->u.ext2_sb.s_sbh->b_dirt = 1;
+		mark_buffer_dirty(sb->u.ext2_sb.s_sbh);
 		sb->s_dirt = 1;
 		ext2_commit_super (sb, es);
 	}
@@ -90,7 +90,7 @@ repeat:
 		if (inode->u.ext2_i.i_flags & EXT2_SECRM_FL) {
 			clear_block (bh->b_data, inode->i_sb->s_blocksize,
 				     RANDOM_INT);
-			bh->b_dirt = 1;
+			mark_buffer_dirty(bh);
 		}
 		brelse (bh);
 		if (free_count == 0) {
@@ -162,11 +162,11 @@ repeat:
 			continue;
 		}
 		*ind = 0;
-		ind_bh->b_dirt = 1;
+		mark_buffer_dirty(ind_bh);
 		if (inode->u.ext2_i.i_flags & EXT2_SECRM_FL) {
 			clear_block (bh->b_data, inode->i_sb->s_blocksize,
 				     RANDOM_INT);
-			bh->b_dirt = 1;
+			mark_buffer_dirty(bh);
 		}
 		brelse (bh);
 		if (free_count == 0) {
@@ -243,7 +243,7 @@ repeat:
 			continue;
 		retry |= trunc_indirect (inode, offset + (i * addr_per_block),
 					  dind);
-		dind_bh->b_dirt = 1;
+		mark_buffer_dirty(dind_bh);
 	}
 	dind = (unsigned long *) dind_bh->b_data;
 	for (i = 0; i < addr_per_block; i++)
@@ -302,7 +302,7 @@ repeat:
 		retry |= trunc_dindirect(inode, EXT2_NDIR_BLOCKS +
 			addr_per_block + (i + 1) * addr_per_block * addr_per_block,
 			tind);
-		tind_bh->b_dirt = 1;
+		mark_buffer_dirty(tind_bh);
 	}
 	tind = (unsigned long *) tind_bh->b_data;
 	for (i = 0; i < addr_per_block; i++)
@@ -838,16 +838,13 @@ static unsigned count_one_bitmap(dev_t dev, secno secno)
 {
 	struct quad_buffer_head qbh;
 	char *bits;
-	unsigned i, count;
+	unsigned count;
 
 	bits = map_4sectors(dev, secno, &qbh);
 	if (!bits)
 		return 0;
 
-	count = 0;
-
-	for (i = 0; i < 8 * 2048; i++)
-		count += (test_bit(i, bits) != 0);
+	count = 8 * 2048 - count_zero_bits(bits, 8 * 2048);
 	brelse4(&qbh);
 
 	return count;
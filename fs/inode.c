@@ -149,6 +149,7 @@ void clear_inode(struct inode * inode)
 	struct wait_queue * wait;
 
 	wait_on_inode(inode);
+	invalidate_page_cache(inode, 0);
 	remove_inode_hash(inode);
 	remove_inode_free(inode);
 	wait = ((volatile struct inode *) inode)->i_wait;
@@ -16,6 +16,7 @@
 #include <linux/fcntl.h>
 #include <linux/stat.h>
 #include <linux/locks.h>
+#include <linux/mm.h>
 
 #define	NBUF	32
 
@@ -91,7 +92,12 @@ static int minix_file_read(struct inode * inode, struct file * filp, char * buf,
 		left = count;
 	if (left <= 0)
 		return 0;
-	read = 0;
+	read = read_page_cache(inode,offset,buf,left);
+	filp->f_pos += read;
+	if (!(left -= read))
+		goto done;
+	buf += read;
+	offset += read;
 	block = offset >> BLOCK_SIZE_BITS;
 	offset &= BLOCK_SIZE-1;
 	size = (size + (BLOCK_SIZE-1)) >> BLOCK_SIZE_BITS;
@@ -179,6 +185,7 @@ static int minix_file_read(struct inode * inode, struct file * filp, char * buf,
 	};
 	if (!read)
 		return -EIO;
+done:
 	filp->f_reada = 1;
 	if (!IS_RDONLY(inode))
 		inode->i_atime = CURRENT_TIME;
@@ -239,7 +246,7 @@ static int minix_file_write(struct inode * inode, struct file * filp, char * buf
 		memcpy_fromfs(p,buf,c);
 		buf += c;
 		bh->b_uptodate = 1;
-		bh->b_dirt = 1;
+		mark_buffer_dirty(bh);
 		brelse(bh);
 	}
 	inode->i_mtime = inode->i_ctime = CURRENT_TIME;
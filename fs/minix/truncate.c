@@ -96,7 +96,7 @@ repeat:
 			continue;
 		}
 		*ind = 0;
-		ind_bh->b_dirt = 1;
+		mark_buffer_dirty(ind_bh);
 		brelse(bh);
 		minix_free_block(inode->i_sb,tmp);
 	}
@@ -144,7 +144,7 @@ repeat:
 			goto repeat;
 		dind = i+(unsigned short *) dind_bh->b_data;
 		retry |= trunc_indirect(inode,7+512+(i<<9),dind);
-		dind_bh->b_dirt = 1;
+		mark_buffer_dirty(dind_bh);
 	}
 	dind = (unsigned short *) dind_bh->b_data;
 	for (i = 0; i < 512; i++)
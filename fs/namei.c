@@ -16,6 +16,7 @@
 #include <linux/string.h>
 #include <linux/fcntl.h>
 #include <linux/stat.h>
+#include <linux/mm.h>
 
 #define ACC_MODE(x) ("\000\004\002\006"[(x)&O_ACCMODE])
 
@@ -87,9 +88,9 @@ int permission(struct inode * inode,int mask)
 }
 
 /*
- * lookup() looks up one part of a pathname, using the fs-dependent
- * routines (currently minix_lookup) for it. It also checks for
- * fathers (pseudo-roots, mount-points)
+ * lookup() looks up one part of a pathname, using the directory cache
+ * and the fs-dependent routines behind it. It also checks for fathers
+ * (pseudo-roots, mount-points)
  */
 int lookup(struct inode * dir,const char * name, int len,
 	struct inode ** result)
@@ -127,7 +128,7 @@ int lookup(struct inode * dir,const char * name, int len,
 		*result = dir;
 		return 0;
 	}
-	return dir->i_op->lookup(dir,name,len,result);
+	return dcache_lookup(dir,name,len,result);
 }
 
 int follow_link(struct inode * dir, struct inode * inode,
@@ -315,6 +316,7 @@ int open_namei(const char * pathname, int flag, int mode,
 		else {
 			dir->i_count++;		/* create eats the dir */
 			error = dir->i_op->create(dir,basename,namelen,mode,res_inode);
+			dcache_forget(dir->i_dev, dir->i_ino, 1);
 			up(&dir->i_sem);
 			iput(dir);
 			return error;
@@ -369,6 +371,7 @@ int open_namei(const char * pathname, int flag, int mode,
  	}
 	if (flag & O_TRUNC) {
 	      inode->i_size = 0;
+	      invalidate_page_cache(inode, 0);
 	      if (inode->i_op && inode->i_op->truncate)
 	           inode->i_op->truncate(inode);
 	      if ((error = notify_change(NOTIFY_SIZE, inode))) {
@@ -386,6 +389,8 @@ int do_mknod(const char * filename, int mode, dev_t dev)
 	const char * basename;
 	int namelen, error;
 	struct inode * dir;
+	dev_t dir_dev;
+	unsigned long dir_ino;
 
 	mode &= ~current->umask;
 	error = dir_namei(filename,&namelen,&basename, NULL, &dir);
@@ -407,8 +412,11 @@ int do_mknod(const char * filename, int mode, dev_t dev)
 		iput(dir);
 		return -EPERM;
 	}
+	dir_dev = dir->i_dev;
+	dir_ino = dir->i_ino;
 	down(&dir->i_sem);
 	error = dir->i_op->mknod(dir,basename,namelen,mode,dev);
+	dcache_forget(dir_dev, dir_ino, 1);
 	up(&dir->i_sem);
 	return error;
 }
@@ -442,6 +450,8 @@ static int do_mkdir(const char * pathname, int mode)
 	const char * basename;
 	int namelen, error;
 	struct inode * dir;
+	dev_t dir_dev;
+	unsigned long dir_ino;
 
 	error = dir_namei(pathname,&namelen,&basename,NULL,&dir);
 	if (error)
@@ -462,8 +472,11 @@ static int do_mkdir(const char * pathname, int mode)
 		iput(dir);
 		return -EPERM;
 	}
+	dir_dev = dir->i_dev;
+	dir_ino = dir->i_ino;
 	down(&dir->i_sem);
 	error = dir->i_op->mkdir(dir,basename,namelen,mode);
+	dcache_forget(dir_dev, dir_ino, 1);
 	up(&dir->i_sem);
 	return error;
 }
@@ -486,6 +499,8 @@ static int do_rmdir(const char * name)
 	const char * basename;
 	int namelen, error;
 	struct inode * dir;
+	dev_t dir_dev;
+	unsigned long dir_ino;
 
 	error = dir_namei(name,&namelen,&basename,NULL,&dir);
 	if (error)
@@ -506,7 +521,11 @@ static int do_rmdir(const char * name)
 		iput(dir);
 		return -EPERM;
 	}
-	return dir->i_op->rmdir(dir,basename,namelen);
+	dir_dev = dir->i_dev;
+	dir_ino = dir->i_ino;
+	error = dir->i_op->rmdir(dir,basename,namelen);
+	dcache_forget(dir_dev, dir_ino, 0);
+	return error;
 }
 
 asmlinkage int sys_rmdir(const char * pathname)
@@ -527,6 +546,8 @@ static int do_unlink(const char * name)
 	const char * basename;
 	int namelen, error;
 	struct inode * dir;
+	dev_t dir_dev;
+	unsigned long dir_ino;
 
 	error = dir_namei(name,&namelen,&basename,NULL,&dir);
 	if (error)
@@ -547,7 +568,11 @@ static int do_unlink(const char * name)
 		iput(dir);
 		return -EPERM;
 	}
-	return dir->i_op->unlink(dir,basename,namelen);
+	dir_dev = dir->i_dev;
+	dir_ino = dir->i_ino;
+	error = dir->i_op->unlink(dir,basename,namelen);
+	dcache_forget(dir_dev, dir_ino, 0);
+	return error;
 }
 
 asmlinkage int sys_unlink(const char * pathname)
@@ -568,6 +593,8 @@ static int do_symlink(const char * oldname, const char * newname)
 	struct inode * dir;
 	const char * basename;
 	int namelen, error;
+	dev_t dir_dev;
+	unsigned long dir_ino;
 
 	error = dir_namei(newname,&namelen,&basename,NULL,&dir);
 	if (error)
@@ -588,8 +615,11 @@ static int do_symlink(const char * oldname, const char * newname)
 		iput(dir);
 		return -EPERM;
 	}
+	dir_dev = dir->i_dev;
+	dir_ino = dir->i_ino;
 	down(&dir->i_sem);
 	error = dir->i_op->symlink(dir,basename,namelen,oldname);
+	dcache_forget(dir_dev, dir_ino, 1);
 	up(&dir->i_sem);
 	return error;
 }
@@ -616,6 +646,8 @@ static int do_link(struct inode * oldinode, const char * newname)
 	struct inode * dir;
 	const char * basename;
 	int namelen, error;
+	dev_t dir_dev;
+	unsigned long dir_ino;
 
 	error = dir_namei(newname,&namelen,&basename,NULL,&dir);
 	if (error) {
@@ -647,8 +679,11 @@ static int do_link(struct inode * oldinode, const char * newname)
 		iput(oldinode);
 		return -EPERM;
 	}
+	dir_dev = dir->i_dev;
+	dir_ino = dir->i_ino;
 	down(&dir->i_sem);
 	error = dir->i_op->link(oldinode, dir, basename, namelen);
+	dcache_forget(dir_dev, dir_ino, 1);
 	up(&dir->i_sem);
 	return error;
 }
@@ -674,9 +709,11 @@ asmlinkage int sys_link(const char * oldname, const char * newname)
 
 static int do_rename(const char * oldname, const char * newname)
 {
-	struct inode * old_dir, * new_dir;
+	struct inode * old_dir, * new_dir, * inode;
 	const char * old_base, * new_base;
 	int old_len, new_len, error;
+	dev_t dev;
+	unsigned long old_ino, new_ino, moved_ino;
 
 	error = dir_namei(oldname,&old_len,&old_base,NULL,&old_dir);
 	if (error)
@@ -723,10 +760,36 @@ static int do_rename(const char * oldname, const char * newname)
 		iput(new_dir);
 		return -EPERM;
 	}
+	dev = old_dir->i_dev;
+	old_ino = old_dir->i_ino;
+	new_ino = new_dir->i_ino;
+	moved_ino = 0;
+	old_dir->i_count++;
+	if (!lookup(old_dir, old_base, old_len, &inode)) {
+		moved_ino = inode->i_ino;
+		iput(inode);
+	}
+	new_dir->i_count++;
 	down(&new_dir->i_sem);
 	error = old_dir->i_op->rename(old_dir, old_base, old_len, 
 		new_dir, new_base, new_len);
 	up(&new_dir->i_sem);
+	/*
+	 * Forget both directories, and the names cached under the renamed
+	 * object as a directory: on msdos its inode number changes, and the
+	 * new number may have belonged to a directory that was removed.
+	 */
+	dcache_forget(dev, old_ino, 0);
+	dcache_forget(dev, new_ino, 0);
+	if (moved_ino)
+		dcache_forget(dev, moved_ino, 0);
+	if (error)
+		iput(new_dir);
+	else if (!lookup(new_dir, new_base, new_len, &inode)) {
+		if (inode->i_ino != moved_ino)
+			dcache_forget(dev, inode->i_ino, 0);
+		iput(inode);
+	}
 	return error;
 }
 
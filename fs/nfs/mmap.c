@@ -73,13 +73,14 @@ int nfs_mmap(struct inode * inode, struct file * file,
 	mpnt->vm_start = addr;
 	mpnt->vm_end = addr + len;
 	mpnt->vm_page_prot = prot;
+	mpnt->vm_flags = 0;
 	mpnt->vm_share = NULL;
 	mpnt->vm_inode = inode;
 	inode->i_count++;
 	mpnt->vm_offset = off;
 	mpnt->vm_ops = &nfs_file_mmap;
 	insert_vm_struct(current, mpnt);
-	merge_segments(current->mmap, NULL, NULL);
+	merge_segments(current, addr, addr + len, NULL, NULL);
 	return 0;
 }
 
@@ -16,6 +16,7 @@
 #include <linux/signal.h>
 #include <linux/tty.h>
 #include <linux/time.h>
+#include <linux/mm.h>
 
 #include <asm/segment.h>
 
@@ -82,6 +83,7 @@ asmlinkage int sys_truncate(const char * path, unsigned int length)
 		return -EROFS;
 	}
 	inode->i_size = length;
+	invalidate_page_cache(inode, length);
 	if (inode->i_op && inode->i_op->truncate)
 		inode->i_op->truncate(inode);
 	inode->i_ctime = inode->i_mtime = CURRENT_TIME;
@@ -103,6 +105,7 @@ asmlinkage int sys_ftruncate(unsigned int fd, unsigned int length)
 	if (S_ISDIR(inode->i_mode) || !(file->f_mode & 2))
 		return -EACCES;
 	inode->i_size = length;
+	invalidate_page_cache(inode, length);
 	if (inode->i_op && inode->i_op->truncate)
 		inode->i_op->truncate(inode);
 	inode->i_ctime = inode->i_mtime = CURRENT_TIME;
@@ -27,6 +27,8 @@
 #ifdef CONFIG_DEBUG_MALLOC
 int get_malloc(char * buffer);
 #endif
+int get_slabinfo(char * buffer);
+int get_vmallocinfo(char * buffer);
 
 static int read_core(struct inode * inode, struct file * file,char * buf, int count)
 {
@@ -86,14 +88,23 @@ static int get_loadavg(char * buffer)
 		LOAD_INT(c), LOAD_FRAC(c));
 }
 
+extern int get_blk_stat(char *);
+extern int get_swap_stat(char *);
+
 static int get_kstat(char * buffer)
 {
-        return sprintf(buffer,	"cpu  %u %u %u %lu\n"
+	int len;
+
+        len = sprintf(buffer,	"cpu  %u %u %u %lu\n"
         			"disk %u %u %u %u\n"
         			"page %u %u\n"
-        			"swap %u %u\n"
+        			"swap %u %u %u %u\n"
         			"intr %u\n"
         			"ctxt %u\n"
+        			"timer %u %u\n"
+        			"buffer %u %u %u\n"
+        			"dcache %u %u\n"
+        			"readahead %u %u %u\n"
         			"btime %lu\n",
                 kstat.cpu_user,
                 kstat.cpu_nice,
@@ -107,9 +118,23 @@ static int get_kstat(char * buffer)
                 kstat.pgpgout,
                 kstat.pswpin,
                 kstat.pswpout,
+                kstat.swap_ra_hits,
+                kstat.swap_ra_misses,
                 kstat.interrupts,
                 kstat.context_swtch,
+                kstat.timers,
+                kstat.timer_cascades,
+                kstat.buffer_lookups,
+                kstat.buffer_hits,
+                kstat.buffer_scans,
+                kstat.dcache_hits,
+                kstat.dcache_misses,
+                kstat.ra_blocks,
+                kstat.ra_hits,
+                kstat.ra_wasted,
                 xtime.tv_sec - jiffies / HZ);
+	len += get_blk_stat(buffer + len);
+	return len + get_swap_stat(buffer + len);
 }
 
 
@@ -256,12 +281,17 @@ static int get_stat(int pid, char * buffer)
 {
 	struct task_struct ** p = get_task(pid);
 	unsigned long sigignore=0, sigcatch=0, bit=1, wchan;
-	unsigned long vsize, eip, esp;
+	unsigned long vsize, eip, esp, it_real_value;
 	int i,tty_pgrp;
 	char state;
 
 	if (!p || !*p)
 		return 0;
+	it_real_value = 0;
+	if (del_timer(&(*p)->real_timer)) {
+		it_real_value = (*p)->real_timer.expires;
+		add_timer(&(*p)->real_timer);
+	}
 	if ((*p)->state < 0 || (*p)->state > 5)
 		state = '.';
 	else
@@ -313,7 +343,7 @@ static int get_stat(int pid, char * buffer)
 		(*p)->priority, /* this is the nice value ---
 				   subtract 15 in your user-level program. */
 		(*p)->timeout,
-		(*p)->it_real_value,
+		it_real_value,
 		(*p)->start_time,
 		vsize,
 		(*p)->rss, /* you might want to shift this left 3 */
@@ -499,6 +529,12 @@ static int array_read(struct inode * inode, struct file * file,char * buf, int c
 		case 17:
 			length = get_kstat(page);
 			break;
+		case 18:
+			length = get_slabinfo(page);
+			break;
+		case 19:
+			length = get_vmallocinfo(page);
+			break;
 		default:
 			free_page((unsigned long) page);
 			return -EBADF;
@@ -9,6 +9,7 @@
 #include <linux/stat.h>
 #include <linux/kernel.h>
 #include <linux/sched.h>
+#include <linux/mm.h>
 
 #include <asm/segment.h>
 
@@ -104,5 +105,8 @@ asmlinkage int sys_write(unsigned int fd,char * buf,unsigned int count)
 	error = verify_area(VERIFY_READ,buf,count);
 	if (error)
 		return error;
-	return file->f_op->write(inode,file,buf,count);
+	error = file->f_op->write(inode,file,buf,count);
+	if (error > 0 && inode->i_pages)
+		update_page_cache(inode,file->f_pos-error,buf,error);
+	return error;
 }
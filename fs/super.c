@@ -232,6 +232,7 @@ static int do_umount(dev_t dev)
 	if (sb->s_op && sb->s_op->write_super && sb->s_dirt)
 		sb->s_op->write_super(sb);
 	put_super(dev);
+	dcache_invalidate(dev);
 	return 0;
 }
 
@@ -390,15 +391,9 @@ static int copy_mount_options (const void * data, unsigned long *where)
 	if (!data)
 		return 0;
 
-	for (vma = current->mmap ; ; ) {
-		if (!vma ||
-		    (unsigned long) data < vma->vm_start) {
-			return -EFAULT;
-		}
-		if ((unsigned long) data < vma->vm_end)
-			break;
-		vma = vma->vm_next;
-	}
+	vma = find_vma(current, (unsigned long) data);
+	if (!vma || (unsigned long) data < vma->vm_start)
+		return -EFAULT;
 	i = vma->vm_end - (unsigned long) data;
 	if (PAGE_SIZE <= (unsigned long) i)
 		i = PAGE_SIZE-1;
@@ -18,14 +18,9 @@
 #include <linux/kernel.h>
 #include <linux/string.h>
 
-#include "xiafs_mac.h"
-
+#include <asm/bitops.h>
 
-#define clear_bit(nr,addr) ({\
-char res; \
-__asm__ __volatile__("btrl %1,%2\n\tsetnb %0": \
-"=q" (res):"r" (nr),"m" (*(addr))); \
-res;})
+#include "xiafs_mac.h"
 
 char internal_error_message[]="XIA-FS: internal error %s %d\n"; 
 
@@ -37,36 +32,18 @@ static int find_first_zero(struct buffer_head *bh, int start_bit, int end_bit)
      * "goto repeat".  ---Frank.
      */
 
-    int end, i, j, tmp;
-    u_long *bmap;
-    char res;
-
-    bmap=(u_long *)bh->b_data;
-    end = end_bit >> 5;
+    int j;
 
 repeat:
-    i=start_bit >> 5;
-    if ( (tmp=(~bmap[i]) & (0xffffffff << (start_bit & 31))) )        
-        goto zone_found;
-    while (++i < end)
-        if (~bmap[i]) {
-	    tmp=~bmap[i];
-	    goto zone_found;
-	}
-    if ( !(tmp=~bmap[i] & ((1 << (end_bit & 31)) -1)) )
+    j=find_next_zero_bit(bh->b_data, end_bit, start_bit);
+    if (j >= end_bit)
         return -1;
-zone_found:    
-    for (j=0; j < 32; j++)
-        if (tmp & (1 << j))
-	    break;
-    __asm__ ("btsl %1,%2\n\tsetb %0": \
-	     "=q" (res):"r" (j),"m" (bmap[i]));
-    if (res) {
-        start_bit=j + (i << 5) + 1;
+    if (set_bit(j, bh->b_data)) {
+        start_bit=j + 1;
 	goto repeat;
     }
-    bh->b_dirt=1;
-    return j + (i << 5);
+    mark_buffer_dirty(bh);
+    return j;
 }
 
 static void clear_buf(struct buffer_head * bh) 
@@ -241,11 +218,11 @@ void xiafs_free_zone(struct super_block * sb, int d_addr)
     if (!bh)
 	return;
     offset = bit & (XIAFS_BITS_PER_Z(sb) -1);
-    if (clear_bit(offset, bh->b_data))
+    if (!clear_bit(offset, bh->b_data))
         printk("XIA-FS: dev %04x"
 	       " block bit %u (0x%x) already cleared (%s %d)\n",
 	       sb->s_dev, bit, bit, WHERE_ERR);
-    bh->b_dirt = 1;
+    mark_buffer_dirty(bh);
     xiafs_unlock_super(sb, sb->u.xiafs_sb.s_zmap_cached);
 }
 
@@ -277,7 +254,7 @@ int xiafs_new_zone(struct super_block * sb, u_long prev_addr)
     }
     clear_buf(bh);
     bh->b_uptodate = 1;
-    bh->b_dirt = 1;
+    mark_buffer_dirty(bh);
     brelse(bh);
     return tmp;
 }
@@ -301,11 +278,11 @@ void xiafs_free_inode(struct inode * inode)
     if (!bh)
 	return;
     clear_inode(inode);
-    if (clear_bit(ino & (XIAFS_BITS_PER_Z(sb)-1), bh->b_data))
+    if (!clear_bit(ino & (XIAFS_BITS_PER_Z(sb)-1), bh->b_data))
         printk("XIA-FS: dev %04x"
 	       "inode bit %ld (0x%lx) already cleared (%s %d)\n",
 	       inode->i_dev, ino, ino, WHERE_ERR);
-    bh->b_dirt = 1;
+    mark_buffer_dirty(bh);
     xiafs_unlock_super(sb, sb->u.xiafs_sb.s_imap_cached);
 }
 
@@ -341,19 +318,9 @@ struct inode * xiafs_new_inode(struct inode * dir)
     return inode;
 }
 
-static int nibblemap[] = { 0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4 };
-
 static u_long count_zone(struct buffer_head * bh)
 {
-    int i, tmp;
-    u_long sum;
-
-    sum=0;
-    for (i=bh->b_size; i-- > 0; ) {
-        tmp=bh->b_data[i];
-        sum += nibblemap[tmp & 0xf] + nibblemap[(tmp & 0xff) >> 4];
-    }
-    return sum;
+    return (bh->b_size << 3) - count_zero_bits(bh->b_data, bh->b_size << 3);
 } 
 
 unsigned long xiafs_count_free_inodes(struct super_block *sb)
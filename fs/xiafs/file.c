@@ -240,7 +240,7 @@ xiafs_file_write(struct inode * inode, struct file * filp, char * buf, int count
 	memcpy_fromfs(cp,buf,c);
 	buf += c;
 	bh->b_uptodate = 1;
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	brelse(bh);
     }
     inode->i_mtime = inode->i_ctime = CURRENT_TIME;
@@ -39,6 +39,16 @@ extern __inline__ int clear_bit(int nr, void * addr)
 	return oldbit;
 }
 
+extern __inline__ int change_bit(int nr, void * addr)
+{
+	int oldbit;
+
+	__asm__ __volatile__("btcl %2,%1\n\tsbbl %0,%0"
+		:"=r" (oldbit),"=m" (ADDR)
+		:"r" (nr));
+	return oldbit;
+}
+
 /*
  * This routine doesn't need to be atomic, but it's faster to code it
  * this way.
@@ -53,6 +63,86 @@ extern __inline__ int test_bit(int nr, void * addr)
 	return oldbit;
 }
 
+/*
+ * Find-bit routines, shared by the filesystem allocators.  They scan a
+ * long at a time, and return a bit number >= size if there is no zero
+ * bit (the search may look at the rest of the last long).
+ */
+extern __inline__ int find_first_zero_bit(void * addr, unsigned size)
+{
+	int res;
+
+	if (!size)
+		return 0;
+	__asm__("cld\n\t"
+		"movl $-1,%%eax\n\t"
+		"repe; scasl\n\t"
+		"je 1f\n\t"
+		"subl $4,%%edi\n\t"
+		"movl (%%edi),%%eax\n\t"
+		"notl %%eax\n\t"
+		"bsfl %%eax,%%edx\n\t"
+		"jmp 2f\n"
+		"1:\txorl %%edx,%%edx\n"
+		"2:\tsubl %%ebx,%%edi\n\t"
+		"shll $3,%%edi\n\t"
+		"addl %%edi,%%edx"
+		:"=d" (res)
+		:"c" ((size + 31) >> 5), "D" (addr), "b" (addr)
+		:"ax", "bx", "cx", "di");
+	return res;
+}
+
+extern __inline__ int find_next_zero_bit(void * addr, int size, int offset)
+{
+	unsigned long * p = ((unsigned long *) addr) + (offset >> 5);
+	int set = 0, bit = offset & 31, res;
+
+	if (offset >= size)
+		return size;
+	if (bit) {
+		/*
+		 * Look for a zero in the first long
+		 */
+		__asm__("bsfl %1,%0\n\t"
+			"jne 1f\n\t"
+			"movl $32,%0\n"
+			"1:"
+			:"=r" (set)
+			:"r" (~(*p >> bit)));
+		if (set < (32 - bit))
+			return set + offset;
+		set = 32 - bit;
+		p++;
+	}
+	/*
+	 * No zero yet, search the remaining longs
+	 */
+	res = find_first_zero_bit(p, size - 32 * (p - (unsigned long *) addr));
+	return (offset + set + res);
+}
+
+/*
+ * Find a byte with all eight bits clear: returns addr+size if none.
+ */
+extern __inline__ char * find_first_zero_byte(void * addr, int size)
+{
+	char * res;
+
+	if (!size)
+		return (char *) addr;
+	__asm__("cld\n\t"
+		"movl $0,%%eax\n\t"
+		"repnz; scasb\n\t"
+		"jnz 1f\n\t"
+		"decl %%edi\n"
+		"1:"
+		:"=D" (res)
+		:"0" (addr), "c" (size)
+		:"ax", "cx");
+	return res;
+}
+
 #else
 /*
  * For the benefit of those who are trying to port Linux to another
@@ -95,6 +185,19 @@ extern __inline__ int clear_bit(int nr, int * addr)
 	return retval;
 }
 
+extern __inline__ int change_bit(int nr, int * addr)
+{
+	int	mask, retval;
+
+	addr += nr >> 5;
+	mask = 1 << (nr & 0x1f);
+	cli();
+	retval = (mask & *addr) != 0;
+	*addr ^= mask;
+	sti();
+	return retval;
+}
+
 extern __inline__ int test_bit(int nr, int * addr)
 {
 	int	mask;
@@ -103,5 +206,72 @@ extern __inline__ int test_bit(int nr, int * addr)
 	mask = 1 << (nr & 0x1f);
 	return ((mask & *addr) != 0);
 }
+
+extern __inline__ int find_next_zero_bit(void * addr, int size, int offset)
+{
+	unsigned long * p = ((unsigned long *) addr) + (offset >> 5);
+	unsigned long w;
+
+	if (offset >= size)
+		return size;
+	w = *p++ | ((1UL << (offset & 31)) - 1);
+	offset &= ~31;
+	while (w == ~0UL) {
+		offset += 32;
+		if (offset >= size)
+			return size;
+		w = *p++;
+	}
+	while (w & 1) {
+		w >>= 1;
+		offset++;
+	}
+	return offset;
+}
+
+extern __inline__ int find_first_zero_bit(void * addr, unsigned size)
+{
+	return find_next_zero_bit(addr, size, 0);
+}
+
+extern __inline__ char * find_first_zero_byte(void * addr, int size)
+{
+	char * p = (char *) addr;
+
+	while (size-- > 0 && *p)
+		p++;
+	return p;
+}
 #endif	/* i386 */
+
+/*
+ * Number of bits set in a long, and of bits clear in the first "nbits"
+ * of a bitmap.  Counting a long at a time with shifts and adds is much
+ * quicker than looking bytes up in a table, and free space bitmaps are
+ * mostly all ones or all zeros, which is quicker still.
+ */
+extern __inline__ unsigned long hweight32(unsigned long w)
+{
+	w = w - ((w >> 1) & 0x55555555);
+	w = (w & 0x33333333) + ((w >> 2) & 0x33333333);
+	w = (w + (w >> 4)) & 0x0f0f0f0f;
+	return (w * 0x01010101) >> 24;
+}
+
+extern __inline__ unsigned long count_zero_bits(void * addr, unsigned long nbits)
+{
+	unsigned long * p = (unsigned long *) addr;
+	unsigned long sum = 0, w;
+
+	for ( ; nbits >= 32 ; nbits -= 32) {
+		w = *p++;
+		if (!w)
+			sum += 32;
+		else if (w != ~0UL)
+			sum += 32 - hweight32(w);
+	}
+	if (nbits)
+		sum += nbits - hweight32(*p & ((1UL << nbits) - 1));
+	return sum;
+}
 #endif /* _ASM_BITOPS_H */
@@ -48,6 +48,7 @@
  * Define EXT2_PREALLOCATE to preallocate data blocks for expanding files
  */
 #define EXT2_PREALLOCATE
+#define EXT2_MAX_PREALLOC	64	/* Most blocks reserved ahead of a write */
 
 /*
  * The second extended file system version
@@ -199,12 +200,14 @@ struct ext2_group_desc
 #define	EXT2_UNRM_FL			0x0002	/* Undelete */
 #define	EXT2_COMPR_FL			0x0004	/* Compress file */
 #define EXT2_SYNC_FL			0x0008	/* Synchronous updates */
+#define EXT2_INDEX_FL			0x1000	/* Hash-indexed directory */
 
 /*
  * ioctl commands
  */
 #define	EXT2_IOC_GETFLAGS		_IOR('f', 1, long)
 #define	EXT2_IOC_SETFLAGS		_IOW('f', 2, long)
+#define	EXT2_IOC_GETEXTENTS		_IOR('f', 3, long)
 #define	EXT2_IOC_GETVERSION		_IOR('v', 1, long)
 #define	EXT2_IOC_SETVERSION		_IOW('v', 2, long)
 
@@ -253,6 +256,7 @@ struct ext2_inode {
 #define EXT2_MOUNT_ERRORS_CONT		0x0010	/* Continue on errors */
 #define EXT2_MOUNT_ERRORS_RO		0x0020	/* Remount fs ro on errors */
 #define EXT2_MOUNT_ERRORS_PANIC		0x0040	/* Panic on errors */
+#define EXT2_MOUNT_INDEX		0x0080	/* Index growing directories */
 
 #define clear_opt(o, opt)		o &= ~EXT2_MOUNT_##opt
 #define set_opt(o, opt)			o |= EXT2_MOUNT_##opt
@@ -322,6 +326,38 @@ struct ext2_dir_entry {
 #define EXT2_DIR_REC_LEN(name_len)	(((name_len) + 8 + EXT2_DIR_ROUND) & \
 					 ~EXT2_DIR_ROUND)
 
+/*
+ * Structure of the hashed directory index (see fs/ext2/index.c)
+ *
+ * The root block starts with "." and "..", and the ext2_dx_root_info
+ * follows the name of "..".  Index nodes start with an empty directory
+ * entry covering the whole block.  In both, an array of ext2_dx_entry
+ * comes next: the hash of its first element holds the ext2_dx_countlimit.
+ */
+struct ext2_dx_root_info {
+	unsigned long  reserved_zero;
+	unsigned char  hash_version;		/* Hash function */
+	unsigned char  info_length;		/* 8 */
+	unsigned char  indirect_levels;		/* Levels of index nodes */
+	unsigned char  unused_flags;
+};
+
+struct ext2_dx_entry {
+	unsigned long  hash;
+	unsigned long  block;			/* Directory block number */
+};
+
+struct ext2_dx_countlimit {
+	unsigned short limit;			/* Room in the array */
+	unsigned short count;			/* Entries in use */
+};
+
+#define EXT2_DX_HASH_LEGACY		0
+#define EXT2_DX_ROOT_INFO		24	/* Offsets in the root block */
+#define EXT2_DX_ROOT_ENTRIES		32
+#define EXT2_DX_NODE_ENTRIES		8	/* Offset in an index node */
+#define EXT2_DX_MAX_LEVELS		2
+
 #ifdef __KERNEL__
 /*
  * Function prototypes
@@ -346,7 +382,7 @@ extern int ext2_permission (struct inode *, int);
 
 /* balloc.c */
 extern int ext2_new_block (struct super_block *, unsigned long,
-			   unsigned long *, unsigned long *);
+			   unsigned long, unsigned long *, unsigned long *);
 extern void ext2_free_blocks (struct super_block *, unsigned long,
 			      unsigned long);
 extern unsigned long ext2_count_free_blocks (struct super_block *);
@@ -378,6 +414,17 @@ extern int ext2_write (struct inode *, struct file *, char *, int);
 /* fsync.c */
 extern int ext2_sync_file (struct inode *, struct file *);
 
+/* index.c */
+#define EXT2_DX_BAD	(-75000)	/* index unusable: search linearly */
+
+extern struct buffer_head * ext2_dx_find_entry (struct inode *, const char *,
+						int, struct ext2_dir_entry **,
+						int *);
+extern struct buffer_head * ext2_dx_add_entry (struct inode *, const char *,
+					       int, struct ext2_dir_entry **,
+					       int *);
+extern int ext2_dx_make_indexed (struct inode *, struct buffer_head *);
+
 /* ialloc.c */
 extern struct inode * ext2_new_inode (const struct inode *, int);
 extern void ext2_free_inode (struct inode *);
@@ -16,7 +16,8 @@
 #define _LINUX_EXT2_FS_SB
 
 #define EXT2_MAX_GROUP_DESC	8
-#define EXT2_MAX_GROUP_LOADED	8
+#define EXT2_MIN_GROUP_LOADED	8
+#define EXT2_MAX_GROUP_LOADED	64
 
 /*
  * second extended-fs super-block data in memory
@@ -36,10 +37,12 @@ struct ext2_sb_info {
 	struct buffer_head * s_group_desc[EXT2_MAX_GROUP_DESC];
 	unsigned short s_loaded_inode_bitmaps;
 	unsigned short s_loaded_block_bitmaps;
-	unsigned long s_inode_bitmap_number[EXT2_MAX_GROUP_LOADED];
-	struct buffer_head * s_inode_bitmap[EXT2_MAX_GROUP_LOADED];
-	unsigned long s_block_bitmap_number[EXT2_MAX_GROUP_LOADED];
-	struct buffer_head * s_block_bitmap[EXT2_MAX_GROUP_LOADED];
+	unsigned short s_max_loaded_bitmaps;	/* Size of the bitmap caches */
+	unsigned long * s_inode_bitmap_number;
+	struct buffer_head ** s_inode_bitmap;
+	unsigned long * s_block_bitmap_number;
+	struct buffer_head ** s_block_bitmap;
+	unsigned short * s_max_free_run;/* Longest free run in each group, at most */
 	int s_rename_lock;
 	struct wait_queue * s_rename_wait;
 	unsigned long  s_mount_opt;
@@ -28,7 +28,6 @@
 #define NR_INODE 2048	/* this should be bigger than NR_FILE */
 #define NR_FILE 1024	/* this can well be larger on a larger system */
 #define NR_SUPER 32
-#define NR_HASH 997
 #define NR_IHASH 131
 #define NR_FILE_LOCKS 64
 #define BLOCK_SIZE 1024
@@ -44,6 +43,7 @@
 #define WRITEA 3	/* "write-ahead" - silly, but somewhat useful */
 
 extern void buffer_init(void);
+extern void dcache_init(void);
 extern unsigned long inode_init(unsigned long start, unsigned long end);
 extern unsigned long file_table_init(unsigned long start, unsigned long end);
 
@@ -103,6 +103,8 @@ extern unsigned long file_table_init(unsigned long start, unsigned long end);
 #define BLKRRPART 4703 /* re-read partition table */
 #define BLKGETSIZE 4704 /* return device size */
 #define BLKFLSBUF 4705 /* flush buffer cache */
+#define BLKRASET 4706 /* set maximum read-ahead (in sectors) */
+#define BLKRAGET 4707 /* get maximum read-ahead */
 
 /* These are a few other constants  only used by scsi  devices */
 
@@ -137,6 +139,9 @@ struct buffer_head {
 	unsigned char b_dirt;		/* 0-clean,1-dirty */
 	unsigned char b_lock;		/* 0 - ok, 1 -locked */
 	unsigned char b_req;		/* 0 if the buffer has been invalidated */
+	unsigned char b_list;		/* which LRU list it is on */
+	unsigned char b_reada;		/* read ahead, not yet used */
+	unsigned long b_flushtime;	/* when a dirty buffer should be written */
 	struct wait_queue * b_wait;
 	struct buffer_head * b_prev;		/* doubly linked list of hash-queue */
 	struct buffer_head * b_next;
@@ -146,6 +151,14 @@ struct buffer_head {
 	struct buffer_head * b_reqnext;		/* request queue */
 };
 
+/*
+ * The buffer LRU lists, see fs/buffer.c
+ */
+#define BUF_CLEAN	0
+#define BUF_LOCKED	1	/* buffers scheduled for write */
+#define BUF_DIRTY	2
+#define NR_LIST		3
+
 #include <linux/pipe_fs_i.h>
 #include <linux/minix_fs_i.h>
 #include <linux/ext_fs_i.h>
@@ -177,6 +190,7 @@ struct inode {
 	struct wait_queue * i_wait;
 	struct file_lock * i_flock;
 	struct vm_area_struct * i_mmap;
+	struct page_cache * i_pages;
 	struct inode * i_next, * i_prev;
 	struct inode * i_hash_next, * i_hash_prev;
 	struct inode * i_bound_to, * i_bound_by;
@@ -210,6 +224,9 @@ struct file {
 	unsigned short f_flags;
 	unsigned short f_count;
 	unsigned short f_reada;
+	unsigned short f_rawin;		/* read-ahead window, in sectors */
+	off_t f_ranext;			/* where a sequential read starts */
+	unsigned long f_raend;		/* read ahead up to this block */
 	struct file *f_next, *f_prev;
 	struct inode * f_inode;
 	struct file_operations * f_op;
@@ -373,6 +390,10 @@ extern int permission(struct inode * inode,int mask);
 extern int open_namei(const char * pathname, int flag, int mode,
 	struct inode ** res_inode, struct inode * base);
 extern int do_mknod(const char * filename, int mode, dev_t dev);
+extern int dcache_lookup(struct inode * dir, const char * name, int len,
+	struct inode ** result);
+extern void dcache_forget(dev_t dev, unsigned long dir, int negative_only);
+extern void dcache_invalidate(dev_t dev);
 extern void iput(struct inode * inode);
 extern struct inode * __iget(struct super_block * sb,int nr,int crsmnt);
 extern struct inode * iget(struct super_block * sb,int nr);
@@ -385,21 +406,40 @@ extern struct buffer_head * get_hash_table(dev_t dev, int block, int size);
 extern struct buffer_head * getblk(dev_t dev, int block, int size);
 extern void ll_rw_block(int rw, int nr, struct buffer_head * bh[]);
 extern void ll_rw_page(int rw, int dev, int nr, char * buffer);
+extern void unplug_devices(void);
 extern void ll_rw_swap_file(int rw, int dev, unsigned int *b, int nb, char *buffer);
+extern void ll_rw_swap_batch(int rw, int nr, struct buffer_head * bh[]);
 extern void brelse(struct buffer_head * buf);
+extern void refile_buffer(struct buffer_head * buf);
 extern void set_blocksize(dev_t dev, int size);
 extern struct buffer_head * bread(dev_t dev, int block, int size);
 extern unsigned long bread_page(unsigned long addr,dev_t dev,int b[],int size,int prot);
 extern struct buffer_head * breada(dev_t dev,int block,...);
+extern int file_readahead(struct file * filp, dev_t dev, off_t pos, int count);
+extern void read_ahead_buffers(struct buffer_head * bh[], int nr);
 extern void put_super(dev_t dev);
 extern dev_t ROOT_DEV;
 
 extern void show_buffers(void);
+
+/*
+ * Use this rather than setting b_dirt by hand, so that the buffer ends
+ * up on the dirty list where sync() will find it.
+ */
+extern inline void mark_buffer_dirty(struct buffer_head * bh)
+{
+	if (!bh->b_dirt) {
+		bh->b_dirt = 1;
+		refile_buffer(bh);
+	}
+}
+
 extern void mount_root(void);
 
 extern int char_read(struct inode *, struct file *, char *, int);
 extern int block_read(struct inode *, struct file *, char *, int);
 extern int read_ahead[];
+extern int max_readahead[];
 
 extern int char_write(struct inode *, struct file *, char *, int);
 extern int block_write(struct inode *, struct file *, char *, int);
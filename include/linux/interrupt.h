@@ -19,7 +19,8 @@ enum {
 	SERIAL_BH,
 	TTY_BH,
 	INET_BH,
-	KEYBOARD_BH
+	KEYBOARD_BH,
+	BLKDEV_BH
 };
 
 extern inline void mark_bh(int nr)
@@ -14,11 +14,16 @@ struct kernel_stat {
 	unsigned int dk_drive[DK_NDRIVE];
 	unsigned int pgpgin, pgpgout;
 	unsigned int pswpin, pswpout;
+	unsigned int swap_ra_hits, swap_ra_misses;
 	unsigned int interrupts;
 	unsigned int ipackets, opackets;
 	unsigned int ierrors, oerrors;
 	unsigned int collisions;
 	unsigned int context_swtch;
+	unsigned int timers, timer_cascades;
+	unsigned int buffer_lookups, buffer_hits, buffer_scans;
+	unsigned int dcache_hits, dcache_misses;
+	unsigned int ra_blocks, ra_hits, ra_wasted;
 };
 
 extern struct kernel_stat kstat;
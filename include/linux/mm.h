@@ -42,13 +42,24 @@ struct vm_area_struct {
 	unsigned long vm_start;
 	unsigned long vm_end;
 	unsigned short vm_page_prot;
+	unsigned short vm_flags;
 	struct vm_area_struct * vm_next;	/* linked list */
+	short vm_avl_height;			/* AVL tree of the task's areas */
+	struct vm_area_struct * vm_avl_left;
+	struct vm_area_struct * vm_avl_right;
 	struct vm_area_struct * vm_share;	/* linked list */
 	struct inode * vm_inode;
 	unsigned long vm_offset;
 	struct vm_operations_struct * vm_ops;
 };
 
+/*
+ * vm_flags: VM_SHARED areas were mapped shared and writable, so writes
+ * go to the pages themselves rather than to copies even after mprotect()
+ * has taken write access away and given it back.
+ */
+#define VM_SHARED	0x0001
+
 /*
  * These are the virtual MM functions - opening of an area, closing it (needed to
  * keep files on disk up-to-date etc), pointer to the functions called when a
@@ -77,22 +88,38 @@ extern volatile short free_page_ptr; /* used by malloc and tcp/ip. */
 
 extern int nr_swap_pages;
 extern int nr_free_pages;
-extern unsigned long free_page_list;
-extern int nr_secondary_pages;
-extern unsigned long secondary_page_list;
 
-#define MAX_SECONDARY_PAGES 20
+#define MAX_SECONDARY_PAGES 20	/* free pages kept for GFP_ATOMIC */
+
+/*
+ * Free memory is managed by a buddy allocator in blocks of up to
+ * 2^(NR_MEM_LISTS-1) pages.
+ */
+#define NR_MEM_LISTS 6
+
+extern unsigned long __get_free_pages(int priority, unsigned long order);
+extern void free_pages(unsigned long addr, unsigned long order);
+extern unsigned long free_area_init(unsigned long start_mem, unsigned long end_mem);
+extern void show_free_areas(void);
+
+#define __get_free_page(priority) __get_free_pages((priority),0)
+#define free_page(addr) free_pages((addr),0)
+
+extern unsigned long take_zeroed_page(void);
 
 /*
  * This is timing-critical - most of the time in getting a new page
- * goes to clearing the page. If you want a page without the clearing
- * overhead, just use __get_free_page() directly..
+ * goes to clearing the page, so the idle task keeps a few cleared in
+ * advance. If you want a page without the clearing overhead, just use
+ * __get_free_page() directly..
  */
-extern unsigned long __get_free_page(int priority);
 extern inline unsigned long get_free_page(int priority)
 {
 	unsigned long page;
 
+	page = take_zeroed_page();
+	if (page)
+		return page;
 	page = __get_free_page(priority);
 	if (page)
 		__asm__ __volatile__("rep ; stosl"
@@ -104,13 +131,13 @@ extern inline unsigned long get_free_page(int priority)
 
 /* memory.c */
 
-extern void free_page(unsigned long addr);
 extern unsigned long put_dirty_page(struct task_struct * tsk,unsigned long page,
 	unsigned long address);
 extern void free_page_tables(struct task_struct * tsk);
 extern void clear_page_tables(struct task_struct * tsk);
 extern int copy_page_tables(struct task_struct * to);
 extern int clone_page_tables(struct task_struct * to);
+extern int unshare_page_table(unsigned long * page_dir);
 extern int unmap_page_range(unsigned long from, unsigned long size);
 extern int remap_page_range(unsigned long from, unsigned long to, unsigned long size, int mask);
 extern int zeromap_page_range(unsigned long from, unsigned long size, int mask);
@@ -146,12 +173,27 @@ extern int do_mmap(struct file * file, unsigned long addr, unsigned long len,
 	unsigned long prot, unsigned long flags, unsigned long off);
 typedef int (*map_mergep_fnp)(const struct vm_area_struct *,
 			      const struct vm_area_struct *, void *);
-extern void merge_segments(struct vm_area_struct *, map_mergep_fnp, void *);
+extern void merge_segments(struct task_struct *, unsigned long, unsigned long,
+	map_mergep_fnp, void *);
 extern void insert_vm_struct(struct task_struct *, struct vm_area_struct *);
+extern struct vm_area_struct * find_vma(struct task_struct *, unsigned long);
+extern struct vm_area_struct * find_vma_prev(struct task_struct *, unsigned long,
+	struct vm_area_struct **);
+extern void build_mmap_avl(struct task_struct *);
 extern int ignoff_mergep(const struct vm_area_struct *,
 			 const struct vm_area_struct *, void *);
 extern int do_munmap(unsigned long, size_t);
 
+/* filemap.c */
+extern unsigned long page_cache_size;
+extern void page_cache_init(void);
+extern unsigned long find_page_cache(struct inode * inode, unsigned long offset);
+extern void add_page_cache(struct inode * inode, unsigned long offset, unsigned long page);
+extern int read_page_cache(struct inode * inode, unsigned long pos, char * buf, int count);
+extern void update_page_cache(struct inode * inode, unsigned long pos, char * buf, int count);
+extern void invalidate_page_cache(struct inode * inode, unsigned long start);
+extern int shrink_page_cache(int priority);
+
 #define read_swap_page(nr,buf) \
 	rw_swap_page(READ,(nr),(buf))
 #define write_swap_page(nr,buf) \
@@ -180,6 +222,7 @@ extern unsigned short * mem_map;
 #define PAGE_SHARED	(PAGE_PRESENT | PAGE_RW | PAGE_USER | PAGE_ACCESSED)
 #define PAGE_COPY	(PAGE_PRESENT | PAGE_USER | PAGE_ACCESSED | PAGE_COW)
 #define PAGE_READONLY	(PAGE_PRESENT | PAGE_USER | PAGE_ACCESSED)
+#define PAGE_NONE	(PAGE_PRESENT | PAGE_ACCESSED)	/* for the kernel only */
 #define PAGE_TABLE	(PAGE_PRESENT | PAGE_RW | PAGE_USER | PAGE_ACCESSED)
 
 #define GFP_BUFFER	0x00
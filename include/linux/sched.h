@@ -81,6 +81,7 @@ extern unsigned long avenrun[];		/* Load averages */
 #include <linux/resource.h>
 #include <linux/vm86.h>
 #include <linux/math_emu.h>
+#include <linux/timer.h>
 
 #define TASK_RUNNING		0
 #define TASK_INTERRUPTIBLE	1
@@ -202,7 +203,7 @@ struct task_struct {
 	unsigned short uid,euid,suid;
 	unsigned short gid,egid,sgid;
 	unsigned long timeout;
-	unsigned long it_real_value, it_prof_value, it_virt_value;
+	unsigned long it_prof_value, it_virt_value;
 	unsigned long it_real_incr, it_prof_incr, it_virt_incr;
 	long utime,stime,cutime,cstime,start_time;
 	unsigned long min_flt, maj_flt;
@@ -220,7 +221,8 @@ struct task_struct {
 	struct inode * pwd;
 	struct inode * root;
 	struct inode * executable;
-	struct vm_area_struct * mmap;
+	struct vm_area_struct * mmap;		/* sorted list of areas */
+	struct vm_area_struct * mmap_avl;	/* the same, as an AVL tree */
 	struct shm_desc *shm;
 	struct sem_undo *semun;
 	struct file * filp[NR_OPEN];
@@ -230,13 +232,16 @@ struct task_struct {
 /* tss for this task */
 	struct tss_struct tss;
 #ifdef NEW_SWAP
-	unsigned long old_maj_flt;	/* old value of maj_flt */
-	unsigned long dec_flt;		/* page fault count of the last time */
-	unsigned long swap_cnt;		/* number of pages to swap on next pass */
-	short swap_table;		/* current page table */
-	short swap_page;		/* current page */
+	short swap_table;		/* where page aging got to */
+	short swap_page;
 #endif NEW_SWAP
 	struct vm_area_struct *stk_vma;
+/* run-queue linkage, see kernel/sched.c */
+	struct task_struct *next_run, *prev_run;
+	struct run_queue *run_queue;	/* NULL if not queued */
+	short run_level;
+	unsigned long sched_epoch;	/* last counter recalculation seen */
+	struct timer_list real_timer;	/* ITIMER_REAL */
 };
 
 /*
@@ -246,6 +251,7 @@ struct task_struct {
 					/* Not implemented yet, only for 486*/
 #define PF_PTRACED	0x00000010	/* set if ptrace (0) has been called. */
 #define PF_TRACESYS	0x00000020	/* tracing system calls */
+#define PF_VFORK	0x00000040	/* parent waits until we exec or exit */
 
 /*
  * cloning flags:
@@ -253,6 +259,7 @@ struct task_struct {
 #define CSIGNAL		0x000000ff	/* signal mask to be sent at exit */
 #define COPYVM		0x00000100	/* set if VM copy desired (like normal fork()) */
 #define COPYFD		0x00000200	/* set if fd's should be copied, not shared (NI) */
+#define CLONE_VFORK	0x00000400	/* borrow the parent's VM until exec or exit */
 
 /*
  *  INIT_TASK is used to set up the first task table, touch at
@@ -270,7 +277,7 @@ struct task_struct {
 /* suppl grps*/ {NOGROUP,}, \
 /* proc links*/ &init_task,&init_task,NULL,NULL,NULL,NULL, \
 /* uid etc */	0,0,0,0,0,0, \
-/* timeout */	0,0,0,0,0,0,0,0,0,0,0,0, \
+/* timeout */	0,0,0,0,0,0,0,0,0,0,0, \
 /* min_flt */	0,0,0,0, \
 /* rlimits */   { {LONG_MAX, LONG_MAX}, {LONG_MAX, LONG_MAX},  \
 		  {LONG_MAX, LONG_MAX}, {LONG_MAX, LONG_MAX},  \
@@ -279,7 +286,7 @@ struct task_struct {
 /* rss */	2, \
 /* comm */	"swapper", \
 /* vm86_info */	NULL, 0, \
-/* fs info */	0,-1,0022,NULL,NULL,NULL,NULL, \
+/* fs info */	0,-1,0022,NULL,NULL,NULL,NULL,NULL, \
 /* ipc */	NULL, NULL, \
 /* filp */	{NULL,}, \
 /* cloe */	{{ 0, }}, \
@@ -303,8 +310,6 @@ extern struct task_struct *task[NR_TASKS];
 extern struct task_struct *last_task_used_math;
 extern struct task_struct *current;
 extern unsigned long volatile jiffies;
-extern unsigned long itimer_ticks;
-extern unsigned long itimer_next;
 extern struct timeval xtime;
 extern int need_resched;
 
@@ -314,6 +319,9 @@ extern void sleep_on(struct wait_queue ** p);
 extern void interruptible_sleep_on(struct wait_queue ** p);
 extern void wake_up(struct wait_queue ** p);
 extern void wake_up_interruptible(struct wait_queue ** p);
+extern void wake_up_process(struct task_struct * tsk);
+extern void release_vfork(struct task_struct * p);
+extern void it_real_fn(unsigned long data);
 
 extern void notify_parent(struct task_struct * tsk);
 extern int send_sig(unsigned long sig,struct task_struct * p,int priv);
@@ -0,0 +1,39 @@
+#ifndef _LINUX_SLAB_H
+#define _LINUX_SLAB_H
+
+/*
+ * Object caches for fixed-size kernel structures, see mm/slab.c.
+ */
+
+struct kmem_slab;
+
+struct kmem_cache {
+	char * name;
+	int objsize;		/* including alignment padding */
+	int num;		/* objects per slab */
+	int offset;		/* of the first object in an uncoloured slab */
+	int colour;		/* number of different slab colours */
+	int colour_off;		/* the step between two colours */
+	int colour_next;
+	void (*ctor)(void *, int);
+	struct kmem_slab * full;
+	struct kmem_slab * partial;
+	struct kmem_slab * empty;
+	struct kmem_cache * next;	/* all caches, for /proc/slabinfo */
+	unsigned long active;	/* objects handed out right now */
+	unsigned long slabs;
+	unsigned long allocs;
+	unsigned long grown;
+	unsigned long reaped;
+};
+
+extern struct kmem_cache * kmem_cache_create(char * name, int size, int align,
+	void (*ctor)(void *, int));
+extern void * kmem_cache_alloc(struct kmem_cache * cachep, int priority);
+extern void kmem_cache_free(struct kmem_cache * cachep, void * objp);
+extern int kmem_cache_shrink(struct kmem_cache * cachep);
+extern struct kmem_cache * kmem_find_cache(void * objp);
+extern int kmem_cache_reap(void);
+extern int get_slabinfo(char * buffer);
+
+#endif /* _LINUX_SLAB_H */
@@ -168,7 +168,6 @@ extern int sys_bdflush();
  */
 
 #define sys_quotactl	sys_ni_syscall
-#define sys_bdflush	sys_ni_syscall
 
 typedef int (*fn_ptr)();
 
@@ -1,6 +1,8 @@
 #ifndef _LINUX_TIMER_H
 #define _LINUX_TIMER_H
 
+#include <linux/stddef.h>
+
 /*
  * DON'T CHANGE THESE!! Most of them are hardcoded into some assembly language
  * as well as being defined here.
@@ -84,4 +86,14 @@ struct timer_list {
 extern void add_timer(struct timer_list * timer);
 extern int  del_timer(struct timer_list * timer);
 
+/*
+ * A timer_list that isn't statically allocated (or cleared) has to be
+ * set up with this before it is first handed to add_timer/del_timer.
+ */
+extern inline void init_timer(struct timer_list * timer)
+{
+	timer->next = NULL;
+	timer->prev = NULL;
+}
+
 #endif
@@ -49,6 +49,7 @@ static inline _syscall0(int,fork)
 static inline _syscall0(int,pause)
 static inline _syscall1(int,setup,void *,BIOS)
 static inline _syscall0(int,sync)
+static inline _syscall2(int,bdflush,int,func,long,data)
 static inline _syscall0(pid_t,setsid)
 static inline _syscall3(int,write,int,fd,const char *,buf,off_t,count)
 static inline _syscall1(int,dup,int,fd)
@@ -76,6 +77,7 @@ extern long blk_dev_init(long,long);
 extern long chr_dev_init(long,long);
 extern void floppy_init(void);
 extern void sock_init(void);
+extern void page_cache_init(void);
 extern long rd_init(long mem_start, int length);
 unsigned long net_dev_init(unsigned long, unsigned long);
 extern unsigned long simple_strtoul(const char *,char **,unsigned int);
@@ -91,6 +93,8 @@ extern void t128_setup(char *str, int *ints);
 extern void generic_NCR5380_setup(char *str, int *intr);
 extern void aha152x_setup(char *str, int *ints);
 extern void sound_setup(char *str, int *ints);
+extern void elevator_setup(char *str, int *ints);
+extern void queue_depth_setup(char *str, int *ints);
 #ifdef CONFIG_SBPCD
 extern void sbpcd_setup(char *str, int *ints);
 #endif CONFIG_SBPCD
@@ -170,6 +174,8 @@ struct {
 	void (*setup_func)(char *, int *);
 } bootsetups[] = {
 	{ "reserve=", reserve_setup },
+	{ "elevator=", elevator_setup },
+	{ "queue_depth=", queue_depth_setup },
 #ifdef CONFIG_INET
 	{ "ether=", eth_setup },
 #endif
@@ -405,6 +411,8 @@ asmlinkage void start_kernel(void)
 	memory_start = file_table_init(memory_start,memory_end);
 	mem_init(low_memory_start,memory_start,memory_end);
 	buffer_init();
+	page_cache_init();
+	dcache_init();
 	time_init();
 	floppy_init();
 	sock_init();
@@ -482,6 +490,8 @@ void init(void)
 	int pid,i;
 
 	setup((void *) &drive_info);
+	if (!fork())		/* the dirty-buffer flushing daemon */
+		_exit(bdflush(0,0));
 	sprintf(term, "TERM=con%dx%d", ORIG_VIDEO_COLS, ORIG_VIDEO_LINES);
 	(void) open("/dev/tty1",O_RDWR,0);
 	(void) dup(0);
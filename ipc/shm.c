@@ -338,6 +338,8 @@ static int shm_map (struct shm_desc *shmd, int remap)
 	for (tmp = shmd->start; tmp < shmd->end; tmp += PAGE_SIZE) { 
 		page_table = PAGE_DIR_OFFSET(page_dir,tmp);
 		if (*page_table & PAGE_PRESENT) {
+			if (!unshare_page_table(page_table))
+				return -ENOMEM;
 			page_table = (ulong *) (PAGE_MASK & *page_table);
 			page_table += ((tmp >> PAGE_SHIFT) & (PTRS_PER_PAGE-1));
 			if (*page_table) {
@@ -28,18 +28,19 @@ static int generate(unsigned long sig, struct task_struct * p)
 	struct sigaction * sa = sig + p->sigaction - 1;
 
 	/* always generate signals for traced processes ??? */
-	if (p->flags & PF_PTRACED) {
-		p->signal |= mask;
-		return 1;
+	if (!(p->flags & PF_PTRACED)) {
+		/* don't bother with ignored signals (but SIGCHLD is special) */
+		if (sa->sa_handler == SIG_IGN && sig != SIGCHLD)
+			return 0;
+		/* some signals are ignored by default.. (but SIGCONT already did its deed) */
+		if ((sa->sa_handler == SIG_DFL) &&
+		    (sig == SIGCONT || sig == SIGCHLD || sig == SIGWINCH))
+			return 0;
 	}
-	/* don't bother with ignored signals (but SIGCHLD is special) */
-	if (sa->sa_handler == SIG_IGN && sig != SIGCHLD)
-		return 0;
-	/* some signals are ignored by default.. (but SIGCONT already did its deed) */
-	if ((sa->sa_handler == SIG_DFL) &&
-	    (sig == SIGCONT || sig == SIGCHLD || sig == SIGWINCH))
-		return 0;
 	p->signal |= mask;
+	/* schedule() no longer goes looking for these, so wake it here */
+	if (p->state == TASK_INTERRUPTIBLE && (p->signal & ~p->blocked))
+		wake_up_process(p);
 	return 1;
 }
 
@@ -54,7 +55,7 @@ int send_sig(unsigned long sig,struct task_struct * p,int priv)
 		return 0;
 	if ((sig == SIGKILL) || (sig == SIGCONT)) {
 		if (p->state == TASK_STOPPED)
-			p->state = TASK_RUNNING;
+			wake_up_process(p);
 		p->exit_code = 0;
 		p->signal &= ~( (1<<(SIGSTOP-1)) | (1<<(SIGTSTP-1)) |
 				(1<<(SIGTTIN-1)) | (1<<(SIGTTOU-1)) );
@@ -354,11 +355,14 @@ NORET_TYPE void do_exit(long code)
 	int i;
 
 fake_volatile:
+	current->it_real_incr = 0;
+	del_timer(&current->real_timer);
 	if (current->semun)
 		sem_exit();
 	if (current->shm)
 		shm_exit();
 	free_page_tables(current);
+	release_vfork(current);
 	for (i=0 ; i<NR_OPEN ; i++)
 		if (current->filp[i])
 			sys_close(i);
@@ -375,6 +379,7 @@ fake_volatile:
 		struct vm_area_struct * mpnt, *mpnt1;
 		mpnt = current->mmap;
 		current->mmap = NULL;
+		current->mmap_avl = NULL;
 		while (mpnt) {
 			mpnt1 = mpnt->vm_next;
 			if (mpnt->vm_ops && mpnt->vm_ops->close)
@@ -94,12 +94,15 @@ int dup_mmap(struct task_struct * tsk)
 	struct vm_area_struct * mpnt, **p, *tmp;
 
 	tsk->mmap = NULL;
+	tsk->mmap_avl = NULL;
 	tsk->stk_vma = NULL;
 	p = &tsk->mmap;
 	for (mpnt = current->mmap ; mpnt ; mpnt = mpnt->vm_next) {
 		tmp = (struct vm_area_struct *) kmalloc(sizeof(struct vm_area_struct), GFP_KERNEL);
-		if (!tmp)
+		if (!tmp) {
+			build_mmap_avl(tsk);
 			return -ENOMEM;
+		}
 		*tmp = *mpnt;
 		tmp->vm_task = tsk;
 		tmp->vm_next = NULL;
@@ -110,9 +113,22 @@ int dup_mmap(struct task_struct * tsk)
 		if (current->stk_vma == mpnt)
 			tsk->stk_vma = tmp;
 	}
+	build_mmap_avl(tsk);
 	return 0;
 }
 
+/*
+ * A vfork() child runs in the address space of its parent, which waits in
+ * sys_fork() until the child execs or exits and hands the memory back.
+ */
+void release_vfork(struct task_struct * p)
+{
+	if (!(p->flags & PF_VFORK))
+		return;
+	p->flags &= ~PF_VFORK;
+	wake_up(&p->p_opptr->wait_chldexit);
+}
+
 #define IS_CLONE (regs.orig_eax == __NR_clone)
 #define copy_vm(p) ((clone_flags & COPYVM)?copy_page_tables(p):clone_page_tables(p))
 
@@ -125,7 +141,7 @@ asmlinkage int sys_fork(struct pt_regs regs)
 {
 	struct pt_regs * childregs;
 	struct task_struct *p;
-	int i,nr;
+	int i,nr,pid;
 	struct file *f;
 	unsigned long clone_flags = COPYVM | SIGCHLD;
 
@@ -139,15 +155,20 @@ asmlinkage int sys_fork(struct pt_regs regs)
 	p->did_exec = 0;
 	p->kernel_stack_page = 0;
 	p->state = TASK_UNINTERRUPTIBLE;
-	p->flags &= ~(PF_PTRACED|PF_TRACESYS);
-	p->pid = last_pid;
+	p->flags &= ~(PF_PTRACED|PF_TRACESYS|PF_VFORK);
+	p->pid = pid = last_pid;
 	p->swappable = 1;
 	p->p_pptr = p->p_opptr = current;
 	p->p_cptr = NULL;
 	SET_LINKS(p);
 	p->signal = 0;
-	p->it_real_value = p->it_virt_value = p->it_prof_value = 0;
+	p->next_run = p->prev_run = NULL;
+	p->run_queue = NULL;
+	p->it_virt_value = p->it_prof_value = 0;
 	p->it_real_incr = p->it_virt_incr = p->it_prof_incr = 0;
+	init_timer(&p->real_timer);
+	p->real_timer.data = (unsigned long) p;
+	p->real_timer.function = it_real_fn;
 	p->leader = 0;		/* process leadership doesn't inherit */
 	p->utime = p->stime = 0;
 	p->cutime = p->cstime = 0;
@@ -179,7 +200,9 @@ asmlinkage int sys_fork(struct pt_regs regs)
 		if (regs.ebx)
 			childregs->esp = regs.ebx;
 		clone_flags = regs.ecx;
-		if (childregs->esp == regs.esp)
+		if (clone_flags & CLONE_VFORK)
+			clone_flags &= ~COPYVM;
+		else if (childregs->esp == regs.esp)
 			clone_flags |= COPYVM;
 	}
 	p->exit_signal = clone_flags & CSIGNAL;
@@ -220,8 +243,12 @@ asmlinkage int sys_fork(struct pt_regs regs)
 		set_ldt_desc(gdt+(nr<<1)+FIRST_LDT_ENTRY,&default_ldt, 1);
 
 	p->counter = current->counter >> 1;
-	p->state = TASK_RUNNING;	/* do this last, just in case */
-	return p->pid;
+	if (clone_flags & CLONE_VFORK)
+		p->flags |= PF_VFORK;
+	wake_up_process(p);	/* do this last, just in case */
+	while (task[nr] == p && (p->flags & PF_VFORK))
+		sleep_on(&current->wait_chldexit);
+	return pid;
 bad_fork_cleanup:
 	task[nr] = NULL;
 	REMOVE_LINKS(p);
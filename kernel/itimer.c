@@ -27,6 +27,22 @@ static void jiffies_to_tv(unsigned long jiffies, struct timeval *value)
     value->tv_sec = jiffies / HZ;
 }
 
+/*
+ * ITIMER_REAL runs off a timer of its own, so only the task it belongs
+ * to gets touched when it goes off.
+ */
+void it_real_fn(unsigned long data)
+{
+    struct task_struct *p = (struct task_struct *)data;
+
+    send_sig(SIGALRM, p, 1);
+    if (p->it_real_incr)
+    {
+        p->real_timer.expires = p->it_real_incr;
+        add_timer(&p->real_timer);
+    }
+}
+
 int get_itimer(int which, struct itimerval *value)
 {
     unsigned long val, interval;
@@ -34,8 +50,13 @@ int get_itimer(int which, struct itimerval *value)
     switch (which)
     {
     case ITIMER_REAL:
-        val = current->it_real_value;
+        val = 0;
         interval = current->it_real_incr;
+        if (del_timer(&current->real_timer))
+        {
+            val = current->real_timer.expires;
+            add_timer(&current->real_timer);
+        }
         break;
     case ITIMER_VIRTUAL:
         val = current->it_virt_value;
@@ -92,14 +113,13 @@ int set_itimer(int which, struct itimerval *value, struct itimerval *ovalue)
     switch (which)
     {
     case ITIMER_REAL:
+        del_timer(&current->real_timer);
+        current->it_real_incr = interval;
         if (time_val)
         {
-            time_val += 1 + itimer_ticks;
-            if (time_val < itimer_next)
-                itimer_next = time_val;
+            current->real_timer.expires = time_val + 1;
+            add_timer(&current->real_timer);
         }
-        current->it_real_value = time_val;
-        current->it_real_incr = interval;
         break;
 
     case ITIMER_VIRTUAL:
@@ -74,7 +74,7 @@ int wp_works_ok = 0;		/* set if paging hardware honours WP */
  */
 int EISA_bus = 0;
 
-extern int _setitimer(int, struct itimerval *, struct itimerval *);
+extern int set_itimer(int, struct itimerval *, struct itimerval *);
 unsigned long * prof_buffer = NULL;
 unsigned long prof_len = 0;
 
@@ -103,7 +103,7 @@ struct {
 	} stack_start = { & user_stack [PAGE_SIZE>>2] , KERNEL_DS };
 
 struct kernel_stat kstat =
-	{ 0, 0, 0, { 0, 0, 0, 0 }, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+	{ 0, 0, 0, { 0, 0, 0, 0 }, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
 
 /*
  * int 0x80 entry points.. Moved away from the header file, as
@@ -192,9 +192,137 @@ asmlinkage void math_emulate(long arg)
 
 #endif /* CONFIG_MATH_EMULATION */
 
-unsigned long itimer_ticks = 0;
-unsigned long itimer_next = ~0;
-static unsigned long lost_ticks = 0;
+
+/*
+ * The run-queue. Instead of walking the whole task list on every
+ * reschedule, runnable tasks are kept on per-level lists indexed by
+ * their counter, and a bitmap of the non-empty levels lets schedule()
+ * find the best one without looking at anything else.
+ *
+ * Tasks whose counter has run out go on the "expired" queue instead,
+ * filed under their priority (which is what the counter recalculation
+ * will give them). When the active queue runs dry the two are swapped
+ * and sched_epoch is bumped: everybody else picks up the recalculation
+ * lazily, the next time they are queued or chosen.
+ *
+ * The current task is never on a run-queue, nor is task[0]. All of this
+ * is touched from interrupts (through wake_up()), so keep it under cli().
+ */
+#define NR_RUN_LEVELS	128
+
+struct run_queue {
+	unsigned long bitmap[NR_RUN_LEVELS/32];
+	struct task_struct * level[NR_RUN_LEVELS];
+};
+
+static struct run_queue run_queues[2];
+static struct run_queue * active_rq = run_queues+0;
+static struct run_queue * expired_rq = run_queues+1;
+static unsigned long sched_epoch = 0;
+
+/*
+ * Apply any counter recalculations this task has missed. After a few
+ * rounds the counter has converged on 2*priority anyway.
+ */
+static inline void recalc_counter(struct task_struct * p)
+{
+	unsigned long missed = sched_epoch - p->sched_epoch;
+
+	if (missed > 8)
+		missed = 8;
+	while (missed--)
+		p->counter = (p->counter >> 1) + p->priority;
+	p->sched_epoch = sched_epoch;
+}
+
+static inline int top_run_level(struct run_queue * rq)
+{
+	int i, bit;
+
+	for (i = NR_RUN_LEVELS/32-1 ; i >= 0 ; i--) {
+		if (!rq->bitmap[i])
+			continue;
+		__asm__("bsrl %1,%0":"=r" (bit):"r" (rq->bitmap[i]));
+		return (i << 5) + bit;
+	}
+	return -1;
+}
+
+static inline void add_to_runqueue(struct task_struct * p)
+{
+	struct run_queue * rq = active_rq;
+	struct task_struct * head;
+	int level;
+
+	recalc_counter(p);
+	level = p->counter;
+	if (level <= 0) {
+		rq = expired_rq;
+		level = p->priority;
+	}
+	if (level >= NR_RUN_LEVELS)
+		level = NR_RUN_LEVELS-1;
+	if (level < 0)
+		level = 0;
+	if (!(head = rq->level[level])) {
+		rq->level[level] = p->next_run = p->prev_run = p;
+		rq->bitmap[level >> 5] |= 1UL << (level & 31);
+	} else {
+		p->next_run = head;
+		p->prev_run = head->prev_run;
+		head->prev_run->next_run = p;
+		head->prev_run = p;
+	}
+	p->run_queue = rq;
+	p->run_level = level;
+}
+
+static inline void del_from_runqueue(struct task_struct * p)
+{
+	struct run_queue * rq = p->run_queue;
+	int level = p->run_level;
+
+	if (!rq)
+		return;
+	if (p->next_run == p) {
+		rq->level[level] = NULL;
+		rq->bitmap[level >> 5] &= ~(1UL << (level & 31));
+	} else {
+		p->next_run->prev_run = p->prev_run;
+		p->prev_run->next_run = p->next_run;
+		if (rq->level[level] == p)
+			rq->level[level] = p->next_run;
+	}
+	p->next_run = p->prev_run = NULL;
+	p->run_queue = NULL;
+}
+
+/*
+ * Make a task runnable and put it on the run-queue. Anybody changing
+ * the state of some other task to TASK_RUNNING has to go through here,
+ * or schedule() will never see it.
+ */
+void wake_up_process(struct task_struct * p)
+{
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	p->state = TASK_RUNNING;
+	if (p != current && p != task[0] && !p->run_queue)
+		add_to_runqueue(p);
+	restore_flags(flags);
+	if (p->counter > current->counter)
+		need_resched = 1;
+}
+
+static void process_timeout(unsigned long data)
+{
+	struct task_struct * p = (struct task_struct *) data;
+
+	p->timeout = 0;
+	wake_up_process(p);
+}
 
 /*
  *  'schedule()' is the scheduler function. It's a very simple and nice
@@ -204,57 +332,34 @@ static unsigned long lost_ticks = 0;
  *   NOTE!!  Task 0 is the 'idle' task, which gets called when no other
  * tasks can run. It can not be killed, and it cannot sleep. The 'state'
  * information in task[0] is never used.
- *
- * The "confuse_gcc" goto is used only to get better assembly code..
- * Djikstra probably hates me.
  */
 asmlinkage void schedule(void)
 {
-	int c;
-	struct task_struct * p;
+	int level;
 	struct task_struct * next;
-	unsigned long ticks;
+	struct run_queue * rq;
+	unsigned long timeout = 0;
+	struct timer_list timer;
 
-/* check alarm, wake up any interruptible tasks that have got a signal */
+	need_resched = 0;
 
+/*
+ * Alarms and other tasks' timeouts run off the timer-list now: all we
+ * have to check is whether the task going to sleep has got a signal
+ * or an expired timeout already, and otherwise arm its timeout.
+ */
 	cli();
-	ticks = itimer_ticks;
-	itimer_ticks = 0;
-	itimer_next = ~0;
-	sti();
-	need_resched = 0;
-	p = &init_task;
-	for (;;) {
-		if ((p = p->next_task) == &init_task)
-			goto confuse_gcc1;
-		if (ticks && p->it_real_value) {
-			if (p->it_real_value <= ticks) {
-				send_sig(SIGALRM, p, 1);
-				if (!p->it_real_incr) {
-					p->it_real_value = 0;
-					goto end_itimer;
-				}
-				do {
-					p->it_real_value += p->it_real_incr;
-				} while (p->it_real_value <= ticks);
-			}
-			p->it_real_value -= ticks;
-			if (p->it_real_value < itimer_next)
-				itimer_next = p->it_real_value;
-		}
-end_itimer:
-		if (p->state != TASK_INTERRUPTIBLE)
-			continue;
-		if (p->signal & ~p->blocked) {
-			p->state = TASK_RUNNING;
-			continue;
-		}
-		if (p->timeout && p->timeout <= jiffies) {
-			p->timeout = 0;
-			p->state = TASK_RUNNING;
+	if (current->state == TASK_INTERRUPTIBLE) {
+		if (current->signal & ~current->blocked)
+			current->state = TASK_RUNNING;
+		else if ((timeout = current->timeout) != 0 &&
+			 timeout <= jiffies) {
+			current->timeout = 0;
+			timeout = 0;
+			current->state = TASK_RUNNING;
 		}
 	}
-confuse_gcc1:
+	sti();
 
 /* this is the scheduler proper: */
 #if 0
@@ -267,22 +372,44 @@ confuse_gcc1:
 		++current->counter;
 	}
 #endif
-	c = -1;
-	next = p = &init_task;
+	cli();
+	if (current != task[0] && current->state == TASK_RUNNING &&
+	    !current->run_queue)
+		add_to_runqueue(current);
 	for (;;) {
-		if ((p = p->next_task) == &init_task)
-			goto confuse_gcc2;
-		if (p->state == TASK_RUNNING && p->counter > c)
-			c = p->counter, next = p;
+		level = top_run_level(active_rq);
+		if (level < 0) {
+			if (top_run_level(expired_rq) < 0) {
+				next = task[0];
+				break;
+			}
+			/* everybody has used up their slice: recalculate */
+			rq = active_rq;
+			active_rq = expired_rq;
+			expired_rq = rq;
+			sched_epoch++;
+			continue;
+		}
+		next = active_rq->level[level];
+		del_from_runqueue(next);
+		/* stale entries are just dropped */
+		if (next->state == TASK_RUNNING)
+			break;
 	}
-confuse_gcc2:
-	if (!c) {
-		for_each_task(p)
-			p->counter = (p->counter >> 1) + p->priority;
+	recalc_counter(next);
+	if (timeout) {
+		init_timer(&timer);
+		timer.expires = timeout - jiffies;
+		timer.data = (unsigned long) current;
+		timer.function = process_timeout;
+		add_timer(&timer);
 	}
 	if(current != next)
 		kstat.context_swtch++;
 	switch_to(next);
+	sti();
+	if (timeout)
+		del_timer(&timer);
 	/* Now maybe reload the debug registers */
 	if(current->debugreg[7]){
 		loaddebug(0);
@@ -318,11 +445,8 @@ void wake_up(struct wait_queue **q)
 	do {
 		if ((p = tmp->task) != NULL) {
 			if ((p->state == TASK_UNINTERRUPTIBLE) ||
-			    (p->state == TASK_INTERRUPTIBLE)) {
-				p->state = TASK_RUNNING;
-				if (p->counter > current->counter)
-					need_resched = 1;
-			}
+			    (p->state == TASK_INTERRUPTIBLE))
+				wake_up_process(p);
 		}
 		if (!tmp->next) {
 			printk("wait_queue is bad (eip = %08lx)\n",((unsigned long *) q)[-1]);
@@ -344,11 +468,8 @@ void wake_up_interruptible(struct wait_queue **q)
 		return;
 	do {
 		if ((p = tmp->task) != NULL) {
-			if (p->state == TASK_INTERRUPTIBLE) {
-				p->state = TASK_RUNNING;
-				if (p->counter > current->counter)
-					need_resched = 1;
-			}
+			if (p->state == TASK_INTERRUPTIBLE)
+				wake_up_process(p);
 		}
 		if (!tmp->next) {
 			printk("wait_queue is bad (eip = %08lx)\n",((unsigned long *) q)[-1]);
@@ -402,54 +523,181 @@ void sleep_on(struct wait_queue **p)
 	__sleep_on(p,TASK_UNINTERRUPTIBLE);
 }
 
-static struct timer_list * next_timer = NULL;
+/*
+ * The timer-list is kept as a hierarchical timing wheel: tv1 holds the
+ * timers due in the next TVR_SIZE ticks, one list per tick, and each of
+ * tv2..tv5 covers TVN_SIZE times the range of the level below it. Both
+ * add_timer() and del_timer() are constant-time; the only real work is
+ * done by timer_bh() when it cascades the timers of a higher level down
+ * into tv1 every TVR_SIZE ticks.
+ *
+ * While a timer is pending its "expires" field holds the absolute
+ * jiffies value, del_timer() turns it back into the number of ticks
+ * that were left so that callers can still look at it.
+ */
+#define TVN_BITS 6
+#define TVR_BITS 8
+#define TVN_SIZE (1 << TVN_BITS)
+#define TVR_SIZE (1 << TVR_BITS)
+#define TVN_MASK (TVN_SIZE - 1)
+#define TVR_MASK (TVR_SIZE - 1)
+
+struct timer_vec {
+	int index;
+	struct timer_list *vec[TVN_SIZE];
+};
+
+struct timer_vec_root {
+	int index;
+	struct timer_list *vec[TVR_SIZE];
+};
+
+static struct timer_vec tv5 = { 0 };
+static struct timer_vec tv4 = { 0 };
+static struct timer_vec tv3 = { 0 };
+static struct timer_vec tv2 = { 0 };
+static struct timer_vec_root tv1 = { 0 };
+
+static struct timer_vec * const tvecs[] = {
+	(struct timer_vec *)&tv1, &tv2, &tv3, &tv4, &tv5
+};
+
+#define NOOF_TVECS (sizeof(tvecs) / sizeof(tvecs[0]))
+
+static unsigned long timer_jiffies = 0;
+
+/*
+ * The "prev" pointer of the first timer on a list points back at the
+ * list head itself, which works because "next" is the first member.
+ */
+static inline void insert_timer(struct timer_list * timer,
+	struct timer_list ** vec, int idx)
+{
+	if ((timer->next = vec[idx]) != NULL)
+		vec[idx]->prev = timer;
+	vec[idx] = timer;
+	timer->prev = (struct timer_list *) &vec[idx];
+}
+
+static inline void internal_add_timer(struct timer_list * timer)
+{
+	unsigned long expires = timer->expires;
+	unsigned long idx = expires - timer_jiffies;
+
+	if (idx < TVR_SIZE)
+		insert_timer(timer, tv1.vec, expires & TVR_MASK);
+	else if (idx < 1 << (TVR_BITS + TVN_BITS))
+		insert_timer(timer, tv2.vec,
+			(expires >> TVR_BITS) & TVN_MASK);
+	else if (idx < 1 << (TVR_BITS + 2 * TVN_BITS))
+		insert_timer(timer, tv3.vec,
+			(expires >> (TVR_BITS + TVN_BITS)) & TVN_MASK);
+	else if (idx < 1 << (TVR_BITS + 3 * TVN_BITS))
+		insert_timer(timer, tv4.vec,
+			(expires >> (TVR_BITS + 2 * TVN_BITS)) & TVN_MASK);
+	else if ((long) idx < 0)
+		/* already overdue: run it on the next timer_bh() pass */
+		insert_timer(timer, tv1.vec, tv1.index);
+	else
+		insert_timer(timer, tv5.vec,
+			(expires >> (TVR_BITS + 3 * TVN_BITS)) & TVN_MASK);
+}
+
+static inline int detach_timer(struct timer_list * timer)
+{
+	struct timer_list * prev = timer->prev;
+
+	if (!prev)
+		return 0;
+	if (timer->next)
+		timer->next->prev = prev;
+	prev->next = timer->next;
+	timer->next = timer->prev = NULL;
+	return 1;
+}
 
 void add_timer(struct timer_list * timer)
 {
 	unsigned long flags;
-	struct timer_list ** p;
 
 	if (!timer)
 		return;
-	timer->next = NULL;
-	p = &next_timer;
 	save_flags(flags);
 	cli();
-	while (*p) {
-		if ((*p)->expires > timer->expires) {
-			(*p)->expires -= timer->expires;
-			timer->next = *p;
-			break;
-		}
-		timer->expires -= (*p)->expires;
-		p = &(*p)->next;
+	if (timer->prev) {
+		printk("add_timer() called with pending timer (eip = %08lx)\n",
+			((unsigned long *) &timer)[-1]);
+		restore_flags(flags);
+		return;
 	}
-	*p = timer;
+	timer->expires += jiffies;
+	internal_add_timer(timer);
+	kstat.timers++;
 	restore_flags(flags);
 }
 
 int del_timer(struct timer_list * timer)
 {
 	unsigned long flags;
-	unsigned long expires = 0;
-	struct timer_list **p;
+	int ret;
 
-	p = &next_timer;
 	save_flags(flags);
 	cli();
-	while (*p) {
-		if (*p == timer) {
-			if ((*p = timer->next) != NULL)
-				(*p)->expires += timer->expires;
-			timer->expires += expires;
-			restore_flags(flags);
-			return 1;
-		}
-		expires += (*p)->expires;
-		p = &(*p)->next;
+	ret = detach_timer(timer);
+	if (ret) {
+		kstat.timers--;
+		if ((long) (timer->expires -= jiffies) < 0)
+			timer->expires = 0;
 	}
 	restore_flags(flags);
-	return 0;
+	return ret;
+}
+
+static inline void cascade_timers(struct timer_vec * tv)
+{
+	struct timer_list * timer = tv->vec[tv->index];
+
+	tv->vec[tv->index] = NULL;
+	while (timer) {
+		struct timer_list * tmp = timer;
+		timer = timer->next;
+		internal_add_timer(tmp);
+		kstat.timer_cascades++;
+	}
+	tv->index = (tv->index + 1) & TVN_MASK;
+}
+
+/*
+ * Run everything that has become due since the last call. This catches
+ * up with jiffies one tick at a time, so a late bottom half doesn't lose
+ * any timers.
+ */
+static inline void run_timer_list(void)
+{
+	struct timer_list * timer;
+
+	cli();
+	while ((long) (jiffies - timer_jiffies) >= 0) {
+		if (!tv1.index) {
+			int n = 1;
+			do {
+				cascade_timers(tvecs[n]);
+			} while (tvecs[n]->index == 1 && ++n < NOOF_TVECS);
+		}
+		while ((timer = tv1.vec[tv1.index]) != NULL) {
+			void (*fn)(unsigned long) = timer->function;
+			unsigned long data = timer->data;
+			detach_timer(timer);
+			timer->expires = 0;
+			kstat.timers--;
+			sti();
+			fn(data);
+			cli();
+		}
+		++timer_jiffies;
+		tv1.index = (tv1.index + 1) & TVR_MASK;
+	}
+	sti();
 }
 
 unsigned long timer_active = 0;
@@ -568,17 +816,8 @@ static void timer_bh(void * unused)
 	unsigned long mask;
 	struct timer_struct *tp;
 
-	cli();
-	while (next_timer && next_timer->expires == 0) {
-		void (*fn)(unsigned long) = next_timer->function;
-		unsigned long data = next_timer->data;
-		next_timer = next_timer->next;
-		sti();
-		fn(data);
-		cli();
-	}
-	sti();
-	
+	run_timer_list();
+
 	for (mask = 1, tp = timer_table+0 ; mask ; tp++,mask += mask) {
 		if (mask > timer_active)
 			break;
@@ -697,21 +936,7 @@ static void do_timer(struct pt_regs * regs)
 			continue;
 		mark_bh(TIMER_BH);
 	}
-	cli();
-	itimer_ticks++;
-	if (itimer_ticks > itimer_next)
-		need_resched = 1;
-	if (next_timer) {
-		if (next_timer->expires) {
-			next_timer->expires--;
-			if (!next_timer->expires)
-				mark_bh(TIMER_BH);
-		} else {
-			lost_ticks++;
-			mark_bh(TIMER_BH);
-		}
-	}
-	sti();
+	mark_bh(TIMER_BH);
 }
 
 asmlinkage int sys_alarm(long seconds)
@@ -721,7 +946,7 @@ asmlinkage int sys_alarm(long seconds)
 	it_new.it_interval.tv_sec = it_new.it_interval.tv_usec = 0;
 	it_new.it_value.tv_sec = seconds;
 	it_new.it_value.tv_usec = 0;
-	_setitimer(ITIMER_REAL, &it_new, &it_old);
+	set_itimer(ITIMER_REAL, &it_new, &it_old);
 	return(it_old.it_value.tv_sec + (it_old.it_value.tv_usec / 1000000));
 }
 
@@ -816,6 +1041,8 @@ void sched_init(void)
 	struct desc_struct * p;
 
 	bh_base[TIMER_BH].routine = timer_bh;
+	init_task.real_timer.data = (unsigned long) &init_task;
+	init_task.real_timer.function = it_real_fn;
 	if (sizeof(struct sigaction) != 16)
 		panic("Struct sigaction MUST be 16 bytes");
 	set_tss_desc(gdt+FIRST_TSS_ENTRY,&init_task.tss);
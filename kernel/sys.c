@@ -161,6 +161,8 @@ static void mark_screen_rdonly(struct task_struct * tsk)
 	unsigned long *pg_table;
 
 	if ((tmp = tsk->tss.cr3) != 0) {
+		if (!unshare_page_table((unsigned long *) tmp))
+			return;
 		tmp = *(unsigned long *) tmp;
 		if (tmp & PAGE_PRESENT) {
 			tmp &= PAGE_MASK;
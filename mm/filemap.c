@@ -0,0 +1,261 @@
+/*
+ *  linux/mm/filemap.c
+ *
+ *  The page cache: file pages that stay in memory after the last process
+ *  that mapped them has gone.
+ */
+
+/*
+ * Pages are looked up by (inode, offset) through a small hash table, and
+ * every inode keeps a list of its own pages so that they can be found on
+ * write(), truncate() and when the inode is thrown out. The cache holds
+ * one mem_map reference to each page: a page with a count of one is used
+ * by nobody else and can be given back by try_to_free_page().
+ *
+ * Cached pages are only ever mapped read-only, so nobody but write() (via
+ * update_page_cache) changes their contents. Pages that bread_page() was
+ * able to share with the buffer cache aren't entered: they are cached
+ * already.
+ *
+ * None of this is used from interrupts, so there is no need for cli().
+ */
+
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/slab.h>
+
+#include <asm/segment.h>
+
+#define PAGE_HASH_BITS	8
+#define PAGE_HASH_SIZE	(1 << PAGE_HASH_BITS)
+
+struct page_cache {
+	struct inode * inode;
+	unsigned long offset;
+	unsigned long page;
+	struct page_cache * next_hash, * prev_hash;
+	struct page_cache * next_inode, * prev_inode;
+	struct page_cache * next_lru, * prev_lru;
+};
+
+static struct page_cache * page_hash_table[PAGE_HASH_SIZE];
+static struct page_cache * lru_pages = NULL;	/* most recently used first */
+static struct kmem_cache * page_cache_cachep = NULL;
+
+unsigned long page_cache_size = 0;	/* in pages */
+
+#define page_hashfn(i,offset) \
+	((((unsigned long) (i) / sizeof(struct inode)) ^ ((offset) >> PAGE_SHIFT)) & \
+	 (PAGE_HASH_SIZE - 1))
+#define page_hash(i,offset) page_hash_table[page_hashfn(i,offset)]
+
+static inline void remove_lru(struct page_cache * p)
+{
+	if (p->next_lru == p)
+		lru_pages = NULL;
+	else {
+		p->next_lru->prev_lru = p->prev_lru;
+		p->prev_lru->next_lru = p->next_lru;
+		if (lru_pages == p)
+			lru_pages = p->next_lru;
+	}
+}
+
+static inline void add_lru(struct page_cache * p)
+{
+	if (!lru_pages)
+		p->next_lru = p->prev_lru = p;
+	else {
+		p->next_lru = lru_pages;
+		p->prev_lru = lru_pages->prev_lru;
+		p->prev_lru->next_lru = p;
+		lru_pages->prev_lru = p;
+	}
+	lru_pages = p;
+}
+
+static void remove_page_cache(struct page_cache * p)
+{
+	if (p->next_hash)
+		p->next_hash->prev_hash = p->prev_hash;
+	if (p->prev_hash)
+		p->prev_hash->next_hash = p->next_hash;
+	else
+		page_hash(p->inode, p->offset) = p->next_hash;
+	if (p->next_inode)
+		p->next_inode->prev_inode = p->prev_inode;
+	if (p->prev_inode)
+		p->prev_inode->next_inode = p->next_inode;
+	else
+		p->inode->i_pages = p->next_inode;
+	remove_lru(p);
+	page_cache_size--;
+	free_page(p->page);
+	kmem_cache_free(page_cache_cachep, p);
+}
+
+static struct page_cache * lookup_page_cache(struct inode * inode, unsigned long offset)
+{
+	struct page_cache * p;
+
+	for (p = page_hash(inode, offset) ; p ; p = p->next_hash) {
+		if (p->inode == inode && p->offset == offset) {
+			remove_lru(p);
+			add_lru(p);
+			return p;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Returns the cached page with an extra reference for the caller, or 0.
+ */
+unsigned long find_page_cache(struct inode * inode, unsigned long offset)
+{
+	struct page_cache * p;
+
+	p = lookup_page_cache(inode, offset);
+	if (!p)
+		return 0;
+	mem_map[MAP_NR(p->page)]++;
+	return p->page;
+}
+
+/*
+ * Enter a page that has just been read in. The caller keeps its own
+ * reference. Nothing happens if somebody else got there first while we
+ * slept reading it, or if the page is used by anybody else already (ie
+ * it is a buffer cache page).
+ */
+void add_page_cache(struct inode * inode, unsigned long offset, unsigned long page)
+{
+	struct page_cache * p;
+
+	if (!page_cache_cachep || mem_map[MAP_NR(page)] != 1)
+		return;
+	p = (struct page_cache *) kmem_cache_alloc(page_cache_cachep, GFP_KERNEL);
+	if (!p)
+		return;
+	if (lookup_page_cache(inode, offset)) {
+		kmem_cache_free(page_cache_cachep, p);
+		return;
+	}
+	p->inode = inode;
+	p->offset = offset;
+	p->page = page;
+	mem_map[MAP_NR(page)]++;
+	p->prev_hash = NULL;
+	if ((p->next_hash = page_hash(inode, offset)) != NULL)
+		p->next_hash->prev_hash = p;
+	page_hash(inode, offset) = p;
+	p->prev_inode = NULL;
+	if ((p->next_inode = inode->i_pages) != NULL)
+		p->next_inode->prev_inode = p;
+	inode->i_pages = p;
+	add_lru(p);
+	page_cache_size++;
+}
+
+/*
+ * Copy as much of [pos, pos+count) as the cache has, starting at pos and
+ * stopping at the first page that isn't there. Returns the number of
+ * bytes copied to user space.
+ */
+int read_page_cache(struct inode * inode, unsigned long pos, char * buf, int count)
+{
+	struct page_cache * p;
+	unsigned long page;
+	int read = 0, chars;
+
+	if (pos >= inode->i_size)
+		return 0;
+	if (count > inode->i_size - pos)
+		count = inode->i_size - pos;
+	while (count > 0) {
+		p = lookup_page_cache(inode, pos & PAGE_MASK);
+		if (!p)
+			break;
+		/* memcpy_tofs() can sleep: make sure the page stays */
+		page = p->page;
+		mem_map[MAP_NR(page)]++;
+		chars = PAGE_SIZE - (pos & ~PAGE_MASK);
+		if (chars > count)
+			chars = count;
+		memcpy_tofs(buf, (char *) page + (pos & ~PAGE_MASK), chars);
+		free_page(page);
+		buf += chars;
+		pos += chars;
+		read += chars;
+		count -= chars;
+	}
+	return read;
+}
+
+/*
+ * Called by sys_write() once the data has gone to the file, so that the
+ * cached pages don't go stale.
+ */
+void update_page_cache(struct inode * inode, unsigned long pos, char * buf, int count)
+{
+	struct page_cache * p;
+	unsigned long start, end;
+
+	for (p = inode->i_pages ; p ; p = p->next_inode) {
+		start = (pos > p->offset) ? pos : p->offset;
+		end = p->offset + PAGE_SIZE;
+		if (end > pos + count)
+			end = pos + count;
+		if (start >= end)
+			continue;
+		mem_map[MAP_NR(p->page)]++;
+		memcpy_fromfs((char *) p->page + start - p->offset, buf + start - pos,
+			end - start);
+		free_page(p->page);
+	}
+}
+
+/*
+ * Forget all pages at or after "start" (and the one "start" is in, if it
+ * isn't page aligned): truncate() and clear_inode() use this.
+ */
+void invalidate_page_cache(struct inode * inode, unsigned long start)
+{
+	struct page_cache * p, * next;
+
+	for (p = inode->i_pages ; p ; p = next) {
+		next = p->next_inode;
+		if (p->offset + PAGE_SIZE > start)
+			remove_page_cache(p);
+	}
+}
+
+/*
+ * Called by try_to_free_page(): look at up to 1/2^priority of the cache,
+ * least recently used first, and free a page nobody maps any more.
+ * Pages that are still mapped are moved to the front.
+ */
+int shrink_page_cache(int priority)
+{
+	struct page_cache * p;
+	int count;
+
+	count = (page_cache_size >> priority) + 1;
+	while (lru_pages && count-- > 0) {
+		p = lru_pages->prev_lru;
+		if (mem_map[MAP_NR(p->page)] == 1) {
+			remove_page_cache(p);
+			return 1;
+		}
+		lru_pages = p;
+	}
+	return 0;
+}
+
+void page_cache_init(void)
+{
+	page_cache_cachep = kmem_cache_create("page_cache", sizeof(struct page_cache),
+		0, NULL);
+}
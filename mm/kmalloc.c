@@ -17,7 +17,7 @@
    I want this number to be increased in the near future:
         loadable device drivers should use this function to get memory */
 
-#define MAX_KMALLOC_K 4
+#define MAX_KMALLOC_K ((PAGE_SIZE << (NR_MEM_LISTS-1)) >> 10)
 
 
 /* This defines how many times we should try to allocate a free page before
@@ -81,6 +81,7 @@ struct size_descriptor {
 	struct page_descriptor *firstfree;
 	int size;
 	int nblocks;
+	int gfporder;		/* the blocks come in 2^gfporder pages */
 
 	int nmallocs;
 	int nfrees;
@@ -89,21 +90,31 @@ struct size_descriptor {
 };
 
 
+/*
+ * Blocks bigger than a page get a multi-page area of their own: the page
+ * descriptor has to be in the same page as the block.
+ */
 struct size_descriptor sizes[] = { 
-	{ NULL,  32,127, 0,0,0,0 },
-	{ NULL,  64, 63, 0,0,0,0 },
-	{ NULL, 128, 31, 0,0,0,0 },
-	{ NULL, 252, 16, 0,0,0,0 },
-	{ NULL, 508,  8, 0,0,0,0 },
-	{ NULL,1020,  4, 0,0,0,0 },
-	{ NULL,2040,  2, 0,0,0,0 },
-	{ NULL,4080,  1, 0,0,0,0 },
-	{ NULL,   0,  0, 0,0,0,0 }
+	{ NULL,  32,127, 0, 0,0,0,0 },
+	{ NULL,  64, 63, 0, 0,0,0,0 },
+	{ NULL, 128, 31, 0, 0,0,0,0 },
+	{ NULL, 252, 16, 0, 0,0,0,0 },
+	{ NULL, 508,  8, 0, 0,0,0,0 },
+	{ NULL,1020,  4, 0, 0,0,0,0 },
+	{ NULL,2040,  2, 0, 0,0,0,0 },
+	{ NULL,4080,  1, 0, 0,0,0,0 },
+	{ NULL,8176,  1, 1, 0,0,0,0 },
+	{ NULL,16368, 1, 2, 0,0,0,0 },
+	{ NULL,32752, 1, 3, 0,0,0,0 },
+	{ NULL,65520, 1, 4, 0,0,0,0 },
+	{ NULL,131056,1, 5, 0,0,0,0 },
+	{ NULL,   0,  0, 0, 0,0,0,0 }
 };
 
 
 #define NBLOCKS(order)          (sizes[order].nblocks)
 #define BLOCKSIZE(order)        (sizes[order].size)
+#define AREASIZE(order)         (PAGE_SIZE << (sizes[order].gfporder))
 
 
 
@@ -118,12 +129,12 @@ long kmalloc_init (long start_mem,long end_mem)
 for (order = 0;BLOCKSIZE(order);order++)
     {
     if ((NBLOCKS (order)*BLOCKSIZE(order) + sizeof (struct page_descriptor)) >
-        PAGE_SIZE) 
+        AREASIZE(order)) 
         {
         printk ("Cannot use %d bytes out of %d in order = %d block mallocs\n",
                 NBLOCKS (order) * BLOCKSIZE(order) + 
                         sizeof (struct page_descriptor),
-                (int) PAGE_SIZE,
+                (int) AREASIZE(order),
                 BLOCKSIZE (order));
         panic ("This only happens if someone messes with kmalloc");
         }
@@ -161,7 +172,7 @@ void * kmalloc (size_t size, int priority)
 	}
 if (size > MAX_KMALLOC_K * 1024) 
      {
-     printk ("kmalloc: I refuse to allocate %d bytes (for now max = %d).\n",
+     printk ("kmalloc: I refuse to allocate %d bytes (for now max = %lu).\n",
                 size,MAX_KMALLOC_K*1024);
      return (NULL);
      }
@@ -213,7 +224,8 @@ while (tries --)
     sz = BLOCKSIZE(order); /* sz is the size of the blocks we're dealing with */
 
     /* This can be done with ints on: This is private to this invocation */
-    page = (struct page_descriptor *) __get_free_page (priority & GFP_LEVEL_MASK);
+    page = (struct page_descriptor *) __get_free_pages (priority & GFP_LEVEL_MASK,
+                                                        sizes[order].gfporder);
     if (!page) 
         {
         printk ("Couldn't get a free page.....\n");
@@ -335,7 +347,7 @@ if (page->nfree == NBLOCKS (page->order))
         else
             printk ("Ooops. page %p doesn't show on freelist.\n", page);
         }
-    free_page ((long)page);
+    free_pages ((long)page, sizes[order].gfporder);
     }
 restore_flags(flags);
 
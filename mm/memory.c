@@ -40,6 +40,7 @@
 #include <linux/types.h>
 #include <linux/ptrace.h>
 #include <linux/mman.h>
+#include <linux/shm.h>
 
 unsigned long high_memory = 0;
 
@@ -50,15 +51,6 @@ extern void die_if_kernel(char *,struct pt_regs *,long);
 
 int nr_swap_pages = 0;
 int nr_free_pages = 0;
-unsigned long free_page_list = 0;
-/*
- * The secondary free_page_list is used for malloc() etc things that
- * may need pages during interrupts etc. Normal get_free_page() operations
- * don't touch it, so it stays as a kind of "panic-list", that can be
- * accessed when all other mm tricks have failed.
- */
-int nr_secondary_pages = 0;
-unsigned long secondary_page_list = 0;
 
 #define copy_page(from,to) \
 __asm__("cld ; rep ; movsl": :"S" (from),"D" (to),"c" (1024):"cx","di","si")
@@ -94,6 +86,10 @@ static void free_one_table(unsigned long * page_dir)
 	}
 	if (mem_map[MAP_NR(pg_table)] & MAP_PAGE_RESERVED)
 		return;
+	if (mem_map[MAP_NR(pg_table)] > 1) {	/* still shared after fork() */
+		free_page(PAGE_MASK & pg_table);
+		return;
+	}
 	page_table = (unsigned long *) (pg_table & PAGE_MASK);
 	for (j = 0 ; j < PTRS_PER_PAGE ; j++,page_table++) {
 		unsigned long pg = *page_table;
@@ -143,6 +139,8 @@ void clear_page_tables(struct task_struct * tsk)
 			new_pg[i] = page_dir[i];
 		free_page(pg_dir);
 		tsk->tss.cr3 = (unsigned long) new_pg;
+		if (tsk == current)
+			__asm__ __volatile__("movl %0,%%cr3": :"a" (tsk->tss.cr3));
 		return;
 	}
 	for (i = 0 ; i < 768 ; i++,page_dir++)
@@ -201,10 +199,54 @@ int clone_page_tables(struct task_struct * tsk)
 	return 0;
 }
 
+static void copy_one_table(unsigned long * old_page_table, unsigned long * new_page_table)
+{
+	int j;
+
+	for (j = 0 ; j < PTRS_PER_PAGE ; j++,old_page_table++,new_page_table++) {
+		unsigned long pg;
+		pg = *old_page_table;
+		if (!pg)
+			continue;
+		if (!(pg & PAGE_PRESENT)) {
+			*new_page_table = swap_duplicate(pg);
+			continue;
+		}
+		if ((pg & (PAGE_RW | PAGE_COW)) == (PAGE_RW | PAGE_COW))
+			pg &= ~PAGE_RW;
+		*new_page_table = pg;
+		if (mem_map[MAP_NR(pg)] & MAP_PAGE_RESERVED)
+			continue;
+		*old_page_table = pg;
+		mem_map[MAP_NR(pg)]++;
+	}
+}
+
+/*
+ * Does one of the shared memory segments of the current process lie in
+ * the 4MB that page directory entry "i" maps?
+ */
+static int shm_in_table(int i)
+{
+	struct shm_desc * shmd;
+	unsigned long start = (unsigned long) i << 22;
+
+	for (shmd = current->shm ; shmd ; shmd = shmd->task_next)
+		if (shmd->start < start + (PAGE_SIZE << 10) && shmd->end > start)
+			return 1;
+	return 0;
+}
+
 /*
- * copy_page_tables() just copies the whole process memory range:
- * note the special handling of RESERVED (ie kernel) pages, which
- * means that they are always shared by all processes.
+ * copy_page_tables() copies the page directory, but not the page tables:
+ * the parent and the child share those, write-protected in the directory,
+ * until one of them wants to change one (see unshare_page_table()). A
+ * process that forks only to exec never copies a table at all.
+ *
+ * Tables with shared memory segments in them are copied at once, as
+ * shm_swap() wants one page table entry for every attach. Note also the
+ * special handling of RESERVED (ie kernel) pages, which means that they
+ * are always shared by all processes.
  */
 int copy_page_tables(struct task_struct * tsk)
 {
@@ -219,9 +261,7 @@ int copy_page_tables(struct task_struct * tsk)
 	old_page_dir = (unsigned long *) old_pg_dir;
 	new_page_dir = (unsigned long *) new_pg_dir;
 	for (i = 0 ; i < PTRS_PER_PAGE ; i++,old_page_dir++,new_page_dir++) {
-		int j;
-		unsigned long old_pg_table, *old_page_table;
-		unsigned long new_pg_table, *new_page_table;
+		unsigned long old_pg_table, new_pg_table;
 
 		old_pg_table = *old_page_dir;
 		if (!old_pg_table)
@@ -236,35 +276,63 @@ int copy_page_tables(struct task_struct * tsk)
 			*new_page_dir = old_pg_table;
 			continue;
 		}
-		if (!(new_pg_table = get_free_page(GFP_KERNEL))) {
-			free_page_tables(tsk);
-			return -ENOMEM;
-		}
-		old_page_table = (unsigned long *) (PAGE_MASK & old_pg_table);
-		new_page_table = (unsigned long *) (PAGE_MASK & new_pg_table);
-		for (j = 0 ; j < PTRS_PER_PAGE ; j++,old_page_table++,new_page_table++) {
-			unsigned long pg;
-			pg = *old_page_table;
-			if (!pg)
-				continue;
-			if (!(pg & PAGE_PRESENT)) {
-				*new_page_table = swap_duplicate(pg);
-				continue;
+		if (current->shm && shm_in_table(i)) {
+			if (!(new_pg_table = get_free_page(GFP_KERNEL))) {
+				free_page_tables(tsk);
+				return -ENOMEM;
 			}
-			if ((pg & (PAGE_RW | PAGE_COW)) == (PAGE_RW | PAGE_COW))
-				pg &= ~PAGE_RW;
-			*new_page_table = pg;
-			if (mem_map[MAP_NR(pg)] & MAP_PAGE_RESERVED)
-				continue;
-			*old_page_table = pg;
-			mem_map[MAP_NR(pg)]++;
+			copy_one_table((unsigned long *) (PAGE_MASK & *old_page_dir),
+				(unsigned long *) new_pg_table);
+			*new_page_dir = new_pg_table | PAGE_TABLE;
+			continue;
 		}
-		*new_page_dir = new_pg_table | PAGE_TABLE;
+		old_pg_table &= ~PAGE_RW;
+		*old_page_dir = old_pg_table;
+		*new_page_dir = old_pg_table;
+		mem_map[MAP_NR(old_pg_table)]++;
 	}
 	invalidate();
 	return 0;
 }
 
+/*
+ * Give a process its own copy of the page table behind "page_dir", if
+ * it still shares it with others after a fork(). Anybody who changes a
+ * page table entry for one process only has to call this first: swapping
+ * changes shared tables in place, as that is the same for all sharers.
+ * Returns 0 if out of memory.
+ */
+int unshare_page_table(unsigned long * page_dir)
+{
+	unsigned long pg_table, new_pg_table;
+
+repeat:
+	pg_table = *page_dir;
+	if ((pg_table & (PAGE_PRESENT | PAGE_RW)) != PAGE_PRESENT)
+		return 1;
+	if (pg_table >= high_memory || (mem_map[MAP_NR(pg_table)] & MAP_PAGE_RESERVED))
+		return 1;
+	if (mem_map[MAP_NR(pg_table)] == 1) {
+		*page_dir = pg_table | PAGE_RW;
+		invalidate();
+		return 1;
+	}
+	new_pg_table = get_free_page(GFP_KERNEL);
+	if (*page_dir != pg_table || mem_map[MAP_NR(pg_table)] == 1) {
+		if (new_pg_table)
+			free_page(new_pg_table);
+		goto repeat;
+	}
+	if (!new_pg_table)
+		return 0;
+	copy_one_table((unsigned long *) (PAGE_MASK & pg_table),
+		(unsigned long *) new_pg_table);
+	*page_dir = new_pg_table | PAGE_TABLE;
+	free_page(PAGE_MASK & pg_table);
+	invalidate();
+	return 1;
+}
+
 /*
  * a more complete version of free_page_tables which performs with page
  * granularity.
@@ -295,6 +363,18 @@ int unmap_page_range(unsigned long from, unsigned long size)
 			printk("unmap_page_range: bad page directory.");
 			continue;
 		}
+		if (pcnt == PTRS_PER_PAGE && !(page_dir & PAGE_RW) &&
+		    mem_map[MAP_NR(page_dir)] > 1) {
+			/* a shared table that goes away as a whole */
+			*dir = 0;
+			free_page(PAGE_MASK & page_dir);
+			continue;
+		}
+		if (!unshare_page_table(dir)) {
+			invalidate();
+			return -ENOMEM;
+		}
+		page_dir = *dir;
 		page_table = (unsigned long *)(PAGE_MASK & page_dir);
 		if (poff) {
 			page_table += poff;
@@ -332,6 +412,8 @@ int zeromap_page_range(unsigned long from, unsigned long size, int mask)
 			printk("zeromap_page_range: mask = %08x\n",mask);
 			return -EINVAL;
 		}
+		if (mask & PAGE_RW)	/* nobody may write to the zero page */
+			mask = (mask & ~PAGE_RW) | PAGE_COW;
 		mask |= ZERO_PAGE;
 	}
 	if (from & ~PAGE_MASK) {
@@ -356,8 +438,13 @@ int zeromap_page_range(unsigned long from, unsigned long size, int mask)
 				page_table = (unsigned long *)(PAGE_MASK & *dir++);
 			} else
 				*dir++ = ((unsigned long) page_table) | PAGE_TABLE;
-		} else
+		} else {
+			if (!unshare_page_table(dir)) {
+				invalidate();
+				return -ENOMEM;
+			}
 			page_table = (unsigned long *)(PAGE_MASK & *dir++);
+		}
 		page_table += poff;
 		poff = 0;
 		for (size -= pcnt; pcnt-- ;) {
@@ -415,8 +502,13 @@ int remap_page_range(unsigned long from, unsigned long to, unsigned long size, i
 			}
 			*dir++ = ((unsigned long) page_table) | PAGE_TABLE;
 		}
-		else
+		else {
+			if (!unshare_page_table(dir)) {
+				invalidate();
+				return -1;
+			}
 			page_table = (unsigned long *)(PAGE_MASK & *dir++);
+		}
 		if (poff) {
 			page_table += poff;
 			poff = 0;
@@ -479,9 +571,13 @@ unsigned long put_page(struct task_struct * tsk,unsigned long page,
 		return 0;
 	}
 	page_table = PAGE_DIR_OFFSET(tsk->tss.cr3,address);
-	if ((*page_table) & PAGE_PRESENT)
+	if ((*page_table) & PAGE_PRESENT) {
+		if (!unshare_page_table(page_table)) {
+			oom(tsk);
+			return 0;
+		}
 		page_table = (unsigned long *) (PAGE_MASK & *page_table);
-	else {
+	} else {
 		printk("put_page: bad page directory entry\n");
 		oom(tsk);
 		*page_table = BAD_PAGETABLE | PAGE_TABLE;
@@ -513,9 +609,11 @@ unsigned long put_dirty_page(struct task_struct * tsk, unsigned long page, unsig
 	if (mem_map[MAP_NR(page)] != 1)
 		printk("mem_map disagrees with %08lx at %08lx\n",page,address);
 	page_table = PAGE_DIR_OFFSET(tsk->tss.cr3,address);
-	if (PAGE_PRESENT & *page_table)
+	if (PAGE_PRESENT & *page_table) {
+		if (!unshare_page_table(page_table))
+			return 0;
 		page_table = (unsigned long *) (PAGE_MASK & *page_table);
-	else {
+	} else {
 		if (!(tmp = get_free_page(GFP_KERNEL)))
 			return 0;
 		if (PAGE_PRESENT & *page_table) {
@@ -577,7 +675,16 @@ static void __do_wp_page(unsigned long error_code, unsigned long address,
 		if (new_page) {
 			if (mem_map[MAP_NR(old_page)] & MAP_PAGE_RESERVED)
 				++tsk->rss;
-			copy_page(old_page,new_page);
+			if (old_page == ZERO_PAGE) {
+				unsigned long tmp = take_zeroed_page();
+
+				if (tmp) {
+					free_page(new_page);
+					new_page = tmp;
+				} else
+					memset((void *) new_page, 0, PAGE_SIZE);
+			} else
+				copy_page(old_page,new_page);
 			*(unsigned long *) pte = new_page | prot;
 			free_page(old_page);
 			invalidate();
@@ -624,6 +731,13 @@ void do_wp_page(unsigned long error_code, unsigned long address,
 	if (!page)
 		return;
 	if ((page & PAGE_PRESENT) && page < high_memory) {
+		if (!(page & PAGE_RW)) {
+			if (!unshare_page_table(pg_table)) {
+				oom(tsk);
+				return;
+			}
+			page = *pg_table;
+		}
 		pg_table = (unsigned long *) ((page & PAGE_MASK) + PAGE_PTR(address));
 		page = *pg_table;
 		if (!(page & PAGE_PRESENT))
@@ -664,10 +778,23 @@ int __verify_write(unsigned long start, unsigned long size)
 	return 0;
 }
 
-static inline void get_empty_page(struct task_struct * tsk, unsigned long address)
+/*
+ * Anonymous memory: a read fault maps the zero page copy-on-write, so
+ * that memory that is never written never uses any RAM. The page is only
+ * allocated on the first write, by do_wp_page(). Not on a 386, where a
+ * kernel write to user memory doesn't fault and would go straight into
+ * the zero page of every process.
+ */
+static inline void get_empty_page(struct task_struct * tsk, unsigned long address,
+	unsigned long error_code)
 {
 	unsigned long tmp;
 
+	if (!(error_code & PAGE_RW) && wp_works_ok) {
+		--tsk->rss;
+		put_page(tsk,ZERO_PAGE,address,PAGE_COPY);
+		return;
+	}
 	if (!(tmp = get_free_page(GFP_KERNEL))) {
 		oom(tsk);
 		tmp = BAD_PAGE;
@@ -700,6 +827,8 @@ static int try_to_share(unsigned long address, struct task_struct * tsk,
 
 	from_page = (unsigned long)PAGE_DIR_OFFSET(p->tss.cr3,address);
 	to_page = (unsigned long)PAGE_DIR_OFFSET(tsk->tss.cr3,address);
+	if (!unshare_page_table((unsigned long *) to_page))
+		return 0;
 /* is there a page-directory at from? */
 	from = *(unsigned long *) from_page;
 	if (!(from & PAGE_PRESENT))
@@ -824,7 +953,7 @@ void do_no_page(unsigned long error_code, unsigned long address,
 {
 	unsigned long tmp;
 	unsigned long page;
-	struct vm_area_struct * mpnt;
+	struct vm_area_struct * mpnt, * prev;
 
 	page = get_empty_pgtable(tsk,address);
 	if (!page)
@@ -838,20 +967,40 @@ void do_no_page(unsigned long error_code, unsigned long address,
 	if (tmp) {
 		++tsk->maj_flt;
 		swap_in((unsigned long *) page);
+		/* swap_in() makes the page writable: mprotect() may not want that */
+		mpnt = find_vma(tsk, address);
+		if (mpnt && address >= mpnt->vm_start &&
+		    !(mpnt->vm_page_prot & (PAGE_RW | PAGE_COW)) &&
+		    (*(unsigned long *) page & PAGE_PRESENT)) {
+			*(unsigned long *) page &= PAGE_MASK | PAGE_DIRTY;
+			*(unsigned long *) page |= mpnt->vm_page_prot;
+			invalidate();
+		}
 		return;
 	}
 	address &= 0xfffff000;
-	tmp = 0;
-	for (mpnt = tsk->mmap; mpnt != NULL; mpnt = mpnt->vm_next) {
-		if (address < mpnt->vm_start)
-			break;
-		if (address >= mpnt->vm_end) {
-			tmp = mpnt->vm_end;
-			continue;
+	mpnt = find_vma_prev(tsk, address, &prev);
+	tmp = prev ? prev->vm_end : 0;
+	if (mpnt && address >= mpnt->vm_start) {
+		if (!(mpnt->vm_page_prot & PAGE_USER)) {
+			if (error_code & 4)
+				goto bad_area;
+			/* the kernel may use it, but the user still can't */
+			++tsk->min_flt;
+			if (!(tmp = get_free_page(GFP_KERNEL))) {
+				oom(tsk);
+				return;
+			}
+			if (!put_page(tsk,tmp,address,PAGE_NONE))
+				free_page(tmp);
+			return;
 		}
+		if ((error_code & (PAGE_RW | 4)) == (PAGE_RW | 4) &&
+		    !(mpnt->vm_page_prot & (PAGE_RW | PAGE_COW)))
+			goto bad_area;
 		if (!mpnt->vm_ops || !mpnt->vm_ops->nopage) {
 			++tsk->min_flt;
-			get_empty_page(tsk,address);
+			get_empty_page(tsk,address,error_code);
 			return;
 		}
 		mpnt->vm_ops->nopage(error_code, mpnt, address);
@@ -867,6 +1016,7 @@ void do_no_page(unsigned long error_code, unsigned long address,
 		mpnt->vm_start = address;
 		goto ok_no_page;
 	}
+bad_area:
 	tsk->tss.cr2 = address;
 	current->tss.error_code = error_code;
 	current->tss.trap_no = 14;
@@ -875,7 +1025,7 @@ void do_no_page(unsigned long error_code, unsigned long address,
 		return;
 ok_no_page:
 	++tsk->min_flt;
-	get_empty_page(tsk,address);
+	get_empty_page(tsk,address,error_code);
 }
 
 /*
@@ -934,7 +1084,11 @@ asmlinkage void do_page_fault(struct pt_regs *regs, unsigned long error_code)
  * to point to BAD_PAGE entries.
  *
  * ZERO_PAGE is a special page that is used for zero-initialized
- * data and COW.
+ * data and COW. mem_init() clears it once the boot parameters in it
+ * have been used, and after that it is only ever mapped read-only.
+ * A 386 ignores write protection in kernel mode, though, so a put_fs_*
+ * that skipped verify_area() could still write to it: there it's
+ * cleared again every time, as it always used to be.
  */
 unsigned long __bad_pagetable(void)
 {
@@ -964,11 +1118,12 @@ unsigned long __zero_page(void)
 {
 	extern char empty_zero_page[PAGE_SIZE];
 
-	__asm__ __volatile__("cld ; rep ; stosl":
-		:"a" (0),
-		 "D" ((long) empty_zero_page),
-		 "c" (PTRS_PER_PAGE)
-		:"di","cx");
+	if (!wp_works_ok)
+		__asm__ __volatile__("cld ; rep ; stosl":
+			:"a" (0),
+			 "D" ((long) empty_zero_page),
+			 "c" (PTRS_PER_PAGE)
+			:"di","cx");
 	return (unsigned long) empty_zero_page;
 }
 
@@ -979,7 +1134,7 @@ void show_mem(void)
 
 	printk("Mem-info:\n");
 	printk("Free pages:      %6dkB\n",nr_free_pages<<(PAGE_SHIFT-10));
-	printk("Secondary pages: %6dkB\n",nr_secondary_pages<<(PAGE_SHIFT-10));
+	show_free_areas();
 	printk("Free swap:       %6dkB\n",nr_swap_pages<<(PAGE_SHIFT-10));
 	i = high_memory >> PAGE_SHIFT;
 	while (i-- > 0) {
@@ -1055,8 +1210,10 @@ void mem_init(unsigned long start_low_mem,
 	unsigned long tmp;
 	unsigned short * p;
 	extern int etext;
+	extern char empty_zero_page[PAGE_SIZE];
 
 	cli();
+	memset(empty_zero_page, 0, PAGE_SIZE);
 	end_mem &= PAGE_MASK;
 	high_memory = end_mem;
 	start_mem +=  0x0000000f;
@@ -1067,6 +1224,7 @@ void mem_init(unsigned long start_low_mem,
 	start_mem = (unsigned long) p;
 	while (p > mem_map)
 		*--p = MAP_PAGE_RESERVED;
+	start_mem = free_area_init(start_mem, end_mem);
 	start_low_mem = PAGE_ALIGN(start_low_mem);
 	start_mem = PAGE_ALIGN(start_mem);
 	while (start_low_mem < 0xA0000) {
@@ -1080,7 +1238,6 @@ void mem_init(unsigned long start_low_mem,
 #ifdef CONFIG_SOUND
 	sound_mem_init();
 #endif
-	free_page_list = 0;
 	nr_free_pages = 0;
 	for (tmp = 0 ; tmp < end_mem ; tmp += PAGE_SIZE) {
 		if (mem_map[MAP_NR(tmp)]) {
@@ -1092,9 +1249,8 @@ void mem_init(unsigned long start_low_mem,
 				datapages++;
 			continue;
 		}
-		*(unsigned long *) tmp = free_page_list;
-		free_page_list = tmp;
-		nr_free_pages++;
+		mem_map[MAP_NR(tmp)] = 1;
+		free_page(tmp);
 	}
 	tmp = nr_free_pages << PAGE_SHIFT;
 	printk("Memory: %luk/%luk available (%dk kernel code, %dk reserved, %dk data)\n",
@@ -1146,16 +1302,46 @@ void file_mmap_nopage(int error_code, struct vm_area_struct * area, unsigned lon
 {
 	struct inode * inode = area->vm_inode;
 	unsigned int block;
-	unsigned long page;
+	unsigned long page, cached, offset;
 	int nr[8];
 	int i, j;
 	int prot = area->vm_page_prot;
 
+	/*
+	 * Only a write to an area that may be written gets its own
+	 * writable copy: anything else is mapped read-only, and
+	 * do_wp_page() deals with the write when it faults again.
+	 */
+	if (!(prot & (PAGE_RW | PAGE_COW)))
+		error_code &= ~PAGE_RW;
 	address &= PAGE_MASK;
-	block = address - area->vm_start + area->vm_offset;
-	block >>= inode->i_sb->s_blocksize_bits;
+	offset = address - area->vm_start + area->vm_offset;
+	block = offset >> inode->i_sb->s_blocksize_bits;
 
 	page = get_free_page(GFP_KERNEL);
+	cached = find_page_cache(inode, offset);
+	if (cached) {
+		++area->vm_task->min_flt;
+		if (error_code & PAGE_RW) {
+			if (page)
+				copy_page(cached, page);
+			free_page(cached);
+			prot |= PAGE_RW | PAGE_DIRTY;
+		} else {
+			free_page(page);
+			page = cached;
+		}
+		if (!page) {
+			oom(current);
+			put_page(area->vm_task, BAD_PAGE, address, PAGE_PRIVATE);
+			return;
+		}
+		if (put_page(area->vm_task, page, address, prot))
+			return;
+		free_page(page);
+		oom(current);
+		return;
+	}
 	if (share_page(area, area->vm_task, inode, address, error_code, page)) {
 		++area->vm_task->min_flt;
 		return;
@@ -1176,6 +1362,7 @@ void file_mmap_nopage(int error_code, struct vm_area_struct * area, unsigned lon
 	if (!(prot & PAGE_RW)) {
 		if (share_page(area, area->vm_task, inode, address, error_code, page))
 			return;
+		add_page_cache(inode, offset, page);
 	}
 	if (put_page(area->vm_task,page,address,prot))
 		return;
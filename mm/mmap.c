@@ -19,6 +19,7 @@
 static int anon_map(struct inode *, struct file *,
 		    unsigned long, size_t, int,
 		    unsigned long);
+static void avl_remove(struct vm_area_struct *, struct vm_area_struct **);
 /*
  * description of effects of mapping type and prot in current implementation.
  * this is due to the current handling of page faults in memory.c. the expected
@@ -86,16 +87,10 @@ int do_mmap(struct file * file, unsigned long addr, unsigned long len,
 		/* Maybe this works.. Ugly it is. */
 		addr = SHM_RANGE_START;
 		while (addr+len < SHM_RANGE_END) {
-			for (vmm = current->mmap ; vmm ; vmm = vmm->vm_next) {
-				if (addr >= vmm->vm_end)
-					continue;
-				if (addr + len <= vmm->vm_start)
-					continue;
-				addr = PAGE_ALIGN(vmm->vm_end);
-				break;
-			}
-			if (!vmm)
+			vmm = find_vma(current, addr);
+			if (!vmm || addr + len <= vmm->vm_start)
 				break;
+			addr = PAGE_ALIGN(vmm->vm_end);
 		}
 		if (addr+len >= SHM_RANGE_END)
 			return -ENOMEM;
@@ -227,11 +222,6 @@ void unmap_fixup(struct vm_area_struct *area,
 }
 
 
-asmlinkage int sys_mprotect(unsigned long addr, size_t len, unsigned long prot)
-{
-	return -EINVAL; /* Not implemented yet */
-}
-
 asmlinkage int sys_munmap(unsigned long addr, size_t len)
 {
 	return do_munmap(addr, len);
@@ -245,7 +235,7 @@ asmlinkage int sys_munmap(unsigned long addr, size_t len)
  */
 int do_munmap(unsigned long addr, size_t len)
 {
-	struct vm_area_struct *mpnt, **npp, *free;
+	struct vm_area_struct *mpnt, *prev, **npp, *free;
 
 	if ((addr & ~PAGE_MASK) || addr > TASK_SIZE || len > TASK_SIZE-addr)
 		return -EINVAL;
@@ -259,21 +249,14 @@ int do_munmap(unsigned long addr, size_t len)
 	 * every area affected in some way (by any overlap) is put
 	 * on the list.  If nothing is put on, nothing is affected.
 	 */
-	npp = &current->mmap;
+	mpnt = find_vma_prev(current, addr, &prev);
+	npp = prev ? &prev->vm_next : &current->mmap;
 	free = NULL;
-	for (mpnt = *npp; mpnt != NULL; mpnt = *npp) {
-		unsigned long end = addr+len;
-
-		if ((addr < mpnt->vm_start && end <= mpnt->vm_start) ||
-		    (addr >= mpnt->vm_end && end > mpnt->vm_end))
-		{
-			npp = &mpnt->vm_next;
-			continue;
-		}
-
+	for ( ; mpnt != NULL && mpnt->vm_start < addr+len; mpnt = *npp) {
 		*npp = mpnt->vm_next;
 		mpnt->vm_next = free;
 		free = mpnt;
+		avl_remove(mpnt, &current->mmap_avl);
 	}
 
 	if (free == NULL)
@@ -340,17 +323,223 @@ int generic_mmap(struct inode * inode, struct file * file,
 	mpnt->vm_start = addr;
 	mpnt->vm_end = addr + len;
 	mpnt->vm_page_prot = prot;
+	mpnt->vm_flags = 0;
 	mpnt->vm_share = NULL;
 	mpnt->vm_inode = inode;
 	inode->i_count++;
 	mpnt->vm_offset = off;
 	mpnt->vm_ops = &file_mmap;
 	insert_vm_struct(current, mpnt);
-	merge_segments(current->mmap, NULL, NULL);
+	merge_segments(current, addr, addr + len, NULL, NULL);
 	
 	return 0;
 }
 
+/*
+ * The areas of a task are kept both on a list sorted by address (for
+ * everybody who wants to look at all of them) and in an AVL tree keyed
+ * on vm_start (for finding the one an address is in). The tree code is
+ * done without recursion: the places that point to the nodes on the way
+ * down are remembered on a stack, and rebalanced on the way back up.
+ */
+#define avl_maxheight	41	/* enough for any number of areas we can have */
+#define heightof(tree)	((tree) == NULL ? 0 : (tree)->vm_avl_height)
+
+static void avl_rebalance(struct vm_area_struct *** nodeplaces_ptr, int count)
+{
+	for ( ; count > 0 ; count--) {
+		struct vm_area_struct ** nodeplace = *--nodeplaces_ptr;
+		struct vm_area_struct * node = *nodeplace;
+		struct vm_area_struct * nodeleft = node->vm_avl_left;
+		struct vm_area_struct * noderight = node->vm_avl_right;
+		int heightleft = heightof(nodeleft);
+		int heightright = heightof(noderight);
+
+		if (heightright + 1 < heightleft) {
+			struct vm_area_struct * nodeleftleft = nodeleft->vm_avl_left;
+			struct vm_area_struct * nodeleftright = nodeleft->vm_avl_right;
+			int heightleftright = heightof(nodeleftright);
+
+			if (heightof(nodeleftleft) >= heightleftright) {
+				node->vm_avl_left = nodeleftright;
+				nodeleft->vm_avl_right = node;
+				nodeleft->vm_avl_height = 1 + (node->vm_avl_height = 1 + heightleftright);
+				*nodeplace = nodeleft;
+			} else {
+				nodeleft->vm_avl_right = nodeleftright->vm_avl_left;
+				node->vm_avl_left = nodeleftright->vm_avl_right;
+				nodeleftright->vm_avl_left = nodeleft;
+				nodeleftright->vm_avl_right = node;
+				nodeleft->vm_avl_height = node->vm_avl_height = heightleftright;
+				nodeleftright->vm_avl_height = heightleft;
+				*nodeplace = nodeleftright;
+			}
+		} else if (heightleft + 1 < heightright) {
+			struct vm_area_struct * noderightright = noderight->vm_avl_right;
+			struct vm_area_struct * noderightleft = noderight->vm_avl_left;
+			int heightrightleft = heightof(noderightleft);
+
+			if (heightof(noderightright) >= heightrightleft) {
+				node->vm_avl_right = noderightleft;
+				noderight->vm_avl_left = node;
+				noderight->vm_avl_height = 1 + (node->vm_avl_height = 1 + heightrightleft);
+				*nodeplace = noderight;
+			} else {
+				noderight->vm_avl_left = noderightleft->vm_avl_right;
+				node->vm_avl_right = noderightleft->vm_avl_left;
+				noderightleft->vm_avl_right = noderight;
+				noderightleft->vm_avl_left = node;
+				noderight->vm_avl_height = node->vm_avl_height = heightrightleft;
+				noderightleft->vm_avl_height = heightright;
+				*nodeplace = noderightleft;
+			}
+		} else {
+			int height = (heightleft < heightright ? heightright : heightleft) + 1;
+
+			if (height == node->vm_avl_height)
+				break;
+			node->vm_avl_height = height;
+		}
+	}
+}
+
+static void avl_insert(struct vm_area_struct * new_node, struct vm_area_struct ** ptree)
+{
+	unsigned long key = new_node->vm_start;
+	struct vm_area_struct ** nodeplace = ptree;
+	struct vm_area_struct ** stack[avl_maxheight];
+	struct vm_area_struct *** stack_ptr = &stack[0];
+	int stack_count = 0;
+
+	for (;;) {
+		struct vm_area_struct * node = *nodeplace;
+
+		if (node == NULL)
+			break;
+		*stack_ptr++ = nodeplace;
+		stack_count++;
+		if (key < node->vm_start)
+			nodeplace = &node->vm_avl_left;
+		else
+			nodeplace = &node->vm_avl_right;
+	}
+	new_node->vm_avl_left = NULL;
+	new_node->vm_avl_right = NULL;
+	new_node->vm_avl_height = 1;
+	*nodeplace = new_node;
+	avl_rebalance(stack_ptr, stack_count);
+}
+
+static void avl_remove(struct vm_area_struct * node_to_delete, struct vm_area_struct ** ptree)
+{
+	unsigned long key = node_to_delete->vm_start;
+	struct vm_area_struct ** nodeplace = ptree;
+	struct vm_area_struct ** stack[avl_maxheight];
+	struct vm_area_struct *** stack_ptr = &stack[0];
+	struct vm_area_struct ** nodeplace_to_delete;
+	int stack_count = 0;
+
+	for (;;) {
+		struct vm_area_struct * node = *nodeplace;
+
+		if (node == NULL) {
+			printk("avl_remove: area %08lx-%08lx not in tree\n",
+				node_to_delete->vm_start, node_to_delete->vm_end);
+			return;
+		}
+		*stack_ptr++ = nodeplace;
+		stack_count++;
+		if (node == node_to_delete)
+			break;
+		if (key < node->vm_start)
+			nodeplace = &node->vm_avl_left;
+		else
+			nodeplace = &node->vm_avl_right;
+	}
+	nodeplace_to_delete = nodeplace;
+	if (node_to_delete->vm_avl_left == NULL) {
+		*nodeplace_to_delete = node_to_delete->vm_avl_right;
+		stack_ptr--;
+		stack_count--;
+	} else {
+		struct vm_area_struct *** stack_ptr_to_delete = stack_ptr;
+		struct vm_area_struct * node;
+
+		/* the rightmost node on the left takes the place of the deleted one */
+		nodeplace = &node_to_delete->vm_avl_left;
+		for (;;) {
+			node = *nodeplace;
+			if (node->vm_avl_right == NULL)
+				break;
+			*stack_ptr++ = nodeplace;
+			stack_count++;
+			nodeplace = &node->vm_avl_right;
+		}
+		*nodeplace = node->vm_avl_left;
+		node->vm_avl_left = node_to_delete->vm_avl_left;
+		node->vm_avl_right = node_to_delete->vm_avl_right;
+		node->vm_avl_height = node_to_delete->vm_avl_height;
+		*nodeplace_to_delete = node;
+		*stack_ptr_to_delete = &node->vm_avl_left;
+	}
+	avl_rebalance(stack_ptr, stack_count);
+}
+
+/*
+ * Find the first area that ends above addr (the one addr is in, if any),
+ * and the one before it.
+ */
+struct vm_area_struct * find_vma_prev(struct task_struct * task, unsigned long addr,
+	struct vm_area_struct ** pprev)
+{
+	struct vm_area_struct * result = NULL, * prev = NULL, * tree;
+
+	for (tree = task->mmap_avl ; tree ; ) {
+		if (tree->vm_end > addr) {
+			result = tree;
+			if (tree->vm_start <= addr) {
+				for (tree = tree->vm_avl_left ; tree ; tree = tree->vm_avl_right)
+					prev = tree;
+				break;
+			}
+			tree = tree->vm_avl_left;
+		} else {
+			prev = tree;
+			tree = tree->vm_avl_right;
+		}
+	}
+	*pprev = prev;
+	return result;
+}
+
+struct vm_area_struct * find_vma(struct task_struct * task, unsigned long addr)
+{
+	struct vm_area_struct * result = NULL, * tree;
+
+	for (tree = task->mmap_avl ; tree ; ) {
+		if (tree->vm_end > addr) {
+			result = tree;
+			if (tree->vm_start <= addr)
+				break;
+			tree = tree->vm_avl_left;
+		} else
+			tree = tree->vm_avl_right;
+	}
+	return result;
+}
+
+/*
+ * Build the tree from the list, after fork() has copied it.
+ */
+void build_mmap_avl(struct task_struct * task)
+{
+	struct vm_area_struct * mpnt;
+
+	task->mmap_avl = NULL;
+	for (mpnt = task->mmap ; mpnt ; mpnt = mpnt->vm_next)
+		avl_insert(mpnt, &task->mmap_avl);
+}
+
 /*
  * Insert vm structure into process list
  * This makes sure the list is sorted by start address, and
@@ -359,45 +548,45 @@ int generic_mmap(struct inode * inode, struct file * file,
  */
 void insert_vm_struct(struct task_struct *t, struct vm_area_struct *vmp)
 {
-	struct vm_area_struct **nxtpp, *mpnt;
-
-	nxtpp = &t->mmap;
-	
-	for(mpnt = t->mmap; mpnt != NULL; mpnt = mpnt->vm_next)
-	{
-		if (mpnt->vm_start > vmp->vm_start)
-			break;
-		nxtpp = &mpnt->vm_next;
-
-		if ((vmp->vm_start >= mpnt->vm_start &&
-		     vmp->vm_start < mpnt->vm_end) ||
-		    (vmp->vm_end >= mpnt->vm_start &&
-		     vmp->vm_end < mpnt->vm_end))
-			printk("insert_vm_struct: ins area %lx-%lx in area %lx-%lx\n",
-			       vmp->vm_start, vmp->vm_end,
-			       mpnt->vm_start, vmp->vm_end);
+	struct vm_area_struct *prev, *mpnt;
+
+	mpnt = find_vma_prev(t, vmp->vm_start, &prev);
+	if (mpnt && mpnt->vm_start < vmp->vm_end)
+		printk("insert_vm_struct: ins area %lx-%lx in area %lx-%lx\n",
+		       vmp->vm_start, vmp->vm_end,
+		       mpnt->vm_start, mpnt->vm_end);
+	if (mpnt && mpnt->vm_start <= vmp->vm_start) {
+		prev = mpnt;
+		mpnt = mpnt->vm_next;
 	}
-	
-	vmp->vm_next = mpnt;
 
-	*nxtpp = vmp;
+	vmp->vm_next = mpnt;
+	if (prev)
+		prev->vm_next = vmp;
+	else
+		t->mmap = vmp;
+	avl_insert(vmp, &t->mmap_avl);
 }
 
 /*
- * Merge a list of memory segments if possible.
+ * Merge the areas around [start_addr, end_addr) if possible: the
+ * caller has just put a new one there.
  * Redundant vm_area_structs are freed.
- * This assumes that the list is ordered by address.
  */
-void merge_segments(struct vm_area_struct *mpnt,
-		    map_mergep_fnp mergep, void *mpd)
+void merge_segments(struct task_struct *task, unsigned long start_addr,
+		    unsigned long end_addr, map_mergep_fnp mergep, void *mpd)
 {
-	struct vm_area_struct *prev, *next;
+	struct vm_area_struct *prev, *mpnt, *next;
 
+	mpnt = find_vma_prev(task, start_addr, &prev);
 	if (mpnt == NULL)
 		return;
-	
-	for(prev = mpnt, mpnt = mpnt->vm_next;
-	    mpnt != NULL;
+	if (prev == NULL) {
+		prev = mpnt;
+		mpnt = mpnt->vm_next;
+	}
+
+	for ( ; mpnt != NULL && prev->vm_start < end_addr;
 	    prev = mpnt, mpnt = next)
 	{
 		int mp;
@@ -419,6 +608,7 @@ void merge_segments(struct vm_area_struct *mpnt,
 		 */
 		if (prev->vm_ops != mpnt->vm_ops ||
 		    prev->vm_page_prot != mpnt->vm_page_prot ||
+		    prev->vm_flags != mpnt->vm_flags ||
 		    prev->vm_inode != mpnt->vm_inode ||
 		    prev->vm_end != mpnt->vm_start ||
 		    !mp ||
@@ -431,6 +621,9 @@ void merge_segments(struct vm_area_struct *mpnt,
 		 * big segment can possibly merge with the next one.
 		 * The old unused mpnt is freed.
 		 */
+		avl_remove(mpnt, &task->mmap_avl);
+		if (task->stk_vma == mpnt)
+			task->stk_vma = prev;
 		prev->vm_end = mpnt->vm_end;
 		prev->vm_next = mpnt->vm_next;
 		kfree_s(mpnt, sizeof(*mpnt));
@@ -440,7 +633,8 @@ void merge_segments(struct vm_area_struct *mpnt,
 
 /*
  * Map memory not associated with any file into a process
- * address space.  Adjecent memory is merged.
+ * address space.  Adjecent memory is merged.  Nothing is mapped
+ * yet: do_no_page() fills in the pages as they are touched.
  */
 static int anon_map(struct inode *ino, struct file * file,
 		    unsigned long addr, size_t len, int mask,
@@ -448,9 +642,6 @@ static int anon_map(struct inode *ino, struct file * file,
 {
   	struct vm_area_struct * mpnt;
 
-	if (zeromap_page_range(addr, len, mask))
-		return -ENOMEM;
-
 	mpnt = (struct vm_area_struct * ) kmalloc(sizeof(struct vm_area_struct), GFP_KERNEL);
 	if (!mpnt)
 		return -ENOMEM;
@@ -459,12 +650,13 @@ static int anon_map(struct inode *ino, struct file * file,
 	mpnt->vm_start = addr;
 	mpnt->vm_end = addr + len;
 	mpnt->vm_page_prot = mask;
+	mpnt->vm_flags = (mask & (PAGE_RW | PAGE_COW)) == PAGE_RW ? VM_SHARED : 0;
 	mpnt->vm_share = NULL;
 	mpnt->vm_inode = NULL;
 	mpnt->vm_offset = 0;
 	mpnt->vm_ops = NULL;
 	insert_vm_struct(current, mpnt);
-	merge_segments(current->mmap, ignoff_mergep, NULL);
+	merge_segments(current, addr, addr + len, ignoff_mergep, NULL);
 
 	return 0;
 }
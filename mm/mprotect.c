@@ -0,0 +1,161 @@
+/*
+ *  linux/mm/mprotect.c
+ *
+ *  Changing the protection of mapped areas.
+ */
+
+/*
+ * The areas affected are split where the range starts and ends in the
+ * middle of one, and the page table entries that are there already get
+ * their new protection in place: nothing has to be faulted in again.
+ * Entries that aren't present are left alone, do_no_page() looks at the
+ * area when they are touched.
+ *
+ * Private areas that become writable get PAGE_COPY, as always: pages
+ * that nobody else uses are made writable right away, the others are
+ * copied on the first write. PROT_NONE is PAGE_NONE: present for the
+ * kernel, but not for the user.
+ */
+
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/mman.h>
+#include <linux/malloc.h>
+
+#include <asm/system.h>
+
+static int change_protection(unsigned long start, unsigned long end, int prot)
+{
+	unsigned long *dir, *page_table, pte, page;
+
+	while (start < end) {
+		dir = PAGE_DIR_OFFSET(current->tss.cr3,start);
+		if (!(*dir & PAGE_PRESENT)) {
+			start = (start + (PAGE_SIZE << 10)) & ~((PAGE_SIZE << 10) - 1);
+			continue;
+		}
+		if (!unshare_page_table(dir)) {
+			invalidate();
+			return -ENOMEM;
+		}
+		page_table = (unsigned long *) (PAGE_MASK & *dir);
+		page_table += (start >> PAGE_SHIFT) & (PTRS_PER_PAGE-1);
+		do {
+			pte = *page_table;
+			if (pte & PAGE_PRESENT) {
+				page = pte & PAGE_MASK;
+				pte = (pte & (PAGE_MASK | PAGE_DIRTY)) | prot;
+				if ((prot & PAGE_COW) && page < high_memory &&
+				    mem_map[MAP_NR(page)] == 1)
+					pte |= PAGE_RW;
+				*page_table = pte;
+			}
+			page_table++;
+			start += PAGE_SIZE;
+		} while (start < end && ((start >> PAGE_SHIFT) & (PTRS_PER_PAGE-1)));
+	}
+	invalidate();
+	return 0;
+}
+
+static int mprotect_fixup(struct vm_area_struct * vma,
+	unsigned long start, unsigned long end, unsigned long prot)
+{
+	struct vm_area_struct * left = NULL, * right = NULL;
+	int newprot;
+
+	if (!(prot & (PROT_READ | PROT_WRITE | PROT_EXEC)))
+		newprot = PAGE_NONE;
+	else if (!(prot & PROT_WRITE))
+		newprot = PAGE_READONLY;
+	else if (vma->vm_flags & VM_SHARED)
+		newprot = PAGE_SHARED;
+	else
+		newprot = PAGE_COPY;
+	if (newprot == vma->vm_page_prot)
+		return 0;
+
+	/* get the memory first, so that a failure changes nothing */
+	if (start > vma->vm_start) {
+		left = (struct vm_area_struct *) kmalloc(sizeof(*left), GFP_KERNEL);
+		if (!left)
+			return -ENOMEM;
+	}
+	if (end < vma->vm_end) {
+		right = (struct vm_area_struct *) kmalloc(sizeof(*right), GFP_KERNEL);
+		if (!right) {
+			if (left)
+				kfree_s(left, sizeof(*left));
+			return -ENOMEM;
+		}
+	}
+
+	/*
+	 * The original area stays the lowest part, so that stk_vma and
+	 * the tree keep pointing at the right thing: "left" takes over
+	 * the changed range, and "right" what is above it.
+	 */
+	if (right) {
+		*right = *vma;
+		right->vm_start = end;
+		right->vm_offset += end - vma->vm_start;
+		if (right->vm_inode)
+			right->vm_inode->i_count++;
+		vma->vm_end = end;
+	}
+	if (left) {
+		*left = *vma;
+		left->vm_start = start;
+		left->vm_offset += start - vma->vm_start;
+		left->vm_page_prot = newprot;
+		if (left->vm_inode)
+			left->vm_inode->i_count++;
+		vma->vm_end = start;
+	} else
+		vma->vm_page_prot = newprot;
+	if (right)
+		insert_vm_struct(current, right);
+	if (left)
+		insert_vm_struct(current, left);
+	return change_protection(start, end, newprot);
+}
+
+asmlinkage int sys_mprotect(unsigned long start, size_t len, unsigned long prot)
+{
+	unsigned long end, tmp;
+	struct vm_area_struct * vma, * next;
+	int error;
+
+	if ((start & ~PAGE_MASK) || start > TASK_SIZE || len > TASK_SIZE-start)
+		return -EINVAL;
+	if (prot & ~(PROT_READ | PROT_WRITE | PROT_EXEC))
+		return -EINVAL;
+	len = PAGE_ALIGN(len);
+	end = start + len;
+	if (end == start)
+		return 0;
+
+	/* the whole range has to be mapped */
+	vma = find_vma(current, start);
+	for (next = vma, tmp = start ; ; next = next->vm_next) {
+		if (!next || next->vm_start > tmp)
+			return -EFAULT;
+		if (next->vm_end >= end)
+			break;
+		tmp = next->vm_end;
+	}
+
+	for (tmp = start ; ; vma = next) {
+		unsigned long stop = vma->vm_end < end ? vma->vm_end : end;
+
+		next = vma->vm_next;
+		error = mprotect_fixup(vma, tmp, stop, prot);
+		if (error || stop >= end)
+			break;
+		tmp = stop;
+	}
+	merge_segments(current, start, end, NULL, NULL);
+	return error;
+}
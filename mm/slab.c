@@ -0,0 +1,284 @@
+/*
+ *  linux/mm/slab.c
+ *
+ *  Object caches for fixed-size kernel structures.
+ */
+
+/*
+ * A cache hands out objects of one size from "slabs": single pages that
+ * start with a struct kmem_slab, followed by an array of free-list links
+ * and the objects themselves. A slab is on one of three lists of its
+ * cache: full, partial or empty. Allocations come from partial slabs
+ * first, so that empty ones can be given back when memory gets tight.
+ *
+ * The free list of a slab is kept in the link array rather than in the
+ * objects, so an object that has been freed is still in the state the
+ * constructor left it in, and the constructor is only run when a slab
+ * is created.
+ *
+ * The space left over at the end of a slab is used to "colour" it: the
+ * objects of consecutive slabs start at different offsets, so that the
+ * same fields of objects in different slabs don't all compete for the
+ * same cache lines.
+ *
+ * Like kmalloc() all of this can be called with interrupts off and from
+ * interrupts (with GFP_ATOMIC).
+ */
+
+#include <linux/mm.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/malloc.h>
+#include <linux/slab.h>
+#include <asm/system.h>
+
+#define SLAB_MAGIC	0xf1ab51ab	/* never a valid kmalloc() page link */
+#define SLAB_ALIGN	sizeof(long)	/* default object alignment */
+#define L1_CACHE_BYTES	16
+
+struct kmem_slab {
+	unsigned long s_magic;
+	struct kmem_cache * s_cache;
+	struct kmem_slab * s_next;
+	struct kmem_slab * s_prev;
+	struct kmem_slab ** s_list;	/* which list of the cache it is on */
+	int s_inuse;
+	int s_offset;			/* of the first object */
+	int s_free;			/* first free object, -1 if none */
+};
+
+#define SLAB_OF(objp)	((struct kmem_slab *) ((unsigned long) (objp) & PAGE_MASK))
+#define SLAB_LINKS(s)	((short *) ((s) + 1))
+#define SLAB_OBJ(c,s,i)	((void *) ((char *) (s) + (s)->s_offset + (i) * (c)->objsize))
+
+static struct kmem_cache * cache_chain = NULL;
+
+static void slab_unlink(struct kmem_slab * slab)
+{
+	if (slab->s_next)
+		slab->s_next->s_prev = slab->s_prev;
+	if (slab->s_prev)
+		slab->s_prev->s_next = slab->s_next;
+	else
+		*slab->s_list = slab->s_next;
+	slab->s_list = NULL;
+}
+
+static void slab_link(struct kmem_slab * slab, struct kmem_slab ** list)
+{
+	slab->s_list = list;
+	slab->s_prev = NULL;
+	if ((slab->s_next = *list) != NULL)
+		slab->s_next->s_prev = slab;
+	*list = slab;
+}
+
+/*
+ * Put a slab on the list that goes with the number of objects in use.
+ */
+static inline void slab_refile(struct kmem_cache * cachep, struct kmem_slab * slab)
+{
+	struct kmem_slab ** list;
+
+	if (!slab->s_inuse)
+		list = &cachep->empty;
+	else if (slab->s_inuse == cachep->num)
+		list = &cachep->full;
+	else
+		list = &cachep->partial;
+	if (slab->s_list != list) {
+		slab_unlink(slab);
+		slab_link(slab, list);
+	}
+}
+
+struct kmem_cache * kmem_cache_create(char * name, int size, int align,
+	void (*ctor)(void *, int))
+{
+	struct kmem_cache * cachep;
+	int left;
+
+	if (align <= 0)
+		align = SLAB_ALIGN;
+	size = (size + align - 1) & ~(align - 1);
+	if (size <= 0 || size + sizeof(struct kmem_slab) + sizeof(short) > PAGE_SIZE) {
+		printk("kmem_cache_create: bad object size %d for %s\n", size, name);
+		return NULL;
+	}
+	cachep = (struct kmem_cache *) kmalloc(sizeof(*cachep), GFP_KERNEL);
+	if (!cachep)
+		return NULL;
+	memset(cachep, 0, sizeof(*cachep));
+	cachep->name = name;
+	cachep->objsize = size;
+	cachep->ctor = ctor;
+	cachep->num = (PAGE_SIZE - sizeof(struct kmem_slab)) / (size + sizeof(short));
+	cachep->offset = sizeof(struct kmem_slab) + cachep->num * sizeof(short);
+	cachep->offset = (cachep->offset + align - 1) & ~(align - 1);
+	while (cachep->offset + cachep->num * size > PAGE_SIZE) {
+		cachep->num--;
+		cachep->offset = sizeof(struct kmem_slab) + cachep->num * sizeof(short);
+		cachep->offset = (cachep->offset + align - 1) & ~(align - 1);
+	}
+	cachep->colour_off = (align > L1_CACHE_BYTES) ? align : L1_CACHE_BYTES;
+	left = PAGE_SIZE - cachep->offset - cachep->num * size;
+	cachep->colour = left / cachep->colour_off + 1;
+	cachep->next = cache_chain;
+	cache_chain = cachep;
+	return cachep;
+}
+
+/*
+ * Add an empty slab to the cache. Interrupts must be on or off the same
+ * way on the way out as on the way in, they may be enabled in between.
+ */
+static int kmem_cache_grow(struct kmem_cache * cachep, int priority)
+{
+	struct kmem_slab * slab;
+	unsigned long flags;
+	short * links;
+	int i;
+
+	slab = (struct kmem_slab *) __get_free_page(priority);
+	if (!slab)
+		return 0;
+	slab->s_magic = SLAB_MAGIC;
+	slab->s_cache = cachep;
+	slab->s_inuse = 0;
+	save_flags(flags);
+	cli();
+	slab->s_offset = cachep->offset + cachep->colour_next * cachep->colour_off;
+	if (++cachep->colour_next >= cachep->colour)
+		cachep->colour_next = 0;
+	restore_flags(flags);
+	links = SLAB_LINKS(slab);
+	for (i = 0 ; i < cachep->num ; i++) {
+		links[i] = i + 1;
+		if (cachep->ctor)
+			cachep->ctor(SLAB_OBJ(cachep, slab, i), cachep->objsize);
+	}
+	links[cachep->num - 1] = -1;
+	slab->s_free = 0;
+	cli();
+	slab_link(slab, &cachep->empty);
+	cachep->slabs++;
+	cachep->grown++;
+	restore_flags(flags);
+	return 1;
+}
+
+void * kmem_cache_alloc(struct kmem_cache * cachep, int priority)
+{
+	struct kmem_slab * slab;
+	unsigned long flags;
+	void * objp;
+	extern unsigned long intr_count;
+
+	if (intr_count && priority != GFP_ATOMIC) {
+		printk("kmem_cache_alloc called nonatomically from interrupt %08lx\n",
+			((unsigned long *)&cachep)[-1]);
+		priority = GFP_ATOMIC;
+	}
+	save_flags(flags);
+	cli();
+	while (!(slab = cachep->partial) && !(slab = cachep->empty)) {
+		restore_flags(flags);
+		if (!kmem_cache_grow(cachep, priority))
+			return NULL;
+		cli();
+	}
+	objp = SLAB_OBJ(cachep, slab, slab->s_free);
+	slab->s_free = SLAB_LINKS(slab)[slab->s_free];
+	slab->s_inuse++;
+	slab_refile(cachep, slab);
+	cachep->active++;
+	cachep->allocs++;
+	restore_flags(flags);
+	return objp;
+}
+
+void kmem_cache_free(struct kmem_cache * cachep, void * objp)
+{
+	struct kmem_slab * slab;
+	unsigned long flags;
+	int i;
+
+	slab = SLAB_OF(objp);
+	if (slab->s_magic != SLAB_MAGIC || slab->s_cache != cachep) {
+		printk("kmem_cache_free: %p not from cache %s\n", objp, cachep->name);
+		return;
+	}
+	i = ((char *) objp - (char *) slab - slab->s_offset) / cachep->objsize;
+	save_flags(flags);
+	cli();
+	SLAB_LINKS(slab)[i] = slab->s_free;
+	slab->s_free = i;
+	slab->s_inuse--;
+	slab_refile(cachep, slab);
+	cachep->active--;
+	restore_flags(flags);
+}
+
+/*
+ * Give the pages of all empty slabs back. Returns the number of pages
+ * freed.
+ */
+int kmem_cache_shrink(struct kmem_cache * cachep)
+{
+	struct kmem_slab * slab;
+	unsigned long flags;
+	int freed = 0;
+
+	save_flags(flags);
+	cli();
+	while ((slab = cachep->empty) != NULL) {
+		slab_unlink(slab);
+		slab->s_magic = 0;
+		cachep->slabs--;
+		cachep->reaped++;
+		free_page((unsigned long) slab);
+		freed++;
+	}
+	restore_flags(flags);
+	return freed;
+}
+
+/*
+ * Which cache an object came from: NULL for kmalloc() memory, so that
+ * code that is handed both kinds can tell them apart.
+ */
+struct kmem_cache * kmem_find_cache(void * objp)
+{
+	struct kmem_slab * slab = SLAB_OF(objp);
+
+	if (slab->s_magic != SLAB_MAGIC)
+		return NULL;
+	return slab->s_cache;
+}
+
+/*
+ * Called by try_to_free_page(): free the empty slabs of all caches.
+ */
+int kmem_cache_reap(void)
+{
+	struct kmem_cache * cachep;
+	int freed = 0;
+
+	for (cachep = cache_chain ; cachep ; cachep = cachep->next)
+		freed += kmem_cache_shrink(cachep);
+	return freed;
+}
+
+int get_slabinfo(char * buffer)
+{
+	struct kmem_cache * cachep;
+	int len;
+
+	len = sprintf(buffer, "name          active  size slabs  objs  allocs grown reaped\n");
+	for (cachep = cache_chain ; cachep ; cachep = cachep->next)
+		len += sprintf(buffer+len, "%-12s %7lu %5d %5lu %5lu %7lu %5lu %6lu\n",
+			cachep->name, cachep->active, cachep->objsize,
+			cachep->slabs, cachep->slabs * cachep->num,
+			cachep->allocs, cachep->grown, cachep->reaped);
+	return len;
+}
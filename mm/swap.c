@@ -17,6 +17,8 @@
 #include <linux/errno.h>
 #include <linux/string.h>
 #include <linux/stat.h>
+#include <linux/slab.h>
+#include <linux/locks.h>
 
 #include <asm/system.h> /* for cli()/sti() */
 #include <asm/bitops.h>
@@ -30,9 +32,22 @@
 #define SWP_OFFSET(entry) ((entry) >> PAGE_SHIFT)
 #define SWP_ENTRY(type,offset) (((type) << 1) | ((offset) << PAGE_SHIFT))
 
+/*
+ * Swap space is handed out in clusters of SWAP_CLUSTER pages, so that the
+ * pages swap_out() takes from one process in a row end up next to each
+ * other. Clusters with no slot in use are kept on a free list.
+ */
+#define SWAP_CLUSTER	32
+
 static int nr_swapfiles = 0;
 static struct wait_queue * lock_queue = NULL;
 
+struct swap_cluster {
+	unsigned short count;		/* slots in use (or bad) */
+	unsigned short listed;		/* on the free cluster list */
+	int next;
+};
+
 static struct swap_info_struct {
 	unsigned long flags;
 	struct inode * swap_file;
@@ -43,9 +58,12 @@ static struct swap_info_struct {
 	int lowest_bit;
 	int highest_bit;
 	unsigned long max;
+	struct swap_cluster * clusters;
+	int free_cluster;		/* first free cluster, -1 if none */
+	int cluster_next;		/* next slot of the current cluster */
+	int cluster_nr;			/* slots left in it */
 } swap_info[MAX_SWAPFILES];
 
-extern unsigned long free_page_list;
 extern int shm_swap (int);
 
 /*
@@ -55,6 +73,11 @@ extern int shm_swap (int);
 #define NR_LAST_FREE_PAGES 32
 static unsigned long last_free_pages[NR_LAST_FREE_PAGES] = {0,};
 
+/*
+ * try_to_free_page() makes this many passes, each one less gentle.
+ */
+#define SWAP_PRIORITIES	6
+
 void rw_swap_page(int rw, unsigned long entry, char * buf)
 {
 	unsigned long type, offset;
@@ -103,6 +126,173 @@ void rw_swap_page(int rw, unsigned long entry, char * buf)
 	wake_up(&lock_queue);
 }
 
+static inline void add_free_cluster(struct swap_info_struct * p, int nr)
+{
+	p->clusters[nr].listed = 1;
+	p->clusters[nr].next = p->free_cluster;
+	p->free_cluster = nr;
+}
+
+/*
+ * Clusters aren't taken off the free list when a slot in them is handed
+ * out by the linear scan below: they are just skipped here instead.
+ */
+static inline int get_free_cluster(struct swap_info_struct * p)
+{
+	int nr;
+
+	while ((nr = p->free_cluster) >= 0) {
+		p->free_cluster = p->clusters[nr].next;
+		p->clusters[nr].listed = 0;
+		if (!p->clusters[nr].count)
+			return nr;
+	}
+	return -1;
+}
+
+static int scan_swap_map(struct swap_info_struct * p)
+{
+	int offset, nr;
+
+	for (;;) {
+		while (p->cluster_nr) {
+			p->cluster_nr--;
+			offset = p->cluster_next++;
+			if (offset < p->max && !p->swap_map[offset])
+				goto got_slot;
+		}
+		if ((nr = get_free_cluster(p)) < 0)
+			break;
+		p->cluster_next = nr * SWAP_CLUSTER;
+		p->cluster_nr = SWAP_CLUSTER;
+	}
+	/* no free cluster left: take the first free slot there is */
+	for (offset = p->lowest_bit; offset <= p->highest_bit ; offset++) {
+		if (p->swap_map[offset])
+			continue;
+		p->lowest_bit = offset;
+		goto got_slot;
+	}
+	return 0;
+got_slot:
+	p->swap_map[offset] = 1;
+	p->clusters[offset / SWAP_CLUSTER].count++;
+	nr_swap_pages--;
+	if (offset == p->highest_bit)
+		p->highest_bit--;
+	if (offset == p->lowest_bit)
+		p->lowest_bit++;
+	return offset;
+}
+
+/*
+ * swap_out() doesn't write the pages it takes one at a time: they are
+ * queued here, and try_to_free_page() writes them all with one
+ * ll_rw_swap_batch() call, so that a run of neighbouring slots goes to
+ * the disk as a few large requests. A slot is locked from the moment it
+ * is queued, so anybody who wants it back waits for the write.
+ */
+#define SWAP_BATCH	16
+#define SWAP_BATCH_BH	(SWAP_BATCH * (PAGE_SIZE / BLOCK_SIZE))
+
+static unsigned long batch_entry[SWAP_BATCH];
+static unsigned long batch_page[SWAP_BATCH];
+static int batch_nr = 0;
+static int batch_busy = 0;		/* being written: don't queue */
+static struct buffer_head batch_bh[SWAP_BATCH_BH];
+
+static inline int swap_batch_open(void)
+{
+	return !batch_busy && batch_nr < SWAP_BATCH;
+}
+
+/*
+ * Returns 0 if the page can't be queued, and has to be written at once.
+ */
+static int queue_swap_page(unsigned long entry, unsigned long page)
+{
+	if (!swap_batch_open())
+		return 0;
+	if (set_bit(SWP_OFFSET(entry), swap_info[SWP_TYPE(entry)].swap_lockmap))
+		return 0;
+	batch_entry[batch_nr] = entry;
+	batch_page[batch_nr++] = page;
+	return 1;
+}
+
+static void write_swap_batch(struct buffer_head * bh[], int nr)
+{
+	int i;
+
+	if (!nr)
+		return;
+	ll_rw_swap_batch(WRITE, nr, bh);
+	for (i = 0 ; i < nr ; i++) {
+		wait_on_buffer(bh[i]);
+		if (!bh[i]->b_uptodate)
+			printk("write_swap_batch: I/O error on dev %04x block %lu\n",
+				bh[i]->b_dev, bh[i]->b_blocknr);
+	}
+}
+
+static void flush_swap_batch(void)
+{
+	struct swap_info_struct * p;
+	struct buffer_head * bh[SWAP_BATCH_BH], * tmp;
+	unsigned long offset, block;
+	int i, j, nr, size;
+	dev_t dev;
+
+	if (batch_busy || !batch_nr)
+		return;
+	batch_busy = 1;
+	nr = 0;
+	for (i = 0 ; i < batch_nr ; i++) {
+		p = swap_info + SWP_TYPE(batch_entry[i]);
+		offset = SWP_OFFSET(batch_entry[i]);
+		if (p->swap_device) {
+			dev = p->swap_device;
+			size = PAGE_SIZE;
+			block = offset;
+		} else {
+			dev = p->swap_file->i_dev;
+			size = p->swap_file->i_sb->s_blocksize;
+			block = offset << (PAGE_SHIFT - p->swap_file->i_sb->s_blocksize_bits);
+		}
+		if (nr + PAGE_SIZE / size > SWAP_BATCH_BH || (nr && bh[0]->b_dev != dev)) {
+			write_swap_batch(bh, nr);
+			nr = 0;
+		}
+		for (j = 0 ; j < PAGE_SIZE ; j += size, block++) {
+			tmp = batch_bh + nr;
+			memset(tmp, 0, sizeof(*tmp));
+			tmp->b_data = (char *) batch_page[i] + j;
+			tmp->b_size = size;
+			tmp->b_dev = dev;
+			tmp->b_count = 1;
+			tmp->b_dirt = 1;
+			tmp->b_uptodate = 1;
+			tmp->b_blocknr = block;
+			if (!p->swap_device && !(tmp->b_blocknr = bmap(p->swap_file, block))) {
+				printk("flush_swap_batch: bad swap file\n");
+				continue;
+			}
+			bh[nr++] = tmp;
+		}
+	}
+	write_swap_batch(bh, nr);
+	for (i = 0 ; i < batch_nr ; i++) {
+		p = swap_info + SWP_TYPE(batch_entry[i]);
+		if (!clear_bit(SWP_OFFSET(batch_entry[i]), p->swap_lockmap))
+			printk("flush_swap_batch: lock already cleared\n");
+		free_page(batch_page[i]);
+		kstat.pswpout++;
+	}
+	batch_nr = 0;
+	batch_busy = 0;
+	wake_up(&lock_queue);
+}
+
 unsigned int get_swap_page(void)
 {
 	struct swap_info_struct * p;
@@ -112,16 +302,9 @@ unsigned int get_swap_page(void)
 	for (type = 0 ; type < nr_swapfiles ; type++,p++) {
 		if ((p->flags & SWP_WRITEOK) != SWP_WRITEOK)
 			continue;
-		for (offset = p->lowest_bit; offset <= p->highest_bit ; offset++) {
-			if (p->swap_map[offset])
-				continue;
-			p->swap_map[offset] = 1;
-			nr_swap_pages--;
-			if (offset == p->highest_bit)
-				p->highest_bit--;
-			p->lowest_bit = offset;
+		offset = scan_swap_map(p);
+		if (offset)
 			return SWP_ENTRY(type,offset);
-		}
 	}
 	return 0;
 }
@@ -154,10 +337,215 @@ unsigned long swap_duplicate(unsigned long entry)
 	return entry;
 }
 
+/*
+ * Swap readahead: a fault on a swap entry reads the whole aligned window
+ * of SWAP_READAHEAD slots around it in one batch, and the pages nobody
+ * has asked for yet wait in a small swap cache for the faults that are
+ * likely to follow. An entry is dropped when its slot is freed, and idle
+ * ones are given back by try_to_free_page().
+ */
+#define SWAP_READAHEAD	8
+#define SWAP_CACHE_SIZE	16
+#define SWAP_CACHE_BH	(PAGE_SIZE / BLOCK_SIZE)
+
+static struct swap_cache_entry {
+	unsigned long entry;		/* 0 if unused */
+	unsigned long page;
+	int busy;			/* the reads are still being queued */
+	int nr_bh;
+	struct buffer_head bh[SWAP_CACHE_BH];
+} swap_cache[SWAP_CACHE_SIZE];
+
+static struct wait_queue * swap_cache_wait = NULL;
+static int swap_cache_next = 0;
+
+static struct swap_cache_entry * find_swap_cache(unsigned long entry)
+{
+	struct swap_cache_entry * sc;
+
+	for (sc = swap_cache ; sc < swap_cache + SWAP_CACHE_SIZE ; sc++)
+		if (sc->entry == entry)
+			return sc;
+	return NULL;
+}
+
+static int swap_cache_locked(struct swap_cache_entry * sc)
+{
+	int i;
+
+	if (sc->busy)
+		return 1;
+	for (i = 0 ; i < sc->nr_bh ; i++)
+		if (sc->bh[i].b_lock)
+			return 1;
+	return 0;
+}
+
+/*
+ * Wait for the cached copy of "entry" to be read in, and take it out of
+ * the cache. Returns 0 if there is none, or it couldn't be read.
+ */
+static unsigned long take_swap_cache(unsigned long entry)
+{
+	struct swap_cache_entry * sc;
+	unsigned long page;
+	int i, uptodate;
+
+repeat:
+	if (!(sc = find_swap_cache(entry)))
+		return 0;
+	if (sc->busy) {
+		sleep_on(&swap_cache_wait);
+		goto repeat;
+	}
+	uptodate = 1;
+	for (i = 0 ; i < sc->nr_bh ; i++) {
+		if (sc->bh[i].b_lock) {
+			wait_on_buffer(sc->bh + i);
+			goto repeat;
+		}
+		uptodate &= sc->bh[i].b_uptodate;
+	}
+	page = sc->page;
+	sc->entry = 0;
+	sc->page = 0;
+	if (!uptodate) {
+		free_page(page);
+		return 0;
+	}
+	return page;
+}
+
+/*
+ * Find a free cache entry, giving back the page of an idle one if there
+ * is none. Returns NULL if all of them are being read.
+ */
+static struct swap_cache_entry * get_swap_cache(void)
+{
+	struct swap_cache_entry * sc;
+	int i;
+
+	for (sc = swap_cache ; sc < swap_cache + SWAP_CACHE_SIZE ; sc++)
+		if (!sc->entry)
+			return sc;
+	for (i = 0 ; i < SWAP_CACHE_SIZE ; i++) {
+		sc = swap_cache + swap_cache_next;
+		if (++swap_cache_next >= SWAP_CACHE_SIZE)
+			swap_cache_next = 0;
+		if (swap_cache_locked(sc))
+			continue;
+		free_page(sc->page);
+		sc->entry = 0;
+		sc->page = 0;
+		return sc;
+	}
+	return NULL;
+}
+
+static int shrink_swap_cache(void)
+{
+	struct swap_cache_entry * sc;
+	int i;
+
+	for (i = 0 ; i < SWAP_CACHE_SIZE ; i++) {
+		sc = swap_cache + swap_cache_next;
+		if (++swap_cache_next >= SWAP_CACHE_SIZE)
+			swap_cache_next = 0;
+		if (!sc->entry || swap_cache_locked(sc))
+			continue;
+		free_page(sc->page);
+		sc->entry = 0;
+		sc->page = 0;
+		return 1;
+	}
+	return 0;
+}
+
+static inline int swap_readahead_ok(struct swap_info_struct * p, unsigned long entry)
+{
+	unsigned long offset = SWP_OFFSET(entry);
+
+	if (offset >= p->max || !p->swap_map[offset] || p->swap_map[offset] == 0x80)
+		return 0;
+	if (test_bit(offset, p->swap_lockmap))
+		return 0;
+	return !find_swap_cache(entry);
+}
+
+/*
+ * Start reading the in-use slots of the window "entry" is in (that one
+ * included) into the swap cache. Only the queueing is waited for.
+ */
+static void swap_readahead(unsigned long entry)
+{
+	struct swap_info_struct * p;
+	struct swap_cache_entry * sc, * list[SWAP_READAHEAD];
+	struct buffer_head * bh[SWAP_READAHEAD * SWAP_CACHE_BH], * tmp;
+	unsigned long offset, page, block, zones[SWAP_CACHE_BH];
+	int type, i, j, k, nr, nr_list, size;
+	dev_t dev;
+
+	type = SWP_TYPE(entry);
+	p = swap_info + type;
+	if (p->swap_device) {
+		dev = p->swap_device;
+		size = PAGE_SIZE;
+	} else {
+		dev = p->swap_file->i_dev;
+		size = p->swap_file->i_sb->s_blocksize;
+	}
+	if (size < BLOCK_SIZE)
+		return;
+	nr = nr_list = 0;
+	offset = SWP_OFFSET(entry) & ~(SWAP_READAHEAD - 1);
+	for (i = 0 ; i < SWAP_READAHEAD ; i++, offset++) {
+		entry = SWP_ENTRY(type, offset);
+		if (!swap_readahead_ok(p, entry))
+			continue;
+		if (!(page = __get_free_page(GFP_KERNEL)))
+			break;
+		k = 0;
+		if (p->swap_device)
+			zones[k++] = offset;
+		else {
+			block = offset << (PAGE_SHIFT - p->swap_file->i_sb->s_blocksize_bits);
+			for (j = 0 ; j < PAGE_SIZE ; j += size)
+				if (!(zones[k++] = bmap(p->swap_file, block++)))
+					break;
+		}
+		/* we may have slept */
+		if (!zones[k-1] || !swap_readahead_ok(p, entry) || !(sc = get_swap_cache())) {
+			free_page(page);
+			continue;
+		}
+		sc->entry = entry;
+		sc->page = page;
+		sc->busy = 1;
+		sc->nr_bh = k;
+		for (j = 0 ; j < k ; j++) {
+			tmp = sc->bh + j;
+			memset(tmp, 0, sizeof(*tmp));
+			tmp->b_data = (char *) page + j * size;
+			tmp->b_size = size;
+			tmp->b_dev = dev;
+			tmp->b_count = 1;
+			tmp->b_blocknr = zones[j];
+			bh[nr++] = tmp;
+		}
+		list[nr_list++] = sc;
+	}
+	if (nr)
+		ll_rw_swap_batch(READ, nr, bh);
+	kstat.pswpin += nr_list;
+	while (nr_list-- > 0)
+		list[nr_list]->busy = 0;
+	wake_up(&swap_cache_wait);
+}
+
 void swap_free(unsigned long entry)
 {
 	struct swap_info_struct * p;
-	unsigned long offset, type;
+	unsigned long offset, type, page;
 
 	if (!entry)
 		return;
@@ -187,11 +575,17 @@ void swap_free(unsigned long entry)
 	if (!p->swap_map[offset])
 		printk("swap_free: swap-space map bad (entry %08lx)\n",entry);
 	else
-		if (!--p->swap_map[offset])
+		if (!--p->swap_map[offset]) {
 			nr_swap_pages++;
+			if (!--p->clusters[offset / SWAP_CLUSTER].count &&
+			    !p->clusters[offset / SWAP_CLUSTER].listed)
+				add_free_cluster(p, offset / SWAP_CLUSTER);
+		}
 	if (!clear_bit(offset,p->swap_lockmap))
 		printk("swap_free: lock already cleared\n");
 	wake_up(&lock_queue);
+	if (!p->swap_map[offset] && (page = take_swap_cache(entry)) != 0)
+		free_page(page);
 }
 
 void swap_in(unsigned long *table_ptr)
@@ -212,11 +606,20 @@ void swap_in(unsigned long *table_ptr)
 		shm_no_page ((unsigned long *) table_ptr);
 		return;
 	}
-	if (!(page = get_free_page(GFP_KERNEL))) {
-		oom(current);
-		page = BAD_PAGE;
-	} else	
-		read_swap_page(entry, (char *) page);
+	if ((page = take_swap_cache(entry)) != 0)
+		kstat.swap_ra_hits++;
+	else {
+		kstat.swap_ra_misses++;
+		swap_readahead(entry);
+		page = take_swap_cache(entry);
+	}
+	if (!page) {
+		if (!(page = get_free_page(GFP_KERNEL))) {
+			oom(current);
+			page = BAD_PAGE;
+		} else
+			read_swap_page(entry, (char *) page);
+	}
 	if (*table_ptr != entry) {
 		free_page(page);
 		return;
@@ -253,8 +656,10 @@ static inline int try_to_swap_out(unsigned long * table_ptr)
 			return 0;
 		*table_ptr = entry;
 		invalidate();
-		write_swap_page(entry, (char *) page);
-		free_page(page);
+		if (!queue_swap_page(entry, page)) {
+			write_swap_page(entry, (char *) page);
+			free_page(page);
+		}
 		return 1;
 	}
 	page &= PAGE_MASK;
@@ -265,142 +670,290 @@ static inline int try_to_swap_out(unsigned long * table_ptr)
 }
 
 /*
- * sys_idle() does nothing much: it just searches for likely candidates for
- * swapping out or forgetting about. This speeds up the search when we
- * actually have to swap.
+ * Pages cleared in advance by the idle task, for get_free_page(). They
+ * are only made while there is plenty of free memory, and are given back
+ * first thing when memory gets short.
+ */
+#define NR_ZEROED_PAGES	16
+
+static unsigned long zeroed_pages[NR_ZEROED_PAGES];
+static int nr_zeroed_pages = 0;
+
+unsigned long take_zeroed_page(void)
+{
+	unsigned long flags, page = 0;
+
+	save_flags(flags);
+	cli();
+	if (nr_zeroed_pages)
+		page = zeroed_pages[--nr_zeroed_pages];
+	restore_flags(flags);
+	return page;
+}
+
+static int free_zeroed_pages(void)
+{
+	unsigned long page;
+	int freed = 0;
+
+	while ((page = take_zeroed_page()) != 0) {
+		free_page(page);
+		freed++;
+	}
+	return freed;
+}
+
+/*
+ * Clear one page: the idle loop comes back here often enough, and this
+ * way nobody who wakes up has to wait for more than that.
+ */
+static void zero_idle_page(void)
+{
+	unsigned long page, flags;
+
+	if (nr_zeroed_pages >= NR_ZEROED_PAGES || nr_free_pages < 4 * MAX_SECONDARY_PAGES)
+		return;
+	page = __get_free_page(GFP_BUFFER);
+	if (!page)
+		return;
+	memset((void *) page, 0, PAGE_SIZE);
+	save_flags(flags);
+	cli();
+	if (nr_zeroed_pages < NR_ZEROED_PAGES) {
+		zeroed_pages[nr_zeroed_pages++] = page;
+		page = 0;
+	}
+	restore_flags(flags);
+	if (page)
+		free_page(page);
+}
+
+/*
+ * sys_idle() does nothing much: it clears a page for the zeroed page
+ * pool if there is room, and lets somebody else run.
  */
 asmlinkage int sys_idle(void)
 {
+	if (current->pid == 0)
+		zero_idle_page();
 	need_resched = 1;
 	return 0;
 }
 
 /*
- * A new implementation of swap_out().  We do not swap complete processes,
- * but only a small number of blocks, before we continue with the next
- * process.  The number of blocks actually swapped is determined on the
- * number of page faults, that this process actually had in the last time,
- * so we won't swap heavily used processes all the time ...
- *
- * Note: the priority argument is a hint on much CPU to waste with the
- *       swap block search, not a hint, of how much blocks to swap with
- *       each process.
+ * Page aging. Every physical page has an age in mem_age[]. The aging scan
+ * walks the page tables of all swappable tasks in turn (each remembers
+ * where it got to), and for every user page it finds makes the page older
+ * if it hasn't been touched since the last look, or younger if it has.
+ * Pages that reach age 0 go on a global inactive list in the order they
+ * got there, and swap_out() takes its victims from the old end of that
+ * list. A page that is touched again before it gets there is left alone.
  *
- * (C) 1993 Kai Petzke, wpp@marie.physik.tu-berlin.de
+ * So what goes is what has been idle longest anywhere, rather than
+ * whatever the next task in line happens not to have touched lately.
+ * The pages with a non-zero age make up the active set.
  */
+#define PAGE_INITIAL_AGE	3
+#define PAGE_ADVANCE		3
+#define PAGE_DECLINE		1
+#define PAGE_AGE_MAX		32
+
+static unsigned char * mem_age = NULL;
+
+static struct swap_stat {
+	unsigned long scanned[SWAP_PRIORITIES];
+	unsigned long reclaimed[SWAP_PRIORITIES];
+} swap_stat;
+
+static inline void touch_page(unsigned long page)
+{
+	unsigned char * age = mem_age + MAP_NR(page);
+
+	if (*age > PAGE_AGE_MAX - PAGE_ADVANCE)
+		*age = PAGE_AGE_MAX;
+	else
+		*age += PAGE_ADVANCE;
+}
+
 #ifdef NEW_SWAP
+
+#define NR_INACTIVE	256		/* must be a power of 2 */
+#define SWAP_SCAN_MAX	4096		/* pages aged per pass at priority 0 */
+
+static struct inactive_page {
+	struct task_struct * task;
+	int pid;
+	unsigned long address;
+	unsigned long page;
+} inactive[NR_INACTIVE];
+
+static int inactive_head = 0, inactive_tail = 0;
+#define nr_inactive	((inactive_tail - inactive_head) & (NR_INACTIVE - 1))
+
+static inline void add_inactive(struct task_struct * p, unsigned long address,
+	unsigned long page)
+{
+	struct inactive_page * ip = inactive + inactive_tail;
+
+	ip->task = p;
+	ip->pid = p->pid;
+	ip->address = address;
+	ip->page = page;
+	inactive_tail = (inactive_tail + 1) & (NR_INACTIVE - 1);
+}
+
+static inline void age_page(struct task_struct * p, unsigned long * table_ptr,
+	unsigned long address, unsigned int priority)
+{
+	unsigned long page = *table_ptr;
+	unsigned char * age;
+
+	if (!(PAGE_PRESENT & page) || page >= high_memory)
+		return;
+	if (mem_map[MAP_NR(page)] & MAP_PAGE_RESERVED)
+		return;
+	swap_stat.scanned[priority]++;
+	if (PAGE_ACCESSED & page) {
+		*table_ptr = page & ~PAGE_ACCESSED;
+		touch_page(page);
+		return;
+	}
+	age = mem_age + MAP_NR(page);
+	if (*age > PAGE_DECLINE) {
+		*age -= PAGE_DECLINE;
+		return;
+	}
+	*age = 0;
+	add_inactive(p, address, page & PAGE_MASK);
+}
+
 /*
- * These are the miminum and maximum number of pages to swap from one process,
- * before proceeding to the next:
+ * Age the pages of one task from where we left off last time. Returns
+ * how much of the budget is left: non-zero means the task is done.
  */
-#define SWAP_MIN	4
-#define SWAP_MAX	32
+static int age_task(struct task_struct * p, int budget, unsigned int priority)
+{
+	unsigned long pg_table;
+	int table, page;
+
+	for (table = p->swap_table ; table < PTRS_PER_PAGE ; table++) {
+		pg_table = ((unsigned long *) p->tss.cr3)[table];
+		if (pg_table >= high_memory)
+			continue;
+		if (mem_map[MAP_NR(pg_table)] & MAP_PAGE_RESERVED)
+			continue;
+		if (!(PAGE_PRESENT & pg_table)) {
+			printk("swap_out: bad page-table at pg_dir[%d]: %08lx\n",
+				table, pg_table);
+			((unsigned long *) p->tss.cr3)[table] = 0;
+			continue;
+		}
+		pg_table &= PAGE_MASK;
+		for (page = p->swap_page ; page < PTRS_PER_PAGE ; page++) {
+			if (budget <= 0 || nr_inactive == NR_INACTIVE - 1) {
+				p->swap_table = table;
+				p->swap_page = page;
+				return 0;
+			}
+			budget--;
+			age_page(p, page + (unsigned long *) pg_table,
+				((unsigned long) table << 22) | (page << PAGE_SHIFT),
+				priority);
+		}
+		p->swap_page = 0;
+	}
+	p->swap_table = 0;
+	return budget ? budget : 1;
+}
+
+static void age_pages(unsigned int priority)
+{
+	static int swap_task = 1;
+	int budget = SWAP_SCAN_MAX >> priority;
+	int loop = NR_TASKS;
+	struct task_struct * p;
+
+	while (loop-- > 0) {
+		if (swap_task >= NR_TASKS)
+			swap_task = 1;
+		p = task[swap_task];
+		if (p && p->swappable && p->rss) {
+			budget = age_task(p, budget, priority);
+			if (!budget)
+				return;
+		}
+		swap_task++;
+	}
+}
 
 /*
- * The actual number of pages to swap is determined as:
- * SWAP_RATIO / (number of recent major page faults)
+ * The page table entry an inactive page was found at, if it still maps
+ * the same page.
  */
-#define SWAP_RATIO	128
-
-static int swap_out(unsigned int priority)
+static unsigned long * inactive_pte(struct inactive_page * ip)
 {
-    static int swap_task;
-    int table;
-    int page;
-    long pg_table;
-    int loop;
-    int counter = NR_TASKS * 2 >> priority;
-    struct task_struct *p;
-
-    counter = NR_TASKS * 2 >> priority;
-    for(; counter >= 0; counter--, swap_task++) {
-	/*
-	 * Check that swap_task is suitable for swapping.  If not, look for
-	 * the next suitable process.
-	 */
-	loop = 0;
-	while(1) {
-	    if(swap_task >= NR_TASKS) {
-		swap_task = 1;
-		if(loop)
-		    /* all processes are unswappable or already swapped out */
-		    return 0;
-		loop = 1;
-	    }
-
-	    p = task[swap_task];
-	    if(p && p->swappable && p->rss)
-		break;
-
-	    swap_task++;
-	}
-
-	/*
-	 * Determine the number of pages to swap from this process.
-	 */
-	if(! p -> swap_cnt) {
-	    p->dec_flt = (p->dec_flt * 3) / 4 + p->maj_flt - p->old_maj_flt;
-	    p->old_maj_flt = p->maj_flt;
-
-	    if(p->dec_flt >= SWAP_RATIO / SWAP_MIN) {
-		p->dec_flt = SWAP_RATIO / SWAP_MIN;
-		p->swap_cnt = SWAP_MIN;
-	    } else if(p->dec_flt <= SWAP_RATIO / SWAP_MAX)
-		p->swap_cnt = SWAP_MAX;
-	    else
-		p->swap_cnt = SWAP_RATIO / p->dec_flt;
-	}
-
-	/*
-	 * Go through process' page directory.
-	 */
-	for(table = p->swap_table; table < 1024; table++) {
-	    pg_table = ((unsigned long *) p->tss.cr3)[table];
-	    if(pg_table >= high_memory)
-		    continue;
-	    if(mem_map[MAP_NR(pg_table)] & MAP_PAGE_RESERVED)
-		    continue;
-	    if(!(PAGE_PRESENT & pg_table)) {
-		    printk("swap_out: bad page-table at pg_dir[%d]: %08lx\n",
-			    table, pg_table);
-		    ((unsigned long *) p->tss.cr3)[table] = 0;
-		    continue;
-	    }
-	    pg_table &= 0xfffff000;
-
-	    /*
-	     * Go through this page table.
-	     */
-	    for(page = p->swap_page; page < 1024; page++) {
-		switch(try_to_swap_out(page + (unsigned long *) pg_table)) {
-		    case 0:
+	struct task_struct * p = ip->task;
+	unsigned long pg_table, * table_ptr;
+	int i;
+
+	for (i = 1 ; i < NR_TASKS ; i++)
+		if (task[i] == p)
 			break;
+	if (i >= NR_TASKS || p->pid != ip->pid || !p->swappable)
+		return NULL;
+	pg_table = ((unsigned long *) p->tss.cr3)[ip->address >> 22];
+	if (!(PAGE_PRESENT & pg_table) || pg_table >= high_memory)
+		return NULL;
+	if (mem_map[MAP_NR(pg_table)] & MAP_PAGE_RESERVED)
+		return NULL;
+	table_ptr = (unsigned long *) (pg_table & PAGE_MASK);
+	table_ptr += (ip->address >> PAGE_SHIFT) & (PTRS_PER_PAGE - 1);
+	if (!(PAGE_PRESENT & *table_ptr) || (*table_ptr & PAGE_MASK) != ip->page)
+		return NULL;
+	return table_ptr;
+}
 
-		    case 1:
-			p->rss--;
-			/* continue with the following page the next time */
-			p->swap_table = table;
-			p->swap_page  = page + 1;
-			if((--p->swap_cnt) == 0)
-			    swap_task++;
-			return 1;
+static int swap_out(unsigned int priority)
+{
+	struct inactive_page * ip;
+	unsigned long * table_ptr;
+	int freed = 0;
+	int aged = 0;
 
-		    default:
-			p->rss--;
-			break;
+	for (;;) {
+		if (!nr_inactive) {
+			if (aged++)
+				break;
+			age_pages(priority);
+			continue;
+		}
+		ip = inactive + inactive_head;
+		inactive_head = (inactive_head + 1) & (NR_INACTIVE - 1);
+		if (!(table_ptr = inactive_pte(ip)))
+			continue;
+		if (PAGE_ACCESSED & *table_ptr) {
+			*table_ptr &= ~PAGE_ACCESSED;
+			touch_page(ip->page);
+			continue;
+		}
+		/* still young through another mapping? */
+		if (mem_age[MAP_NR(ip->page)])
+			continue;
+		switch (try_to_swap_out(table_ptr)) {
+			case 0:
+				break;
+			case 1:
+				ip->task->rss--;
+				swap_stat.reclaimed[priority]++;
+				/* go on while the pages still fit into one batch */
+				if (++freed >= SWAP_BATCH || !swap_batch_open())
+					return 1;
+				break;
+			default:
+				ip->task->rss--;
 		}
-	    }
-
-	    p->swap_page = 0;
 	}
-
-	/*
-	 * Finish work with this process, if we reached the end of the page
-	 * directory.  Mark restart from the beginning the next time.
-	 */
-	p->swap_table = 0;
-    }
-    return 0;
+	return freed != 0;
 }
 
 #else /* old swapping procedure */
@@ -471,36 +1024,105 @@ check_table:
 
 #endif
 
+/*
+ * For /proc/stat: pages aged and pages reclaimed at each priority, from
+ * the first (gentle) pass of try_to_free_page() to the last.
+ */
+int get_swap_stat(char * buffer)
+{
+	int i, len;
+
+	len = sprintf(buffer, "pgscan");
+	for (i = SWAP_PRIORITIES ; i-- > 0 ; )
+		len += sprintf(buffer+len, " %lu", swap_stat.scanned[i]);
+	len += sprintf(buffer+len, "\npgsteal");
+	for (i = SWAP_PRIORITIES ; i-- > 0 ; )
+		len += sprintf(buffer+len, " %lu", swap_stat.reclaimed[i]);
+	return len + sprintf(buffer+len, "\n");
+}
+
 static int try_to_free_page(void)
 {
-	int i=6;
+	int i=SWAP_PRIORITIES;
 
+	if (free_zeroed_pages() || kmem_cache_reap() || shrink_swap_cache())
+		return 1;
 	while (i--) {
+		if (shrink_page_cache(i))
+			return 1;
 		if (shrink_buffers(i))
 			return 1;
 		if (shm_swap(i))
 			return 1;
-		if (swap_out(i))
+		if (swap_out(i)) {
+			flush_swap_batch();
 			return 1;
+		}
 	}
 	return 0;
 }
 
 /*
+ * The free pages are kept in a binary buddy system. free_area_list[order]
+ * holds the free blocks of 2^order pages, and bit n of free_area_map[order]
+ * is set when exactly one block of the n'th pair of buddies of that order
+ * is free. Freeing a block whose buddy is free as well merges the two
+ * into one block of the next order up.
+ *
  * Note that this must be atomic, or bad things will happen when
  * pages are requested in interrupts (as malloc can do). Thus the
  * cli/sti's.
  */
-static inline void add_mem_queue(unsigned long addr, unsigned long * queue)
+struct mem_list {
+	struct mem_list * next;
+	struct mem_list * prev;
+};
+
+static struct mem_list free_area_list[NR_MEM_LISTS];
+static unsigned char * free_area_map[NR_MEM_LISTS];
+
+static inline void add_mem_queue(struct mem_list * head, struct mem_list * entry)
+{
+	entry->prev = head;
+	(entry->next = head->next)->prev = entry;
+	head->next = entry;
+}
+
+static inline void remove_mem_queue(struct mem_list * entry)
+{
+	entry->next->prev = entry->prev;
+	entry->prev->next = entry->next;
+}
+
+/*
+ * Toggle the bit of the pair the block at "addr" belongs to, returning
+ * the old value: set means its buddy was free.
+ */
+static inline int change_buddy_bit(unsigned long addr, unsigned long order)
 {
-	addr &= PAGE_MASK;
-	*(unsigned long *) addr = *queue;
-	*queue = addr;
+	return change_bit(MAP_NR(addr) >> (1 + order), free_area_map[order]);
+}
+
+static inline void free_pages_ok(unsigned long addr, unsigned long order)
+{
+	unsigned long mask = PAGE_MASK << order;
+
+	addr &= mask;
+	nr_free_pages += 1 << order;
+	while (order < NR_MEM_LISTS-1) {
+		if (!change_buddy_bit(addr, order))
+			break;
+		remove_mem_queue((struct mem_list *) (addr ^ (1+~mask)));
+		order++;
+		mask <<= 1;
+		addr &= mask;
+	}
+	add_mem_queue(free_area_list+order, (struct mem_list *) addr);
 }
 
 /*
- * Free_page() adds the page to the free lists. This is optimized for
- * fast normal cases (no error jumps taken normally).
+ * Free_pages() gives a block back to the buddy lists. This is optimized
+ * for fast normal cases (no error jumps taken normally).
  *
  * The way to optimize jumps for gcc-2.2.2 is to:
  *  - select the "normal" case and put it inside the if () { XXX }
@@ -508,8 +1130,10 @@ static inline void add_mem_queue(unsigned long addr, unsigned long * queue)
  *
  * With the above two rules, you get a straight-line execution path
  * for the normal case, giving better asm-code.
+ *
+ * Only the first page of a multi-page block has a mem_map count.
  */
-void free_page(unsigned long addr)
+void free_pages(unsigned long addr, unsigned long order)
 {
 	if (addr < high_memory) {
 		unsigned short * map = mem_map + MAP_NR(addr);
@@ -520,16 +1144,8 @@ void free_page(unsigned long addr)
 
 				save_flags(flag);
 				cli();
-				if (!--*map) {
-					if (nr_secondary_pages < MAX_SECONDARY_PAGES) {
-						add_mem_queue(addr,&secondary_page_list);
-						nr_secondary_pages++;
-						restore_flags(flag);
-						return;
-					}
-					add_mem_queue(addr,&free_page_list);
-					nr_free_pages++;
-				}
+				if (!--*map)
+					free_pages_ok(addr, order);
 				restore_flags(flag);
 			}
 			return;
@@ -541,53 +1157,53 @@ void free_page(unsigned long addr)
 }
 
 /*
- * This is one ugly macro, but it simplifies checking, and makes
- * this speed-critical place reasonably fast, especially as we have
- * to do things with the interrupt flag etc.
- *
- * Note that this #define is heavily optimized to give fast code
- * for the normal case - the if-statements are ordered so that gcc-2.2.2
- * will make *no* jumps for the normal code. Don't touch unless you
- * know what you are doing.
+ * Take a block of 2^order pages off the lists, splitting a bigger one
+ * if there is none of the right size. Returns 0 if there is no block
+ * that is big enough. Interrupts must be off.
  */
-#define REMOVE_FROM_MEM_QUEUE(queue,nr) \
-	cli(); \
-	if ((result = queue) != 0) { \
-		if (!(result & ~PAGE_MASK) && result < high_memory) { \
-			queue = *(unsigned long *) result; \
-			if (!mem_map[MAP_NR(result)]) { \
-				mem_map[MAP_NR(result)] = 1; \
-				nr--; \
-last_free_pages[index = (index + 1) & (NR_LAST_FREE_PAGES - 1)] = result; \
-				restore_flags(flag); \
-				return result; \
-			} \
-			printk("Free page %08lx has mem_map = %d\n", \
-				result,mem_map[MAP_NR(result)]); \
-		} else \
-			printk("Result = 0x%08lx - memory map destroyed\n", result); \
-		queue = 0; \
-		nr = 0; \
-	} else if (nr) { \
-		printk(#nr " is %d, but " #queue " is empty\n",nr); \
-		nr = 0; \
-	} \
-	restore_flags(flag)
+static inline unsigned long rmqueue(unsigned long order)
+{
+	struct mem_list * queue = free_area_list + order;
+	struct mem_list * block;
+	unsigned long new_order = order;
+	unsigned long size;
+
+	for (;;) {
+		if ((block = queue->next) != queue)
+			break;
+		if (++new_order >= NR_MEM_LISTS)
+			return 0;
+		queue++;
+	}
+	remove_mem_queue(block);
+	change_buddy_bit((unsigned long) block, new_order);
+	nr_free_pages -= 1 << order;
+	size = PAGE_SIZE << new_order;
+	while (new_order > order) {
+		new_order--;
+		size >>= 1;
+		/* the lower half gets used, the upper one goes on the list */
+		add_mem_queue(free_area_list + new_order,
+			(struct mem_list *) (size + (unsigned long) block));
+		change_buddy_bit((unsigned long) block, new_order);
+	}
+	return (unsigned long) block;
+}
 
 /*
- * Get physical address of first (actually last :-) free page, and mark it
- * used. If no free pages left, return 0.
+ * Get physical address of a free block of 2^order pages, and mark it
+ * used. If there isn't one, return 0.
  *
- * Note that this is one of the most heavily called functions in the kernel,
- * so it's a bit timing-critical (especially as we have to disable interrupts
- * in it). See the above macro which does most of the work, and which is
- * optimized for a fast normal path of execution.
+ * The last MAX_SECONDARY_PAGES free pages are kept for GFP_ATOMIC
+ * allocations, and for the others only once try_to_free_page() can't
+ * find anything any more.
  */
-unsigned long __get_free_page(int priority)
+unsigned long __get_free_pages(int priority, unsigned long order)
 {
 	extern unsigned long intr_count;
 	unsigned long result, flag;
 	static unsigned long index = 0;
+	int reserved;
 
 	/* this routine can be called at interrupt time via
 	   malloc.  We want to make sure that the critical
@@ -599,18 +1215,78 @@ unsigned long __get_free_page(int priority)
 			((unsigned long *)&priority)[-1]);
 		priority = GFP_ATOMIC;
 	}
+	reserved = (priority == GFP_ATOMIC) ? 0 : MAX_SECONDARY_PAGES;
 	save_flags(flag);
 repeat:
-	REMOVE_FROM_MEM_QUEUE(free_page_list,nr_free_pages);
+	cli();
+	if (nr_free_pages >= reserved + (1 << order)) {
+		if ((result = rmqueue(order)) != 0) {
+			if (mem_map[MAP_NR(result)])
+				printk("Free page %08lx has mem_map = %d\n",
+					result,mem_map[MAP_NR(result)]);
+			mem_map[MAP_NR(result)] = 1;
+			if (mem_age)
+				mem_age[MAP_NR(result)] = PAGE_INITIAL_AGE;
+			last_free_pages[index = (index + 1) & (NR_LAST_FREE_PAGES - 1)] = result;
+			restore_flags(flag);
+			return result;
+		}
+	}
+	restore_flags(flag);
 	if (priority == GFP_BUFFER)
 		return 0;
-	if (priority != GFP_ATOMIC)
-		if (try_to_free_page())
-			goto repeat;
-	REMOVE_FROM_MEM_QUEUE(secondary_page_list,nr_secondary_pages);
+	if (priority != GFP_ATOMIC && try_to_free_page())
+		goto repeat;
+	if (reserved) {
+		reserved = 0;
+		goto repeat;
+	}
 	return 0;
 }
 
+/*
+ * Set up the buddy lists and bitmaps, taking the bitmaps from start_mem.
+ * mem_init() then frees all the usable pages into them.
+ */
+unsigned long free_area_init(unsigned long start_mem, unsigned long end_mem)
+{
+	unsigned long bitmap_size;
+	int i;
+
+	for (i = 0 ; i < NR_MEM_LISTS ; i++) {
+		free_area_list[i].next = free_area_list[i].prev = free_area_list + i;
+		bitmap_size = end_mem >> (PAGE_SHIFT + i + 1);
+		bitmap_size = (bitmap_size + 7 + 31) >> 3;
+		bitmap_size &= ~3;
+		free_area_map[i] = (unsigned char *) start_mem;
+		memset((void *) start_mem, 0, bitmap_size);
+		start_mem += bitmap_size;
+	}
+	mem_age = (unsigned char *) start_mem;
+	memset(mem_age, 0, MAP_NR(end_mem));
+	start_mem += (MAP_NR(end_mem) + 3) & ~3;
+	return start_mem;
+}
+
+void show_free_areas(void)
+{
+	struct mem_list * queue, * tmp;
+	unsigned long flag;
+	int order, nr;
+
+	printk("Free blocks:");
+	save_flags(flag);
+	cli();
+	for (order = 0, queue = free_area_list ; order < NR_MEM_LISTS ; order++, queue++) {
+		nr = 0;
+		for (tmp = queue->next ; tmp != queue ; tmp = tmp->next)
+			nr++;
+		printk(" %d*%luk", nr, PAGE_SIZE >> (10 - order));
+	}
+	restore_flags(flag);
+	printk("\n");
+}
+
 /*
  * Trying to stop swapping from a file is fraught with races, so
  * we repeat quite a bit here when we have to pause. swapoff()
@@ -712,6 +1388,8 @@ asmlinkage int sys_swapoff(const char * specialfile)
 	p->swap_device = 0;
 	vfree(p->swap_map);
 	p->swap_map = NULL;
+	vfree(p->clusters);
+	p->clusters = NULL;
 	free_page((long) p->swap_lockmap);
 	p->swap_lockmap = NULL;
 	p->flags = 0;
@@ -728,7 +1406,7 @@ asmlinkage int sys_swapon(const char * specialfile)
 	struct swap_info_struct * p;
 	struct inode * swap_inode;
 	unsigned int type;
-	int i,j;
+	int i,j,k;
 	int error;
 
 	if (!suser())
@@ -746,6 +1424,7 @@ asmlinkage int sys_swapon(const char * specialfile)
 	p->swap_device = 0;
 	p->swap_map = NULL;
 	p->swap_lockmap = NULL;
+	p->clusters = NULL;
 	p->lowest_bit = 0;
 	p->highest_bit = 0;
 	p->max = 1;
@@ -815,6 +1494,24 @@ asmlinkage int sys_swapon(const char * specialfile)
 			p->swap_map[i] = 0x80;
 	}
 	p->swap_map[0] = 0x80;
+	i = (p->max + SWAP_CLUSTER - 1) / SWAP_CLUSTER;
+	p->clusters = (struct swap_cluster *) vmalloc(i * sizeof(struct swap_cluster));
+	if (!p->clusters) {
+		error = -ENOMEM;
+		goto bad_swap;
+	}
+	p->free_cluster = -1;
+	p->cluster_next = 0;
+	p->cluster_nr = 0;
+	while (i-- > 0) {
+		p->clusters[i].count = 0;
+		p->clusters[i].listed = 0;
+		for (k = i * SWAP_CLUSTER ; k < (i+1) * SWAP_CLUSTER ; k++)
+			if (k >= p->max || p->swap_map[k])
+				p->clusters[i].count++;
+		if (!p->clusters[i].count)
+			add_free_cluster(p, i);
+	}
 	memset(p->swap_lockmap,0,PAGE_SIZE);
 	p->flags = SWP_WRITEOK;
 	p->pages = j;
@@ -824,10 +1521,12 @@ asmlinkage int sys_swapon(const char * specialfile)
 bad_swap:
 	free_page((long) p->swap_lockmap);
 	vfree(p->swap_map);
+	vfree(p->clusters);
 	iput(p->swap_file);
 	p->swap_device = 0;
 	p->swap_file = NULL;
 	p->swap_map = NULL;
+	p->clusters = NULL;
 	p->swap_lockmap = NULL;
 	p->flags = 0;
 	return error;
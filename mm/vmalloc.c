@@ -23,7 +23,15 @@ struct vm_struct {
 	struct vm_struct * next;
 };
 
+/*
+ * vmlist holds the allocated areas and vmfree the holes between them,
+ * both sorted by address.  Free areas are coalesced on vfree(), so the
+ * free list is never longer than the area list plus one.  vmfree_last
+ * is the highest free area, which runs up to VMALLOC_END.
+ */
 static struct vm_struct * vmlist = NULL;
+static struct vm_struct * vmfree = NULL;
+static struct vm_struct * vmfree_last = NULL;
 
 /* Just any arbitrary offset to the start of the vmalloc VM area: the
  * current 8MB value just means that there will be a 8MB "hole" after the
@@ -33,19 +41,63 @@ static struct vm_struct * vmlist = NULL;
  * area for the same reason. ;)
  */
 #define VMALLOC_OFFSET	(8*1024*1024)
+#define VMALLOC_START	((high_memory + VMALLOC_OFFSET) & ~(VMALLOC_OFFSET-1))
+#define VMALLOC_END	(0x40000000)	/* the kernel segment is 1GB */
+
+/*
+ * Requests of this many pages or more are carved from the top of the
+ * last free area instead of searching the holes from the bottom: that
+ * is O(1), and keeps the big areas from cutting up the low addresses
+ * the small ones come back to.
+ */
+#define VMALLOC_LARGE	(16*PAGE_SIZE)
+
+/*
+ * The page directory changes of one vmalloc() or vfree() are collected
+ * here and copied to all the tasks in one go when the whole area has
+ * been done, instead of walking the task list once for each page table.
+ * Page tables that became empty are chained through their first word
+ * and freed only after no directory points at them any more.
+ */
+struct pgdir_batch {
+	unsigned long first, last;
+	unsigned long freed;
+};
 
-static inline void set_pgdir(unsigned long dindex, unsigned long value)
+static inline void note_pgdir(struct pgdir_batch * batch, unsigned long dindex)
+{
+	if (dindex < batch->first)
+		batch->first = dindex;
+	if (dindex > batch->last)
+		batch->last = dindex;
+}
+
+static void flush_pgdir(struct pgdir_batch * batch)
 {
 	struct task_struct * p;
+	unsigned long i, page;
 
-	p = &init_task;
-	do {
-		((unsigned long *) p->tss.cr3)[dindex] = value;
-		p = p->next_task;
-	} while (p != &init_task);
+	if (batch->first <= batch->last) {
+		p = &init_task;
+		do {
+			unsigned long * dir = (unsigned long *) p->tss.cr3;
+
+			if (dir != swapper_pg_dir)
+				for (i = batch->first ; i <= batch->last ; i++)
+					dir[i] = swapper_pg_dir[i];
+			p = p->next_task;
+		} while (p != &init_task);
+	}
+	while ((page = batch->freed) != 0) {
+		batch->freed = *(unsigned long *) page;
+		mem_map[MAP_NR(page)] = 1;
+		free_page(page);
+	}
+	invalidate();
 }
 
-static int free_area_pages(unsigned long dindex, unsigned long index, unsigned long nr)
+static int free_area_pages(unsigned long dindex, unsigned long index, unsigned long nr,
+	struct pgdir_batch * batch)
 {
 	unsigned long page, *pte;
 
@@ -64,17 +116,23 @@ static int free_area_pages(unsigned long dindex, unsigned long index, unsigned l
 	for (nr = 0 ; nr < 1024 ; nr++, pte++)
 		if (*pte)
 			return 0;
-	set_pgdir(dindex,0);
-	mem_map[MAP_NR(page)] = 1;
-	free_page(page);
-	invalidate();
+	swapper_pg_dir[dindex] = 0;
+	note_pgdir(batch, dindex);
+	*(unsigned long *) page = batch->freed;
+	batch->freed = page;
 	return 0;
 }
 
-static int alloc_area_pages(unsigned long dindex, unsigned long index, unsigned long nr)
+static int alloc_area_pages(unsigned long dindex, unsigned long index, unsigned long nr,
+	struct pgdir_batch * batch)
 {
 	unsigned long page, *pte;
 
+	/*
+	 * The table may have been set up by another vmalloc() that has
+	 * not propagated it yet, so every table we use goes in the batch.
+	 */
+	note_pgdir(batch, dindex);
 	page = swapper_pg_dir[dindex];
 	if (!page) {
 		page = get_free_page(GFP_KERNEL);
@@ -85,7 +143,7 @@ static int alloc_area_pages(unsigned long dindex, unsigned long index, unsigned
 			page = swapper_pg_dir[dindex];
 		} else {
 			mem_map[MAP_NR(page)] = MAP_PAGE_RESERVED;
-			set_pgdir(dindex, page | PAGE_SHARED);
+			swapper_pg_dir[dindex] = page | PAGE_SHARED;
 		}
 	}
 	page &= PAGE_MASK;
@@ -99,15 +157,19 @@ static int alloc_area_pages(unsigned long dindex, unsigned long index, unsigned
 		*pte = pg | PAGE_SHARED;
 		pte++;
 	} while (--nr);
-	invalidate();
 	return 0;
 }
 
 static int do_area(void * addr, unsigned long size,
-	int (*area_fn)(unsigned long,unsigned long,unsigned long))
+	int (*area_fn)(unsigned long,unsigned long,unsigned long,struct pgdir_batch *))
 {
 	unsigned long nr, dindex, index;
+	struct pgdir_batch batch;
+	int retval = 0;
 
+	batch.first = ~0UL;
+	batch.last = 0;
+	batch.freed = 0;
 	nr = size >> PAGE_SHIFT;
 	dindex = (TASK_SIZE + (unsigned long) addr) >> 22;
 	index = (((unsigned long) addr) >> PAGE_SHIFT) & (PTRS_PER_PAGE-1);
@@ -117,11 +179,83 @@ static int do_area(void * addr, unsigned long size,
 		if (i > nr)
 			i = nr;
 		nr -= i;
-		if (area_fn(dindex, index, i))
-			return -1;
+		if (area_fn(dindex, index, i, &batch)) {
+			retval = -1;
+			break;
+		}
 		index = 0;
 		dindex++;
 	}
+	flush_pgdir(&batch);
+	return retval;
+}
+
+/*
+ * Give the range of "area" back to the free list, merging it with the
+ * free areas on either side.  The descriptor itself becomes the free
+ * area node (or is freed if it was merged), so this can't fail.
+ */
+static void free_vm_area(struct vm_struct * area)
+{
+	struct vm_struct **p, *tmp, *prev = NULL;
+	unsigned long start = (unsigned long) area->addr;
+
+	for (p = &vmfree ; (tmp = *p) ; p = &tmp->next) {
+		if ((unsigned long) tmp->addr > start)
+			break;
+		prev = tmp;
+	}
+	if (prev && (unsigned long) prev->addr + prev->size == start) {
+		prev->size += area->size;
+		kfree(area);
+		area = prev;
+	} else {
+		area->next = tmp;
+		*p = area;
+	}
+	if (tmp && (unsigned long) area->addr + area->size == (unsigned long) tmp->addr) {
+		area->size += tmp->size;
+		area->next = tmp->next;
+		kfree(tmp);
+	}
+	if (!area->next)
+		vmfree_last = area;
+}
+
+/*
+ * Take "size" bytes (guard page included) out of the free list.  Large
+ * requests come from the top of the last free area when it has room to
+ * spare, the rest is first fit from the bottom.  Returns 0 if there is
+ * no hole big enough.
+ */
+static unsigned long get_vm_area(unsigned long size)
+{
+	struct vm_struct **p, *tmp;
+	unsigned long addr;
+
+	tmp = vmfree_last;
+	if (size >= VMALLOC_LARGE && tmp && tmp->size > size) {
+		tmp->size -= size;
+		return (unsigned long) tmp->addr + tmp->size;
+	}
+	for (p = &vmfree ; (tmp = *p) ; p = &tmp->next) {
+		if (tmp->size < size)
+			continue;
+		addr = (unsigned long) tmp->addr;
+		if (tmp->size > size) {
+			tmp->addr = (void *) (addr + size);
+			tmp->size -= size;
+			return addr;
+		}
+		*p = tmp->next;
+		if (tmp == vmfree_last) {
+			vmfree_last = NULL;
+			for (tmp = vmfree ; tmp ; tmp = tmp->next)
+				vmfree_last = tmp;
+		}
+		kfree(tmp);
+		return addr;
+	}
 	return 0;
 }
 
@@ -138,17 +272,19 @@ void vfree(void * addr)
 	for (p = &vmlist ; (tmp = *p) ; p = &tmp->next) {
 		if (tmp->addr == addr) {
 			*p = tmp->next;
-			do_area(tmp->addr, tmp->size, free_area_pages);
-			kfree(tmp);
+			do_area(tmp->addr, tmp->size - PAGE_SIZE, free_area_pages);
+			free_vm_area(tmp);
 			return;
 		}
+		if (tmp->addr > addr)
+			break;
 	}
 	printk("Trying to vfree() nonexistent vm area (%p)\n", addr);
 }
 
 void * vmalloc(unsigned long size)
 {
-	void * addr;
+	unsigned long addr;
 	struct vm_struct **p, *tmp, *area;
 
 	size = PAGE_ALIGN(size);
@@ -157,22 +293,40 @@ void * vmalloc(unsigned long size)
 	area = (struct vm_struct *) kmalloc(sizeof(*area), GFP_KERNEL);
 	if (!area)
 		return NULL;
-	addr = (void *) ((high_memory + VMALLOC_OFFSET) & ~(VMALLOC_OFFSET-1));
+	if (!vmfree) {
+		tmp = (struct vm_struct *) kmalloc(sizeof(*tmp), GFP_KERNEL);
+		if (!tmp) {
+			kfree(area);
+			return NULL;
+		}
+		if (vmfree || vmlist)	/* kmalloc() slept and somebody beat us */
+			kfree(tmp);
+		else {
+			tmp->flags = 0;
+			tmp->addr = (void *) VMALLOC_START;
+			tmp->size = VMALLOC_END - VMALLOC_START;
+			tmp->next = NULL;
+			vmfree = vmfree_last = tmp;
+		}
+	}
+	area->flags = 0;
 	area->size = size + PAGE_SIZE;
-	area->next = NULL;
-	for (p = &vmlist; (tmp = *p) ; p = &tmp->next) {
-		if (size + (unsigned long) addr < (unsigned long) tmp->addr)
-			break;
-		addr = (void *) (tmp->size + (unsigned long) tmp->addr);
+	addr = get_vm_area(area->size);
+	if (!addr) {
+		kfree(area);
+		return NULL;
 	}
-	area->addr = addr;
+	area->addr = (void *) addr;
+	for (p = &vmlist; (tmp = *p) ; p = &tmp->next)
+		if ((unsigned long) tmp->addr > addr)
+			break;
 	area->next = *p;
 	*p = area;
-	if (do_area(addr, size, alloc_area_pages)) {
-		vfree(addr);
+	if (do_area(area->addr, size, alloc_area_pages)) {
+		vfree(area->addr);
 		return NULL;
 	}
-	return addr;
+	return area->addr;
 }
 
 int vread(char *buf, char *addr, int count)
@@ -200,3 +354,48 @@ int vread(char *buf, char *addr, int count)
 finished:
 	return buf - buf_start;
 }
+
+/*
+ * /proc/vmallocinfo: a summary line, then the allocated and free areas
+ * in address order for as long as they fit in the page.
+ */
+int get_vmallocinfo(char * buffer)
+{
+	struct vm_struct *used, *free;
+	unsigned long used_size = 0, free_size = 0, largest = 0;
+	int nr_used = 0, nr_free = 0, len;
+
+	for (used = vmlist ; used ; used = used->next) {
+		nr_used++;
+		used_size += used->size;
+	}
+	for (free = vmfree ; free ; free = free->next) {
+		nr_free++;
+		free_size += free->size;
+		if (free->size > largest)
+			largest = free->size;
+	}
+	len = sprintf(buffer, "used: %d areas %lukB, free: %d areas %lukB, largest free %lukB\n",
+		nr_used, used_size >> 10, nr_free, free_size >> 10, largest >> 10);
+	used = vmlist;
+	free = vmfree;
+	while ((used || free) && len < PAGE_SIZE - 80) {
+		struct vm_struct * tmp;
+		char * state;
+
+		if (!free || (used && used->addr < free->addr)) {
+			tmp = used;
+			used = used->next;
+			state = "used";
+		} else {
+			tmp = free;
+			free = free->next;
+			state = "free";
+		}
+		len += sprintf(buffer+len, "%08lx-%08lx %8lu %s\n",
+			(unsigned long) tmp->addr,
+			(unsigned long) tmp->addr + tmp->size,
+			tmp->size >> PAGE_SHIFT, state);
+	}
+	return len;
+}
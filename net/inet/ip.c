@@ -705,6 +705,7 @@ static struct ipq *ip_create(struct sk_buff *skb, struct iphdr *iph, struct devi
 /*  	printk("Protocol = %d\n",qp->iph->protocol);*/
 	
   	/* Start a timer for this entry. */
+  	init_timer(&qp->timer);
   	qp->timer.expires = IP_FRAG_TIME;		/* about 30 seconds	*/
   	qp->timer.data = (unsigned long) qp;		/* pointer to queue	*/
   	qp->timer.function = ip_expire;			/* expire function	*/
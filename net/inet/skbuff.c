@@ -22,6 +22,7 @@
 #include <asm/system.h>
 #include <linux/mm.h>
 #include <linux/interrupt.h>
+#include <linux/slab.h>
 #include <linux/in.h>
 #include "inet.h"
 #include "dev.h"
@@ -418,6 +419,25 @@ void kfree_skb(struct sk_buff *skb, int rw)
 		kfree_skbmem(skb->mem_addr, skb->mem_len);
 }
 
+/*
+ *	Most skbuffs are either small (acks, control packets) or hold one
+ *	ethernet frame, so those two sizes come from their own caches. The
+ *	sizes are picked to fit 8 and 2 objects into a slab. Anything else
+ *	still comes from kmalloc().
+ */
+
+#define SKB_SMALL	(PAGE_SIZE/8 - 16)
+#define SKB_LARGE	(PAGE_SIZE/2 - 32)
+
+static struct kmem_cache *skb_small_cache = NULL;
+static struct kmem_cache *skb_large_cache = NULL;
+
+void skb_init(void)
+{
+	skb_small_cache = kmem_cache_create("skbuff_small", SKB_SMALL, 0, NULL);
+	skb_large_cache = kmem_cache_create("skbuff_large", SKB_LARGE, 0, NULL);
+}
+
 /*
  *	Allocate a new skbuff. We do this ourselves so we can fill in a few 'private'
  *	fields and also do memory statistics to find all the [BEEP] leaks.
@@ -433,7 +453,12 @@ struct sk_buff *alloc_skb(unsigned int size,int priority)
 			((unsigned long *)&size)[-1]);
 		priority = GFP_ATOMIC;
 	}
-	skb=(struct sk_buff *)kmalloc(size,priority);
+	if (size <= SKB_SMALL && skb_small_cache)
+		skb=(struct sk_buff *)kmem_cache_alloc(skb_small_cache,priority);
+	else if (size <= SKB_LARGE && skb_large_cache)
+		skb=(struct sk_buff *)kmem_cache_alloc(skb_large_cache,priority);
+	else
+		skb=(struct sk_buff *)kmalloc(size,priority);
 	if(skb==NULL)
 		return NULL;
 	skb->free= 2;	/* Invalid so we pick up forgetful users */
@@ -451,17 +476,22 @@ struct sk_buff *alloc_skb(unsigned int size,int priority)
 }
 
 /*
- *	Free an skbuff by memory
+ *	Free an skbuff by memory. Some drivers still kmalloc() their own
+ *	receive buffers, so check where it came from.
  */
 
 void kfree_skbmem(void *mem,unsigned size)
 {
 	struct sk_buff *x=mem;
+	struct kmem_cache *cachep;
 	IS_SKB(x);
 	if(x->magic_debug_cookie==SK_GOOD_SKB)
 	{
 		x->magic_debug_cookie=SK_FREED_SKB;
-		kfree_s(mem,size);
+		if((cachep=kmem_find_cache(mem))!=NULL)
+			kmem_cache_free(cachep,mem);
+		else
+			kfree_s(mem,size);
 		net_skbcount--;
 		net_memory-=size;
 	}
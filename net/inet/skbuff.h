@@ -96,6 +96,7 @@ extern void			skb_unlink(struct sk_buff *buf);
 extern void 			skb_new_list_head(struct sk_buff *volatile* list);
 extern struct sk_buff *		skb_peek(struct sk_buff * volatile *list);
 extern struct sk_buff *		skb_peek_copy(struct sk_buff * volatile *list);
+extern void			skb_init(void);
 extern struct sk_buff *		alloc_skb(unsigned int size, int priority);
 extern void			kfree_skbmem(void *mem, unsigned size);
 extern void			skb_kept_by_device(struct sk_buff *skb);
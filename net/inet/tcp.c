@@ -90,6 +90,7 @@
 #include <linux/termios.h>
 #include <linux/in.h>
 #include <linux/fcntl.h>
+#include <linux/slab.h>
 #include "inet.h"
 #include "dev.h"
 #include "ip.h"
@@ -1753,7 +1754,7 @@ tcp_conn_request(struct sock *sk, struct sk_buff *skb,
    * and if the listening socket is destroyed before this is taken
    * off of the queue, this will take care of it.
    */
-  newsk = (struct sock *) kmalloc(sizeof(struct sock), GFP_ATOMIC);
+  newsk = (struct sock *) kmem_cache_alloc(sock_cache, GFP_ATOMIC);
   if (newsk == NULL) {
 	/* just ignore the syn.  It will get retransmitted. */
 	kfree_skb(skb, FREE_READ);
@@ -1801,6 +1802,8 @@ tcp_conn_request(struct sock *sk, struct sk_buff *skb,
   newsk->urg_data = 0;
   newsk->retransmits = 0;
   newsk->destroy = 0;
+  init_timer(&newsk->timer);
+  init_timer(&newsk->partial_timer);
   newsk->timer.data = (unsigned long)newsk;
   newsk->timer.function = &net_timer;
   newsk->dummy_th.source = skb->h.th->dest;
@@ -0,0 +1,188 @@
+/*
+ *  linux/tools/bitscan.c
+ *
+ *  Checks the bitmap scanning routines of <asm/bitops.h> against plain
+ *  bit-at-a-time versions, and times the two against each other.
+ *
+ *	gcc -O -I../include -o bitscan bitscan.c
+ *	bitscan [rounds]
+ *
+ *  The routines are taken straight from the kernel header, so this has
+ *  to be built for the machine the kernel is for (a long is 32 bits).
+ *  The checks run the find and count routines on bitmaps that are full,
+ *  empty, nearly full and random, from random offsets and with sizes
+ *  that aren't a multiple of 32, and stop at the first difference. The
+ *  timings are for one 8192-bit block group bitmap, the size the ext2,
+ *  minix and xiafs allocators scan.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define cli()
+#define sti()
+#include <asm/bitops.h>
+
+#define NBITS	8192
+#define NLONGS	(NBITS / 32)
+
+static unsigned long map[NLONGS + 1];
+
+static int ref_test(int nr)
+{
+	return (map[nr >> 5] >> (nr & 31)) & 1;
+}
+
+static int ref_find_next_zero_bit(int size, int offset)
+{
+	for ( ; offset < size ; offset++)
+		if (!ref_test(offset))
+			break;
+	return offset;
+}
+
+static unsigned long ref_count_zero_bits(unsigned long nbits)
+{
+	unsigned long i, sum = 0;
+
+	for (i = 0 ; i < nbits ; i++)
+		sum += !ref_test(i);
+	return sum;
+}
+
+static char * ref_find_first_zero_byte(int size)
+{
+	char * p = (char *) map;
+
+	while (size > 0 && *p) {
+		p++;
+		size--;
+	}
+	return p;
+}
+
+/*
+ * Fill the map so that about "ones" in 1000 bits are set.
+ */
+static void fill(int ones)
+{
+	int i;
+
+	for (i = 0 ; i < NBITS ; i++) {
+		if (rand() % 1000 < ones)
+			map[i >> 5] |= 1UL << (i & 31);
+		else
+			map[i >> 5] &= ~(1UL << (i & 31));
+	}
+	map[NLONGS] = ~0UL;
+}
+
+static void fail(char * what, int size, int offset, long got, long want)
+{
+	printf("%s(size %d, offset %d): got %ld, want %ld\n",
+		what, size, offset, got, want);
+	exit(1);
+}
+
+static void check(void)
+{
+	static int density[] = { 0, 1000, 999, 990, 900, 500, 100 };
+	int d, i, size, offset, got, want;
+	char * p, * q;
+
+	for (d = 0 ; d < sizeof(density) / sizeof(int) ; d++) {
+		for (i = 0 ; i < 2000 ; i++) {
+			fill(density[d]);
+			size = 1 + rand() % NBITS;
+			offset = rand() % (size + 1);
+			want = ref_find_next_zero_bit(size, offset);
+			got = find_next_zero_bit(map, size, offset);
+			/* past the end, any answer >= size means "none" */
+			if (got != want && !(want == size && got >= size))
+				fail("find_next_zero_bit", size, offset, got, want);
+			want = ref_find_next_zero_bit(size, 0);
+			got = find_first_zero_bit(map, size);
+			if (got != want && !(want == size && got >= size))
+				fail("find_first_zero_bit", size, 0, got, want);
+			if (count_zero_bits(map, size) != ref_count_zero_bits(size))
+				fail("count_zero_bits", size, 0,
+				     count_zero_bits(map, size),
+				     ref_count_zero_bits(size));
+			p = find_first_zero_byte(map, size / 8);
+			q = ref_find_first_zero_byte(size / 8);
+			if (p != q)
+				fail("find_first_zero_byte", size / 8, 0,
+				     p - (char *) map, q - (char *) map);
+		}
+	}
+	printf("all checks passed\n");
+}
+
+static struct timeval start;
+
+static void begin(void)
+{
+	gettimeofday(&start, NULL);
+}
+
+static void report(char * what, int rounds)
+{
+	struct timeval end;
+	double usecs;
+
+	gettimeofday(&end, NULL);
+	usecs = (end.tv_sec - start.tv_sec) * 1000000.0 +
+		(end.tv_usec - start.tv_usec);
+	printf("%-32s %10.3f usec/scan\n", what, usecs / rounds);
+}
+
+volatile unsigned long sink;
+
+int main(int argc, char ** argv)
+{
+	int rounds = 10000, i;
+
+	if (argc > 1)
+		rounds = atoi(argv[1]);
+	if (rounds < 1) {
+		fprintf(stderr, "usage: bitscan [rounds]\n");
+		exit(1);
+	}
+	srand(1);
+	check();
+
+	/* a nearly full group: the one free block is at the end */
+	memset(map, 0xff, sizeof(map));
+	map[NLONGS - 1] &= ~(1UL << 31);
+
+	begin();
+	for (i = 0 ; i < rounds ; i++)
+		sink += find_first_zero_bit(map, NBITS);
+	report("find_first_zero_bit", rounds);
+	begin();
+	for (i = 0 ; i < rounds ; i++)
+		sink += ref_find_next_zero_bit(NBITS, 0);
+	report("  bit at a time", rounds);
+
+	begin();
+	for (i = 0 ; i < rounds ; i++)
+		sink += find_next_zero_bit(map, NBITS, i % NBITS);
+	report("find_next_zero_bit", rounds);
+	begin();
+	for (i = 0 ; i < rounds ; i++)
+		sink += ref_find_next_zero_bit(NBITS, i % NBITS);
+	report("  bit at a time", rounds);
+
+	fill(500);
+	begin();
+	for (i = 0 ; i < rounds ; i++)
+		sink += count_zero_bits(map, NBITS);
+	report("count_zero_bits (random)", rounds);
+	begin();
+	for (i = 0 ; i < rounds ; i++)
+		sink += ref_count_zero_bits(NBITS);
+	report("  bit at a time", rounds);
+	return 0;
+}
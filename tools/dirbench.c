@@ -0,0 +1,117 @@
+/*
+ *  linux/tools/dirbench.c
+ *
+ *  Times creating, looking up and removing many files in one directory,
+ *  to compare a directory with and without the ext2 hashed index.
+ *
+ *	gcc -O -o dirbench dirbench.c
+ *	dirbench directory [nr-files]
+ *
+ *  The directory is made if needed and must not hold the test names
+ *  already. Run it on a filesystem mounted with "index" and then with
+ *  "noindex". The stat() pass goes through the names in a scrambled
+ *  order so that it doesn't just follow the order of creation. The
+ *  missing-name pass asks for names that aren't there, which is the
+ *  worst case for a linear search. With the directory cache in front
+ *  of the filesystem, repeated runs over the same names mostly measure
+ *  the cache, so every pass uses each name only once.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+static struct timeval start;
+static int nr = 10000;
+
+static void name_of(char * buf, char * prefix, int i)
+{
+	sprintf(buf, "%s%07d", prefix, i);
+}
+
+static void die(char * msg)
+{
+	perror(msg);
+	exit(1);
+}
+
+static void begin(void)
+{
+	gettimeofday(&start, NULL);
+}
+
+static void report(char * what)
+{
+	struct timeval end;
+	double usecs;
+
+	gettimeofday(&end, NULL);
+	usecs = (end.tv_sec - start.tv_sec) * 1000000.0 +
+		(end.tv_usec - start.tv_usec);
+	printf("%-8s %8d  %10.2f usec/op\n", what, nr, usecs / nr);
+}
+
+int main(int argc, char ** argv)
+{
+	char name[32];
+	struct stat st;
+	int i, j, fd;
+
+	if (argc < 2 || argc > 3) {
+		fprintf(stderr, "usage: dirbench directory [nr-files]\n");
+		exit(1);
+	}
+	if (argc == 3)
+		nr = atoi(argv[2]);
+	if (nr < 1) {
+		fprintf(stderr, "dirbench: bad number of files\n");
+		exit(1);
+	}
+	if (mkdir(argv[1], 0755) < 0 && errno != EEXIST)
+		die(argv[1]);
+	if (chdir(argv[1]) < 0)
+		die(argv[1]);
+
+	begin();
+	for (i = 0 ; i < nr ; i++) {
+		name_of(name, "f", i);
+		if ((fd = open(name, O_WRONLY | O_CREAT | O_EXCL, 0644)) < 0)
+			die(name);
+		close(fd);
+	}
+	report("create");
+
+	/* 7919 is prime, so this visits every name once unless nr is a multiple */
+	begin();
+	for (i = 0, j = 0 ; i < nr ; i++, j = (j + 7919) % nr) {
+		name_of(name, "f", (nr % 7919) ? j : i);
+		if (stat(name, &st) < 0)
+			die(name);
+	}
+	report("stat");
+
+	begin();
+	for (i = 0 ; i < nr ; i++) {
+		name_of(name, "m", i);
+		if (stat(name, &st) == 0 || errno != ENOENT) {
+			fprintf(stderr, "dirbench: %s: should not exist\n", name);
+			exit(1);
+		}
+	}
+	report("missing");
+
+	begin();
+	for (i = 0 ; i < nr ; i++) {
+		name_of(name, "f", i);
+		if (unlink(name) < 0)
+			die(name);
+	}
+	report("unlink");
+	return 0;
+}
@@ -0,0 +1,136 @@
+/*
+ *  linux/tools/ext2frag.c
+ *
+ *  Reports how fragmented the files on an ext2 filesystem are, using
+ *  the EXT2_IOC_GETEXTENTS ioctl.
+ *
+ *	gcc -O -o ext2frag ext2frag.c
+ *	ext2frag [-v] file-or-directory ...
+ *
+ *  Directories are walked recursively without crossing into other
+ *  filesystems. For every regular file the number of contiguous runs
+ *  of blocks ("extents") is asked for; -v prints them per file. The
+ *  summary gives the share of files that are in more than one piece
+ *  and the average number of extents per file, so that a tree can be
+ *  compared before and after a change to the block allocator.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/ext2_fs.h>
+
+#ifndef EXT2_IOC_GETEXTENTS
+#define EXT2_IOC_GETEXTENTS	_IOR('f', 3, long)
+#endif
+
+static int verbose = 0;
+static dev_t top_dev;
+
+static unsigned long files = 0, fragmented = 0, errors = 0;
+static unsigned long extents = 0, worst = 0;
+
+static void do_file(char * name, struct stat * st)
+{
+	long n;
+	int fd;
+
+	if ((fd = open(name, O_RDONLY)) < 0) {
+		perror(name);
+		errors++;
+		return;
+	}
+	if (ioctl(fd, EXT2_IOC_GETEXTENTS, &n) < 0) {
+		perror(name);
+		errors++;
+		close(fd);
+		return;
+	}
+	close(fd);
+	files++;
+	extents += n;
+	if (n > 1)
+		fragmented++;
+	if (n > worst)
+		worst = n;
+	if (verbose)
+		printf("%6ld %9ld  %s\n", n, (long) st->st_size, name);
+}
+
+static void walk(char * name)
+{
+	struct stat st;
+	struct dirent * de;
+	DIR * dir;
+	char * path;
+
+	if (lstat(name, &st) < 0) {
+		perror(name);
+		errors++;
+		return;
+	}
+	if (S_ISREG(st.st_mode)) {
+		do_file(name, &st);
+		return;
+	}
+	if (!S_ISDIR(st.st_mode) || st.st_dev != top_dev)
+		return;
+	if (!(dir = opendir(name))) {
+		perror(name);
+		errors++;
+		return;
+	}
+	while ((de = readdir(dir)) != NULL) {
+		if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
+			continue;
+		path = malloc(strlen(name) + strlen(de->d_name) + 2);
+		if (!path) {
+			fprintf(stderr, "ext2frag: out of memory\n");
+			exit(1);
+		}
+		sprintf(path, "%s/%s", name, de->d_name);
+		walk(path);
+		free(path);
+	}
+	closedir(dir);
+}
+
+int main(int argc, char ** argv)
+{
+	struct stat st;
+	int i = 1;
+
+	if (i < argc && !strcmp(argv[i], "-v")) {
+		verbose = 1;
+		i++;
+	}
+	if (i >= argc) {
+		fprintf(stderr, "usage: ext2frag [-v] file-or-directory ...\n");
+		exit(1);
+	}
+	if (verbose)
+		printf("extents      size  name\n");
+	for ( ; i < argc ; i++) {
+		if (stat(argv[i], &st) < 0) {
+			perror(argv[i]);
+			errors++;
+			continue;
+		}
+		top_dev = st.st_dev;
+		walk(argv[i]);
+	}
+	printf("%lu files, %lu extents, %lu fragmented (%lu.%lu%%)\n",
+		files, extents, fragmented,
+		files ? fragmented * 100 / files : 0,
+		files ? fragmented * 1000 / files % 10 : 0);
+	if (files)
+		printf("%lu.%02lu extents per file, worst file has %lu\n",
+			extents / files, extents * 100 / files % 100, worst);
+	return errors ? 1 : 0;
+}
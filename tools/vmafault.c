@@ -0,0 +1,102 @@
+/*
+ *  linux/tools/vmafault.c
+ *
+ *  Measures page fault latency against the number of memory mappings
+ *  a process has, to see how the vm area lookup scales.
+ *
+ *	gcc -O -o vmafault vmafault.c
+ *	vmafault [max-mappings]
+ *
+ *  A one-page scratch file is mapped privately over and over, so that
+ *  every mapping is a vm area of its own. With 16, 64, ... up to the
+ *  maximum of them in place, a batch of extra mappings is made and each
+ *  is read once. Each read takes one fault, which has to find its area
+ *  among all the others. The page is in the page cache after the first
+ *  fault, so the time per fault is mostly that lookup.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+#define PAGE		4096
+#define PROBES		256
+#define ROUNDS		16
+
+static char ** maps;
+static int nr_maps = 0;
+static int fd;
+volatile int sink;
+
+static char * map_one(void)
+{
+	char * p;
+
+	p = (char *) mmap(NULL, PAGE, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (p == (char *) -1) {
+		perror("mmap");
+		exit(1);
+	}
+	return p;
+}
+
+static double usecs(struct timeval * a, struct timeval * b)
+{
+	return (b->tv_sec - a->tv_sec) * 1000000.0 + (b->tv_usec - a->tv_usec);
+}
+
+int main(int argc, char ** argv)
+{
+	char name[32];
+	char * probe[PROBES];
+	char page[PAGE];
+	struct timeval start, end;
+	double total;
+	int max = 4096, n, i, r;
+
+	if (argc > 1)
+		max = atoi(argv[1]);
+	if (max < 16) {
+		fprintf(stderr, "usage: vmafault [max-mappings >= 16]\n");
+		exit(1);
+	}
+	sprintf(name, "/tmp/vmafault.%d", (int) getpid());
+	if ((fd = open(name, O_RDWR | O_CREAT | O_EXCL, 0600)) < 0) {
+		perror(name);
+		exit(1);
+	}
+	unlink(name);
+	for (i = 0 ; i < PAGE ; i++)
+		page[i] = i;
+	if (write(fd, page, PAGE) != PAGE) {
+		perror("write");
+		exit(1);
+	}
+	if (!(maps = (char **) malloc(max * sizeof(char *)))) {
+		fprintf(stderr, "vmafault: out of memory\n");
+		exit(1);
+	}
+	printf("mappings  usec/fault\n");
+	for (n = 16 ; n <= max ; n <<= 2) {
+		while (nr_maps < n)
+			maps[nr_maps++] = map_one();
+		total = 0;
+		for (r = 0 ; r < ROUNDS ; r++) {
+			for (i = 0 ; i < PROBES ; i++)
+				probe[i] = map_one();
+			gettimeofday(&start, NULL);
+			for (i = 0 ; i < PROBES ; i++)
+				sink += *probe[i];
+			gettimeofday(&end, NULL);
+			total += usecs(&start, &end);
+			for (i = 0 ; i < PROBES ; i++)
+				munmap(probe[i], PAGE);
+		}
+		printf("%8d  %10.2f\n", n + PROBES, total / (PROBES * ROUNDS));
+	}
+	return 0;
+}